@@ -0,0 +1,258 @@
+#ifndef __CLI_H__
+#define __CLI_H__
+
+/*
+ * cli.h: range2masks command line internals
+ *
+ * Copyright (c) 2017, 2018, 2019, 2020, 2021 Yoichi Hariguchi
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the
+ * Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall
+ * be included in all copies or substantial portions of the
+ * Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+ */
+
+#ifdef R2M_STATS
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#endif /* R2M_STATS */
+#include "range2masks.h"
+
+enum {
+    MAX_THREADS = 256,
+};
+
+enum {
+    STATS_TEXT = 1,             /* -stats text */
+    STATS_JSON,                 /* -stats json */
+};
+
+enum {
+    ACT_ACCEPT = R2M_ACCEPT,
+    ACT_REJECT = R2M_REJECT,
+};
+
+/*
+ * Command line options
+ */
+typedef struct cliOpts_ {
+    bool      optimize;         /* -optimize */
+    bool      minimize;         /* -minimize: r2mOptimize() */
+    bool      compact;          /* -compact: r2mCompact() the input */
+    r2mEngine engine;           /* -engine <name> */
+    r2mPortTbl *portTbl;        /* -engine port */
+    u32       parseFlags;       /* -ipv4: R2M_PARSE_ADDR */
+    bool      brief;            /* -brief: no patt/mask section */
+    int       binary;           /* -binary le|be: R2M_BIN_xx (0: text) */
+    bool      count;            /* -count: entry counts only */
+    u32       nThreads;         /* -j <n> */
+    u32       cacheSize;        /* -cache <n>: slots (0: no cache) */
+    u32       width;            /* -width <w>: W-bit keys (0: 32-bit
+                                   engines) */
+    u32       nFields;          /* -multi <w1,w2,...> (0: one field) */
+    u32       fieldWidth[R2M_MAXFIELD];
+    bool      delta;            /* -delta: r2mDeltaRange() */
+    char     *servePath;        /* -serve <path> (NULL: no server) */
+    int       stats;            /* -stats text|json: STATS_xx (0: off) */
+    bool      pipeline;         /* -pipeline: batchPipe() */
+    bool      verify;           /* -verify: r2mVerify() every result */
+    u32       dirpe;            /* -dirpe <c>: chunk bits (0: prefixes) */
+    bool      dedup;            /* -dedup: entry IDs + table */
+} cliOpts;
+
+/*
+ * Result of a conversion (what the cache keeps): rules in priority
+ * order, each with the action of the range or the inverse one
+ */
+enum {
+    MAX_PARTS = 32 + 1,         /* levels of an r2mOptimize() layout */
+};
+
+typedef struct cliPart_ {
+    u32     st;                 /* range shown for the rule */
+    u32     end;
+    bool    inv;                /* !act */
+    aclRule rule;
+} cliPart;
+
+typedef struct cliMemo_ {
+    int     rc;                 /* SUCCESS or error of range2masks() */
+    u32     nPart;
+    cliPart part[MAX_PARTS];    /* -optimize: [0, start-1] (!act),
+                                   [0, end] (act) if better */
+} cliMemo;
+
+/*
+ * Value of a cache slot: the entries are kept in the slot
+ * (a layout is chosen only if it has fewer than MAXENT entries)
+ */
+typedef struct cliCached_ {
+    cliMemo m;
+    tcamEnt ent[MAXENT];
+} cliCached;
+
+/*
+ * -stats counters (built with R2M_STATS only). The time is charged
+ * to the phase that was entered last (see STATS_PHASE()).
+ */
+typedef enum cliPhase_ {
+    PH_OTHER = 0,               /* reading the input, waiting */
+    PH_PARSE,                   /* splitting and parsing a record */
+    PH_DECOMP,                  /* decomposing (or the cache lookup) */
+    PH_OPT,                     /* -optimize / -minimize layouts */
+    PH_EMIT,                    /* formatting and writing the output */
+    PH_MAX,
+} cliPhase;
+
+typedef struct cliStats_ {
+    u64      tsc[PH_MAX];       /* ticks spent in each phase */
+    u64      last;              /* tick of the last phase change */
+    cliPhase cur;               /* current phase */
+    u64      nRanges;           /* converted ranges */
+    u64      nEnts;             /* entries written */
+    u64      nOpt;              /* ranges with -optimize or -minimize */
+    u64      nOptWon;           /* ... laid out in several rules */
+    u64      hist[MAXENT + 1];  /* ranges by number of entries */
+    u64      workTsc;           /* ticks of the merged workers */
+} cliStats;
+
+/*
+ * Conversion context: everything a conversion writes
+ */
+typedef struct cliCtx_ {
+    const cliOpts *o;
+    r2mOut         out;         /* output stage */
+    r2mBin         bin;         /* binary output (-binary) */
+    r2mArena       arena;       /* entries of the current record */
+    cliMemo        memo;        /* result w/o cache */
+    aclRule        rules[2];    /* [0]: 0 - (start-1), [1]: 0 - end */
+    r2mCache      *cache;       /* -cache (NULL: no cache) */
+    r2mCacheStats  cacheSt;     /* counters of the -j workers' caches */
+    u64            total;       /* total number of entries (-count) */
+    r2mIntern     *intern;      /* -dedup (NULL: off) */
+#ifdef R2M_STATS
+    cliStats       stats;       /* -stats */
+#endif /* R2M_STATS */
+} cliCtx;
+
+#ifdef R2M_STATS
+static inline u64
+cliTsc (void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static inline void
+cliStatsPhase (cliStats *s, cliPhase ph)
+{
+    u64 t = cliTsc();
+
+    s->tsc[s->cur] += t - s->last;
+    s->last = t;
+    s->cur  = ph;
+}
+
+static inline void
+cliStatsRange (cliStats *s, const cliOpts *o, u32 nEnt, u32 nPart)
+{
+    ++s->nRanges;
+    s->nEnts += nEnt;
+    ++s->hist[(nEnt < MAXENT) ? nEnt : MAXENT];
+    if (o->optimize || o->minimize) {
+        ++s->nOpt;
+        s->nOptWon += (nPart > 1);
+    }
+}
+
+/* Starts (or resumes) the clock in PH_OTHER */
+#define STATS_START(_c_)        do {                            \
+        if ((_c_)->o->stats) {                                  \
+            (_c_)->stats.last = cliTsc();                       \
+            (_c_)->stats.cur  = PH_OTHER;                       \
+        }                                                       \
+    } while (0)
+#define STATS_PHASE(_c_,_ph_)   do {                            \
+        if ((_c_)->o->stats) {                                  \
+            cliStatsPhase(&(_c_)->stats, (_ph_));               \
+        }                                                       \
+    } while (0)
+#define STATS_RANGE(_c_,_nEnt_,_nPart_) do {                    \
+        if ((_c_)->o->stats) {                                  \
+            cliStatsRange(&(_c_)->stats, (_c_)->o, (_nEnt_),    \
+                          (_nPart_));                           \
+        }                                                       \
+    } while (0)
+#else
+#define STATS_START(_c_)                do { } while (0)
+#define STATS_PHASE(_c_,_ph_)           do { } while (0)
+#define STATS_RANGE(_c_,_nEnt_,_nPart_) do { } while (0)
+#endif /* R2M_STATS */
+
+int  parseNumber (char *s, u32 *val, const cliOpts *o);
+int  parseWide (char *s, r2mU128 *val, const cliOpts *o);
+int  parseAction (char *s, int *act);
+int  parseActionSpan (const char *s, size_t len, int *act);
+int  solve (cliCtx *c, u32 start, u32 end, cliMemo *m);
+void memoize (cliCached *dst, const cliMemo *src, int rc);
+cliMemo *resolve (cliCtx *c, u32 start, u32 end);
+void emit (cliCtx *c, bool label, u32 st, u32 end, int act, int seq,
+           int nSeq, const aclRule *p);
+int  convert (cliCtx *c, u32 start, u32 end, int act, bool label);
+int  convertWide (cliCtx *c, r2mU128 start, r2mU128 end, int act,
+                  bool label);
+extern const char *actName[];
+
+int  splitFields (char *line, char **tok, int maxTok);
+int  processLine (cliCtx *c, char *line, u32 lineNum, const char *name);
+int  parseSpan (const cliOpts *o, const char *line, size_t len, u32 *start,
+                u32 *end, int *act);
+int  processSpan (cliCtx *c, const char *line, size_t len, u32 lineNum,
+                  const char *name);
+int  batchMt (cliCtx *c, FILE *fp, const char *map, size_t mapLen,
+              const char *name);
+int  batchMap (cliCtx *c, const char *file);
+int  batchPipe (cliCtx *c, FILE *fp, const char *map, size_t mapLen,
+                const char *name);
+int  batchCompact (cliCtx *c, FILE *fp, const char *name);
+int  parseFieldWidths (const char *s, cliOpts *o);
+int  convertMulti (cliCtx *c, char **tok, int nTok, u32 lineNum,
+                   const char *name);
+int  convertDelta (cliCtx *c, u32 oldSt, u32 oldEnd, u32 start, u32 end,
+                   int act);
+int  serve (cliCtx *c, const char *path);
+int  dedupEmit (cliCtx *c, bool label, u32 st, u32 end, int act,
+                const aclRule *p);
+void dedupFinish (cliCtx *c);
+#ifdef R2M_STATS
+void statsMerge (cliStats *dst, const cliStats *src);
+void statsPrint (const cliStats *s, const cliOpts *o, double wallNs,
+                 double nsPerTick);
+#endif /* R2M_STATS */
+
+#endif /* __CLI_H__ */
@@ -0,0 +1,110 @@
+/*
+ * cli_dedup.c: rules as IDs of shared entries (-dedup)
+ *
+ * Copyright (c) 2017, 2018, 2019, 2020, 2021 Yoichi Hariguchi
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the
+ * Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall
+ * be included in all copies or substantial portions of the
+ * Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+ */
+
+/*
+ * Every entry of every rule goes through r2mInternAdd(), so a rule is
+ * written out as the IDs of its entries:
+ *   "<action>: <st> - <end>" (as usual)
+ *   "ids: <id> <id> ..."
+ * and the distinct entries, once each, after the last rule:
+ *   "Entries: <n> (<references>)"
+ *   "<id> a.b.c.d/len"
+ * For a device with range checkers or label indirection, the table
+ * is what has to be loaded.
+ */
+
+#include "cli.h"
+
+
+/**
+ * @name  dedupEmit
+ *
+ * @brief Interns the entries of a rule and writes out their IDs
+ *
+ * @param[in] c     Conversion context (c->intern is set)
+ * @param[in] label Print the action and the range before the IDs
+ * @param[in] st    Number that the range of the rule starts
+ * @param[in] end   Number that the range of the rule ends
+ * @param[in] act   ACT_ACCEPT or ACT_REJECT
+ * @param[in] p     Entries of the rule
+ *
+ * @retval SUCCESS The rule is written out
+ * @retval < 0     Error code returned by r2mInternAdd()
+ */
+int
+dedupEmit (cliCtx *c, bool label, u32 st, u32 end, int act,
+           const aclRule *p)
+{
+    u32 i, id;
+    int rc;
+
+    if (label) {
+        r2mOutRange(&c->out, actName[act], st, end);
+    }
+    r2mOutStr(&c->out, "ids:");
+    for (i = 0; i < p->nEnt; ++i) {
+        if ((rc = r2mInternAdd(c->intern, p->ent + i, &id)) != SUCCESS) {
+            r2mOutStr(&c->out, "\n");
+            return rc;
+        }
+        r2mOutStr(&c->out, " ");
+        r2mOutU32(&c->out, id);
+    }
+    r2mOutStr(&c->out, "\n");
+    return SUCCESS;
+}
+
+/**
+ * @name  dedupFinish
+ *
+ * @brief Writes out the table of the distinct entries and reports
+ *        the saving on stderr
+ *
+ * @param[in] c Conversion context (c->intern is set)
+ */
+void
+dedupFinish (cliCtx *c)
+{
+    const tcamEnt *ent;
+    u32 nEnt, i;
+    u64 nRef;
+
+    ent = r2mInternEnts(c->intern, &nEnt, &nRef);
+    r2mOutStr(&c->out, "\nEntries: ");
+    r2mOutU32(&c->out, nEnt);
+    r2mOutStr(&c->out, " (");
+    r2mOutU64(&c->out, nRef);
+    r2mOutStr(&c->out, ")\n");
+    for (i = 0; i < nEnt; ++i) {
+        r2mOutU32(&c->out, i);
+        r2mOutStr(&c->out, " ");
+        r2mOutPrefix(&c->out, ent[i].patt, ent[i].mask);
+    }
+    fprintf(stderr, "dedup: %" PRIu64 " entries -> %u distinct entries\n",
+            nRef, nEnt);
+}
@@ -0,0 +1,121 @@
+/*
+ * cli_delta.c: TCAM updates of changed ranges (-delta)
+ *
+ * Copyright (c) 2017, 2018, 2019, 2020, 2021 Yoichi Hariguchi
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the
+ * Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall
+ * be included in all copies or substantial portions of the
+ * Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+ */
+
+/*
+ * A -delta record is "<old start> <old end> <start> <end> [action]".
+ * The old entries are those range2masks() made for the old range;
+ * r2mDeltaRange() tells which of them to delete and which entries to
+ * add so that the rule matches the new range.
+ */
+
+#include "cli.h"
+
+
+static void
+putEnts (cliCtx *c, const char *label, tcamEnt *ent, u32 nEnt)
+{
+    aclRule r = { nEnt, nEnt, ent };
+
+    if (nEnt == 0) {
+        return;
+    }
+    r2mOutStr(&c->out, label);
+    r2mOutStr(&c->out, ":\n");
+    r2mOutRule(&c->out, &r, !c->o->brief);
+}
+
+/**
+ * @name  convertDelta
+ *
+ * @brief Writes out the TCAM writes that change a rule from
+ *        [oldSt, oldEnd] to [start, end]:
+ *        "<action>: <old st> - <old end> -> <st> - <end>
+ *        (keep <n>, delete <n>, add <n>)" followed by the entries to
+ *        delete and to add (-count: "<old st> <old end> <st> <end>
+ *        <delete> <add> <keep>" only)
+ *
+ * @param[in] c      Conversion context
+ * @param[in] oldSt  Number that the old range starts
+ * @param[in] oldEnd Number that the old range ends
+ * @param[in] start  Number that the new range starts
+ * @param[in] end    Number that the new range ends
+ * @param[in] act    ACT_ACCEPT or ACT_REJECT
+ *
+ * @retval SUCCESS The delta is written out
+ * @retval Error code of r2mDeltaRange() otherwise
+ */
+int
+convertDelta (cliCtx *c, u32 oldSt, u32 oldEnd, u32 start, u32 end, int act)
+{
+    r2mDelta d;
+    int rc;
+
+
+    r2mArenaReset(&c->arena);
+    if ((rc = r2mDeltaRange(oldSt, oldEnd, start, end, &c->arena, &d))
+        != SUCCESS) {
+        return rc;
+    }
+    c->total += d.nDel + d.nAdd;
+    if (c->o->count) {
+        r2mOutU32(&c->out, oldSt);
+        r2mOutStr(&c->out, " ");
+        r2mOutU32(&c->out, oldEnd);
+        r2mOutStr(&c->out, " ");
+        r2mOutU32(&c->out, start);
+        r2mOutStr(&c->out, " ");
+        r2mOutU32(&c->out, end);
+        r2mOutStr(&c->out, " ");
+        r2mOutU32(&c->out, d.nDel);
+        r2mOutStr(&c->out, " ");
+        r2mOutU32(&c->out, d.nAdd);
+        r2mOutStr(&c->out, " ");
+        r2mOutU32(&c->out, d.nKeep);
+        r2mOutStr(&c->out, "\n");
+        return SUCCESS;
+    }
+    r2mOutStr(&c->out, actName[act]);
+    r2mOutStr(&c->out, ": ");
+    r2mOutU32(&c->out, oldSt);
+    r2mOutStr(&c->out, " - ");
+    r2mOutU32(&c->out, oldEnd);
+    r2mOutStr(&c->out, " -> ");
+    r2mOutU32(&c->out, start);
+    r2mOutStr(&c->out, " - ");
+    r2mOutU32(&c->out, end);
+    r2mOutStr(&c->out, " (keep ");
+    r2mOutU32(&c->out, d.nKeep);
+    r2mOutStr(&c->out, ", delete ");
+    r2mOutU32(&c->out, d.nDel);
+    r2mOutStr(&c->out, ", add ");
+    r2mOutU32(&c->out, d.nAdd);
+    r2mOutStr(&c->out, ")\n");
+    putEnts(c, "Delete", d.del, d.nDel);
+    putEnts(c, "Add", d.add, d.nAdd);
+    return SUCCESS;
+}
@@ -0,0 +1,100 @@
+/*
+ * cli_map.c: mmap()ed -f input
+ *
+ * Copyright (c) 2017, 2018, 2019, 2020, 2021 Yoichi Hariguchi
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the
+ * Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall
+ * be included in all copies or substantial portions of the
+ * Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+ */
+
+/*
+ * A regular -f file is mapped read-only instead of being read, and
+ * its records are converted where they are (processSpan()): nothing
+ * is copied on the way from the page cache to the parser. With -j,
+ * the slots of the workers point into the map as well.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "cli.h"
+
+
+/**
+ * @name  batchMap
+ *
+ * @brief Same as batch() for a file that is mmap()ed
+ *
+ * @param[in] c    Conversion context
+ * @param[in] file Path of the input file
+ *
+ * @retval SUCCESS    All the records are successfully converted
+ * @retval FAILURE    Otherwise
+ * @retval R2M_EINVAL 'file' cannot be mapped (not a regular file or
+ *                    empty); nothing is done, read it with batch()
+ */
+int
+batchMap (cliCtx *c, const char *file)
+{
+    const char *map, *p, *end, *nl;
+    struct stat sb;
+    u32 lineNum = 0;
+    int rc = SUCCESS;
+    int fd;
+
+
+    if ((fd = open(file, O_RDONLY)) < 0) {
+        fprintf(stderr, "ERROR: failed to open %s\n", file);
+        return FAILURE;
+    }
+    if (fstat(fd, &sb) < 0 || !S_ISREG(sb.st_mode) || sb.st_size == 0) {
+        close(fd);
+        return R2M_EINVAL;
+    }
+    map = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return R2M_EINVAL;
+    }
+    madvise((void *)map, sb.st_size, MADV_SEQUENTIAL);
+
+    if (c->o->pipeline) {
+        rc = batchPipe(c, NULL, map, sb.st_size, file);
+    } else if (c->o->nThreads > 1) {
+        rc = batchMt(c, NULL, map, sb.st_size, file);
+    } else {
+        end = map + sb.st_size;
+        for (p = map; p < end; p = nl + 1) {
+            if ((nl = memchr(p, '\n', end - p)) == NULL) {
+                nl = end;       /* last line w/o newline */
+            }
+            STATS_PHASE(c, PH_PARSE);
+            if (processSpan(c, p, nl - p, ++lineNum, file) != SUCCESS) {
+                rc = FAILURE;
+            }
+            STATS_PHASE(c, PH_OTHER);
+        }
+    }
+    munmap((void *)map, sb.st_size);
+    return rc;
+}
@@ -0,0 +1,460 @@
+/*
+ * cli_mt.c: multi-threaded batch conversion (-j)
+ *
+ * Copyright (c) 2017, 2018, 2019, 2020, 2021 Yoichi Hariguchi
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the
+ * Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall
+ * be included in all copies or substantial portions of the
+ * Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+ */
+
+/*
+ * The main thread cuts the input into chunks at line boundaries and
+ * puts them into a ring of slots. Workers take the slots in order
+ * and convert each chunk into the slot's own output buffer, with
+ * their own cliCtx (scratch rules, output stage). The main thread
+ * writes the slots out in order as they complete, so the output is
+ * the same as the one of a single thread; nothing goes through stdio.
+ * mmap()ed input (batchMap()) is not copied: the slots point into it.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include "cli.h"
+
+enum {
+    CHUNK_SIZE    = 1024 * 1024, /* input bytes per chunk */
+    SLOTS_PER_THR = 2,           /* slots per worker */
+    WORK_OUTBUF   = 64 * 1024,   /* output stage buffer of a worker */
+};
+
+typedef enum slotState_ {
+    SLOT_FREE = 0,
+    SLOT_READY,                 /* input filled, waiting for a worker */
+    SLOT_BUSY,                  /* being converted */
+    SLOT_DONE,                  /* output ready to be written */
+} slotState;
+
+typedef struct mtSlot_ {
+    slotState state;
+    char     *in;               /* input buffer (NULL: mmap()ed input) */
+    const char *data;           /* input lines ('in' or the map) */
+    size_t    inLen;
+    size_t    inSize;
+    u32       lineNum;          /* number of the first line */
+    char     *out;              /* converted output */
+    size_t    outLen;
+    size_t    outSize;
+    int       rc;               /* FAILURE if a record failed */
+} mtSlot;
+
+typedef struct mtCtx_ {
+    pthread_mutex_t mtx;
+    pthread_cond_t  cv;
+    mtSlot         *slots;
+    u32             nSlots;
+    u32             next;       /* next slot the workers take */
+    bool            quit;
+    cliCtx         *work;       /* per worker contexts */
+    const char     *name;
+} mtCtx;
+
+
+/*
+ * r2mOut drain: appends the worker's buffer to the slot output
+ */
+static int
+drainToSlot (r2mOut *o)
+{
+    mtSlot *s = o->arg;
+    size_t size;
+    char *p;
+
+    if (s->outLen + o->len > s->outSize) {
+        size = s->outSize ? s->outSize : WORK_OUTBUF;
+        while (size < s->outLen + o->len) {
+            size *= 2;
+        }
+        if ((p = realloc(s->out, size)) == NULL) {
+            return R2M_ENOSPC;
+        }
+        s->out     = p;
+        s->outSize = size;
+    }
+    memcpy(s->out + s->outLen, o->buf, o->len);
+    s->outLen += o->len;
+    return SUCCESS;
+}
+
+static void
+convertSlot (cliCtx *c, mtSlot *s, const char *name)
+{
+    const char *p   = s->data;
+    const char *end = s->data + s->inLen;
+    u32 lineNum = s->lineNum;
+    const char *nl;
+
+    s->outLen  = 0;
+    s->rc      = SUCCESS;
+    c->out.arg = s;
+    STATS_START(c);
+    while (p < end) {
+        if ((nl = memchr(p, '\n', end - p)) == NULL) {
+            nl = end;           /* last line w/o newline */
+        }
+        STATS_PHASE(c, PH_PARSE);
+        if (processSpan(c, p, nl - p, lineNum++, name) != SUCCESS) {
+            s->rc = FAILURE;
+        }
+        p = nl + 1;
+    }
+    STATS_PHASE(c, PH_EMIT);
+    if (r2mOutFlush(&c->out) != SUCCESS) {
+        fprintf(stderr, "ERROR: %s:%u: out of memory\n", name, s->lineNum);
+        s->rc = FAILURE;
+        c->out.err = SUCCESS;   /* the next slot may do better */
+        c->out.len = 0;
+    }
+    STATS_PHASE(c, PH_OTHER);
+}
+
+typedef struct workArg_ {
+    mtCtx  *m;
+    cliCtx *c;
+} workArg;
+
+static void *
+worker (void *arg)
+{
+    mtCtx  *m = ((workArg *)arg)->m;
+    cliCtx *c = ((workArg *)arg)->c;
+    mtSlot *s;
+
+    pthread_mutex_lock(&m->mtx);
+    for (;;) {
+        while (!m->quit && m->slots[m->next].state != SLOT_READY) {
+            pthread_cond_wait(&m->cv, &m->mtx);
+        }
+        if (m->slots[m->next].state != SLOT_READY) {
+            break;              /* quit */
+        }
+        s = m->slots + m->next;
+        s->state = SLOT_BUSY;
+        m->next  = (m->next + 1) % m->nSlots;
+        pthread_mutex_unlock(&m->mtx);
+
+        convertSlot(c, s, m->name);
+
+        pthread_mutex_lock(&m->mtx);
+        s->state = SLOT_DONE;
+        pthread_cond_broadcast(&m->cv);
+    }
+    pthread_mutex_unlock(&m->mtx);
+    return NULL;
+}
+
+/*
+ * Reads the next chunk of whole lines into 's'. 'carry' keeps the
+ * partial last line for the next chunk.
+ * Returns FALSE at the end of the input.
+ */
+static bool
+fillSlot (mtSlot *s, FILE *fp, char **carry, size_t *carryLen, u32 *lineNum)
+{
+    size_t len = *carryLen;
+    size_t n;
+    char *p;
+
+    if (s->inSize < len + CHUNK_SIZE + 1) {
+        if ((p = realloc(s->in, len + CHUNK_SIZE + 1)) == NULL) {
+            return FALSE;
+        }
+        s->in     = p;
+        s->inSize = len + CHUNK_SIZE + 1;
+    }
+    if (len) {
+        memcpy(s->in, *carry, len);
+    }
+    for (;;) {
+        n    = fread(s->in + len, 1, s->inSize - 1 - len, fp);
+        len += n;
+        if (n == 0) {
+            p = s->in + len;    /* EOF: take everything */
+            break;
+        }
+        if (len < s->inSize - 1) {
+            continue;
+        }
+        /* The buffer is full: the chunk ends at the last newline */
+        for (p = s->in + len; p > s->in && p[-1] != '\n'; --p) {
+        }
+        if (p > s->in) {
+            break;
+        }
+        /* No newline at all: a line longer than the buffer */
+        if ((p = realloc(s->in, s->inSize * 2)) == NULL) {
+            return FALSE;
+        }
+        s->in      = p;
+        s->inSize *= 2;
+    }
+    *carryLen = s->in + len - p;
+    if (*carryLen) {
+        char *q;
+
+        if ((q = realloc(*carry, *carryLen)) == NULL) {
+            return FALSE;
+        }
+        *carry = q;
+        memcpy(*carry, p, *carryLen);
+    }
+    s->data    = s->in;
+    s->inLen   = p - s->in;
+    s->lineNum = *lineNum;
+    for (p = s->in; (p = memchr(p, '\n', s->in + s->inLen - p)); ++p) {
+        ++*lineNum;
+    }
+    return s->inLen > 0;
+}
+
+/*
+ * Same as fillSlot() for mmap()ed input: the slot points to the next
+ * CHUNK_SIZE bytes of the map, up to the end of the line.
+ */
+static bool
+mapSlot (mtSlot *s, const char *map, size_t mapLen, size_t *pos,
+         u32 *lineNum)
+{
+    const char *p   = map + *pos;
+    const char *end = map + mapLen;
+    const char *nl;
+
+    if (p == end) {
+        return FALSE;
+    }
+    if (end - p <= CHUNK_SIZE ||
+        (nl = memchr(p + CHUNK_SIZE, '\n', end - p - CHUNK_SIZE)) == NULL) {
+        nl = end;
+    } else {
+        ++nl;
+    }
+    s->data    = p;
+    s->inLen   = nl - p;
+    s->lineNum = *lineNum;
+    *pos      += s->inLen;
+    for (; (p = memchr(p, '\n', nl - p)); ++p) {
+        ++*lineNum;
+    }
+    return TRUE;
+}
+
+static int
+writeAll (int fd, const char *buf, size_t len)
+{
+    ssize_t n;
+
+    while (len) {
+        if ((n = write(fd, buf, len)) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return R2M_EFAIL;
+        }
+        buf += n;
+        len -= n;
+    }
+    return SUCCESS;
+}
+
+/**
+ * @name  batchMt
+ *
+ * @brief Same as batch() but converts with c->o->nThreads workers
+ *
+ * @param[in] c    Conversion context. Its output stage is used for
+ *                 the output; entry and binary rule counts of the
+ *                 workers are added to it.
+ * @param[in] fp     Input stream (NULL: 'map')
+ * @param[in] map    mmap()ed input, converted where it is
+ * @param[in] mapLen Length of 'map'
+ * @param[in] name   Name of the input stream (for error messages)
+ *
+ * @retval SUCCESS All the records are successfully converted
+ * @retval FAILURE Otherwise
+ */
+int
+batchMt (cliCtx *c, FILE *fp, const char *map, size_t mapLen,
+         const char *name)
+{
+    u32 nThr = c->o->nThreads;
+    pthread_t *thr;
+    workArg *args;
+    char **bufs;
+    mtCtx m;
+    char *carry = NULL;
+    size_t carryLen = 0;
+    size_t pos = 0;
+    u32 lineNum = 1;
+    u32 head = 0, tail = 0, inFlight = 0;
+    bool eof = FALSE;
+    int rc = SUCCESS;
+    u32 nStarted = 0;           /* workers running */
+    u32 i;
+
+
+    memset(&m, 0, sizeof(m));
+    m.nSlots = nThr * SLOTS_PER_THR;
+    m.name   = name;
+    m.slots  = calloc(m.nSlots, sizeof(*m.slots));
+    m.work   = calloc(nThr, sizeof(*m.work));
+    thr      = calloc(nThr, sizeof(*thr));
+    args     = calloc(nThr, sizeof(*args));
+    bufs     = calloc(nThr, sizeof(*bufs));
+    if (!m.slots || !m.work || !thr || !args || !bufs) {
+        fprintf(stderr, "ERROR: out of memory\n");
+        free(bufs);
+        free(args);
+        free(thr);
+        free(m.work);
+        free(m.slots);
+        return FAILURE;
+    }
+    pthread_mutex_init(&m.mtx, NULL);
+    pthread_cond_init(&m.cv, NULL);
+
+    for (i = 0; i < nThr; ++i) {
+        cliCtx *w = m.work + i;
+
+        w->o = c->o;
+        r2mArenaInit(&w->arena, 0);
+        w->cache = NULL;
+        if ((bufs[i] = malloc(WORK_OUTBUF)) == NULL ||
+            (c->cache &&
+             (w->cache = r2mCacheCreate(c->o->cacheSize,
+                                        sizeof(cliCached))) == NULL)) {
+            fprintf(stderr, "ERROR: out of memory\n");
+            rc = FAILURE;
+            goto stop;
+        }
+        r2mOutInit(&w->out, -1, bufs[i], WORK_OUTBUF);
+        w->out.drain = drainToSlot;
+        w->bin       = c->bin;  /* same byte order, no header */
+        w->bin.o      = &w->out;
+        w->bin.hdrOff = -1;
+        w->bin.nRules = 0;
+        w->bin.nEnts  = 0;
+        args[i].m = &m;
+        args[i].c = w;
+        if (pthread_create(thr + i, NULL, worker, args + i) != 0) {
+            fprintf(stderr, "ERROR: failed to create a thread\n");
+            rc = FAILURE;
+            goto stop;
+        }
+        ++nStarted;
+    }
+
+    /*
+     * Keep every slot busy; write the oldest one when it's done.
+     */
+    for (;;) {
+        while (!eof && inFlight < m.nSlots) {
+            mtSlot *s = m.slots + tail;
+
+            if ((fp) ? !fillSlot(s, fp, &carry, &carryLen, &lineNum) :
+                !mapSlot(s, map, mapLen, &pos, &lineNum)) {
+                if (fp && (ferror(fp) || carryLen)) {
+                    fprintf(stderr, "ERROR: %s: read error\n", name);
+                    rc = FAILURE;
+                }
+                eof = TRUE;
+                break;
+            }
+            pthread_mutex_lock(&m.mtx);
+            s->state = SLOT_READY;
+            pthread_cond_broadcast(&m.cv);
+            pthread_mutex_unlock(&m.mtx);
+            tail = (tail + 1) % m.nSlots;
+            ++inFlight;
+        }
+        if (inFlight == 0) {
+            break;
+        }
+
+        pthread_mutex_lock(&m.mtx);
+        while (m.slots[head].state != SLOT_DONE) {
+            pthread_cond_wait(&m.cv, &m.mtx);
+        }
+        pthread_mutex_unlock(&m.mtx);
+
+        if (m.slots[head].rc != SUCCESS) {
+            rc = FAILURE;
+        }
+        if (r2mOutFlush(&c->out) == SUCCESS &&
+            writeAll(c->out.fd, m.slots[head].out,
+                     m.slots[head].outLen) != SUCCESS) {
+            c->out.err = R2M_EFAIL;
+        }
+        m.slots[head].state = SLOT_FREE;
+        head = (head + 1) % m.nSlots;
+        --inFlight;
+    }
+
+stop:
+    pthread_mutex_lock(&m.mtx);
+    m.quit = TRUE;
+    pthread_cond_broadcast(&m.cv);
+    pthread_mutex_unlock(&m.mtx);
+    for (i = 0; i < nStarted; ++i) {
+        pthread_join(thr[i], NULL);
+        c->total      += m.work[i].total;
+        c->bin.nRules += m.work[i].bin.nRules;
+        c->bin.nEnts  += m.work[i].bin.nEnts;
+#ifdef R2M_STATS
+        statsMerge(&c->stats, &m.work[i].stats);
+#endif /* R2M_STATS */
+        if (m.work[i].cache) {
+            r2mCacheStats st;
+
+            r2mCacheGetStats(m.work[i].cache, &st);
+            c->cacheSt.hits      += st.hits;
+            c->cacheSt.misses    += st.misses;
+            c->cacheSt.evictions += st.evictions;
+        }
+    }
+    for (i = 0; i < nThr; ++i) {        /* set up or not (all zero) */
+        r2mCacheDestroy(m.work[i].cache);
+        r2mArenaFree(&m.work[i].arena);
+        free(bufs[i]);
+    }
+    for (i = 0; i < m.nSlots; ++i) {
+        free(m.slots[i].in);
+        free(m.slots[i].out);
+    }
+    pthread_cond_destroy(&m.cv);
+    pthread_mutex_destroy(&m.mtx);
+    free(carry);
+    free(bufs);
+    free(args);
+    free(thr);
+    free(m.work);
+    free(m.slots);
+    return rc;
+}
@@ -0,0 +1,176 @@
+/*
+ * cli_multi.c: multi-field rules (-multi)
+ *
+ * Copyright (c) 2017, 2018, 2019, 2020, 2021 Yoichi Hariguchi
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the
+ * Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall
+ * be included in all copies or substantial portions of the
+ * Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+ */
+
+/*
+ * A -multi record is "<st>-<end> <st>-<end> ... [action]", one
+ * range per field. The size of the rule is estimated first, then
+ * the combined entries are streamed out one at a time, so even a
+ * huge cross product takes no memory beyond the per-field entries.
+ */
+
+#include "cli.h"
+
+
+/**
+ * @name  parseFieldWidths
+ *
+ * @brief Parses the -multi argument "w1,w2,..."
+ *
+ * @param[in]  s Argument
+ * @param[out] o Options (nFields and fieldWidth[])
+ *
+ * @retval SUCCESS The widths are set
+ * @retval FAILURE Otherwise
+ */
+int
+parseFieldWidths (const char *s, cliOpts *o)
+{
+    char *end;
+    unsigned long w;
+
+    o->nFields = 0;
+    for (;;) {
+        w = strtoul(s, &end, 10);
+        if (end == s || w == 0 || w > 32 || o->nFields == R2M_MAXFIELD) {
+            return FAILURE;
+        }
+        o->fieldWidth[o->nFields++] = w;
+        if (*end == '\0') {
+            return SUCCESS;
+        }
+        if (*end != ',') {
+            return FAILURE;
+        }
+        s = end + 1;
+    }
+}
+
+/* "<st>-<end>" */
+static int
+parseField (const char *s, r2mField *f, const cliOpts *o)
+{
+    const char *dash = strchr(s, '-');
+
+    if (!dash ||
+        r2mParseNum(s, dash - s, o->parseFlags, &f->st, NULL) != SUCCESS ||
+        r2mParseNum(dash + 1, strlen(dash + 1), o->parseFlags, &f->end,
+                    NULL) != SUCCESS) {
+        return FAILURE;
+    }
+    return SUCCESS;
+}
+
+/**
+ * @name  convertMulti
+ *
+ * @brief Converts a -multi record and writes it out:
+ *        "<action>: <st> - <end>, ... (<n> entries, direct <n>)"
+ *        followed by one line per combined entry in priority order
+ *        (-count: "<entries> <direct>" only)
+ *
+ * @param[in] c       Conversion context
+ * @param[in] tok     Fields of the record
+ * @param[in] nTok    Number of fields
+ * @param[in] lineNum Line number of the record (for error messages)
+ * @param[in] name    Name of the input (for error messages)
+ *
+ * @retval SUCCESS The record is converted
+ * @retval FAILURE Otherwise
+ */
+int
+convertMulti (cliCtx *c, char **tok, int nTok, u32 lineNum,
+              const char *name)
+{
+    const cliOpts *o = c->o;
+    r2mField fld[R2M_MAXFIELD];
+    tcamEnt ent[R2M_MAXFIELD];
+    r2mMultiIter it;
+    r2mMulti m;
+    bool rej;
+    int act;
+    u64 n, nDirect = 0;
+    u32 f;
+    int rc;
+
+
+    if (nTok != o->nFields && nTok != o->nFields + 1) {
+        fprintf(stderr, "ERROR: %s:%u: wrong number of fields\n",
+                name, lineNum);
+        return FAILURE;
+    }
+    for (f = 0; f < o->nFields; ++f) {
+        fld[f].width = o->fieldWidth[f];
+        if (parseField(tok[f], fld + f, o) != SUCCESS) {
+            break;
+        }
+    }
+    if (f < o->nFields ||
+        parseAction((nTok > o->nFields) ? tok[f] : NULL, &act) != SUCCESS) {
+        fprintf(stderr, "ERROR: %s:%u: failed to parse the record\n",
+                name, lineNum);
+        return FAILURE;
+    }
+    if ((n = r2mMultiEstimate(fld, o->nFields, &nDirect)) == 0) {
+        fprintf(stderr, "ERROR: %s:%u: range out of bounds\n",
+                name, lineNum);
+        return FAILURE;
+    }
+    c->total += n;
+    if (o->count) {
+        r2mOutU64(&c->out, n);
+        r2mOutStr(&c->out, " ");
+        r2mOutU64(&c->out, nDirect);
+        r2mOutStr(&c->out, "\n");
+        return SUCCESS;
+    }
+
+    r2mArenaReset(&c->arena);
+    if ((rc = r2mMultiCompile(fld, o->nFields, &c->arena, &m)) != SUCCESS) {
+        fprintf(stderr, "ERROR: %s:%u: failed to convert: %s\n",
+                name, lineNum, r2mStrerror(rc));
+        return FAILURE;
+    }
+    r2mOutStr(&c->out, actName[act]);
+    r2mOutStr(&c->out, ":");
+    for (f = 0; f < o->nFields; ++f) {
+        r2mOutStr(&c->out, (f == 0) ? " " : ", ");
+        r2mOutU32(&c->out, fld[f].st);
+        r2mOutStr(&c->out, " - ");
+        r2mOutU32(&c->out, fld[f].end);
+    }
+    r2mOutStr(&c->out, " (");
+    r2mOutU64(&c->out, n);
+    r2mOutStr(&c->out, " entries, direct ");
+    r2mOutU64(&c->out, nDirect);
+    r2mOutStr(&c->out, ")\n");
+    r2mMultiIterInit(&it, &m);
+    while (r2mMultiNext(&it, ent, &rej)) {
+        r2mOutMultiEnt(&c->out, actName[act ^ rej], &m, ent);
+    }
+    return SUCCESS;
+}
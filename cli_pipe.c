@@ -0,0 +1,308 @@
+/*
+ * cli_pipe.c: parse -> convert -> emit pipeline (-pipeline)
+ *
+ * Copyright (c) 2017, 2018, 2019, 2020, 2021 Yoichi Hariguchi
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the
+ * Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall
+ * be included in all copies or substantial portions of the
+ * Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+ */
+
+/*
+ * Each stage of a record has its own thread: the calling thread
+ * parses the input into batches of ranges, a decomposer converts a
+ * batch into its results and an emitter writes them out. The stages
+ * hand batches to each other through single producer, single
+ * consumer rings, and the emitter gives the written batches back to
+ * the parser through a third one:
+ *
+ *   parser -> toConv -> decomposer -> toEmit -> emitter -> toParse -+
+ *     ^                                                              |
+ *     +--------------------------------------------------------------+
+ *
+ * All PIPE_NBATCH batches are allocated up front and every ring has
+ * room for all of them, so a put never fails; a stage that runs ahead
+ * waits for a free batch (backpressure) and nothing is buffered
+ * beyond them. A stage waiting for a ring spins a little and then
+ * yields the CPU.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include "cli.h"
+
+enum {
+    PIPE_BATCH  = 256,          /* records per batch */
+    PIPE_NBATCH = 8,            /* batches in flight (power of 2) */
+    PIPE_SPIN   = 128,          /* polls before sched_yield() */
+};
+
+typedef struct pipeRec_ {
+    u32 st;                     /* range start */
+    u32 end;                    /* range end */
+    u32 lineNum;
+    int act;                    /* ACT_ACCEPT or ACT_REJECT */
+} pipeRec;
+
+typedef struct pipeBatch_ {
+    u32       n;                /* number of records */
+    bool      last;             /* end of the input */
+    pipeRec   rec[PIPE_BATCH];
+    cliCached res[PIPE_BATCH];  /* results (m.rc: error) */
+} pipeBatch;
+
+typedef struct pipeRing_ {
+    _Atomic u32 head __attribute__((aligned(64)));  /* consumer */
+    _Atomic u32 tail __attribute__((aligned(64)));  /* producer */
+    pipeBatch  *slot[PIPE_NBATCH] __attribute__((aligned(64)));
+} pipeRing;
+
+typedef struct pipeCtx_ {
+    pipeRing    toConv;
+    pipeRing    toEmit;
+    pipeRing    toParse;
+    cliCtx      conv;           /* decomposer (arena, cache) */
+    cliCtx     *emit;           /* emitter (output stage) */
+    const char *name;
+    int         convRc;         /* FAILURE if a range failed */
+} pipeCtx;
+
+
+static inline void
+backoff (u32 *spin)
+{
+    if (++*spin < PIPE_SPIN) {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+        return;
+    }
+    *spin = 0;
+    sched_yield();
+}
+
+static void
+ringPut (pipeRing *r, pipeBatch *b)
+{
+    u32 t = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    u32 spin = 0;
+
+    while (t - atomic_load_explicit(&r->head, memory_order_acquire) ==
+           PIPE_NBATCH) {
+        backoff(&spin);           /* never: every ring holds all of them */
+    }
+    r->slot[t % PIPE_NBATCH] = b;
+    atomic_store_explicit(&r->tail, t + 1, memory_order_release);
+}
+
+static pipeBatch *
+ringGet (pipeRing *r)
+{
+    u32 h = atomic_load_explicit(&r->head, memory_order_relaxed);
+    u32 spin = 0;
+    pipeBatch *b;
+
+    while (h == atomic_load_explicit(&r->tail, memory_order_acquire)) {
+        backoff(&spin);
+    }
+    b = r->slot[h % PIPE_NBATCH];
+    atomic_store_explicit(&r->head, h + 1, memory_order_release);
+    return b;
+}
+
+static void *
+decomposer (void *arg)
+{
+    pipeCtx *pc = arg;
+    cliCtx *c = &pc->conv;
+    const cliMemo *m;
+    pipeBatch *b;
+    pipeRec *r;
+    int rc;
+    u32 i;
+
+    STATS_START(c);
+    do {
+        b = ringGet(&pc->toConv);
+        for (i = 0; i < b->n; ++i) {
+            r  = b->rec + i;
+            m  = resolve(c, r->st, r->end);
+            rc = m->rc;
+            memoize(b->res + i, m, rc);
+            if (rc != SUCCESS) {
+                fprintf(stderr, "ERROR: %s:%u: failed to convert %u - %u:"
+                        " %s\n", pc->name, r->lineNum, r->st, r->end,
+                        r2mStrerror(rc));
+                pc->convRc = FAILURE;
+            }
+        }
+        STATS_PHASE(c, PH_OTHER);
+        ringPut(&pc->toEmit, b);
+    } while (!b->last);
+    return NULL;
+}
+
+static void *
+emitter (void *arg)
+{
+    pipeCtx *pc = arg;
+    cliCtx *c = pc->emit;
+    const cliMemo *m;
+    const cliPart *p;
+    pipeBatch *b;
+    u32 i, k;
+
+    do {
+        b = ringGet(&pc->toEmit);
+        STATS_PHASE(c, PH_EMIT);
+        for (i = 0; i < b->n; ++i) {
+            m = &b->res[i].m;
+            for (k = 0; k < m->nPart; ++k) {
+                p = m->part + k;
+                emit(c, TRUE, p->st, p->end, b->rec[i].act ^ p->inv, k,
+                     m->nPart, &p->rule);
+            }
+        }
+        STATS_PHASE(c, PH_OTHER);
+        ringPut(&pc->toParse, b);
+    } while (!b->last);
+    return NULL;
+}
+
+/**
+ * @name  batchPipe
+ *
+ * @brief Same as batch() but parses, converts and writes out the
+ *        records in three threads (plain 32-bit records only)
+ *
+ * @param[in] c      Conversion context. Its output stage and cache are
+ *                   used by the emitter and the decomposer.
+ * @param[in] fp     Input stream (NULL: 'map')
+ * @param[in] map    mmap()ed input
+ * @param[in] mapLen Length of 'map'
+ * @param[in] name   Name of the input stream (for error messages)
+ *
+ * @retval SUCCESS All the records are successfully converted
+ * @retval FAILURE Otherwise
+ */
+int
+batchPipe (cliCtx *c, FILE *fp, const char *map, size_t mapLen,
+           const char *name)
+{
+    pipeBatch *batches, *b;
+    pthread_t conv, emit;
+    pipeCtx *pc;
+    cliCtx parser;
+    const char *p = map, *nl;
+    char *line = NULL;
+    size_t size = 0;
+    ssize_t len;
+    u32 lineNum = 0;
+    int rc = SUCCESS, st;
+    u32 i;
+
+
+    /* the rings are cache line aligned: not calloc() */
+    pc      = aligned_alloc(_Alignof(pipeCtx), sizeof(*pc));
+    batches = calloc(PIPE_NBATCH, sizeof(*batches));
+    if (!pc || !batches) {
+        fprintf(stderr, "ERROR: out of memory\n");
+        free(batches);
+        free(pc);
+        return FAILURE;
+    }
+    memset(pc, 0, sizeof(*pc));
+    for (i = 0; i < PIPE_NBATCH; ++i) {
+        ringPut(&pc->toParse, batches + i);
+    }
+    pc->conv.o     = c->o;
+    pc->conv.cache = c->cache;
+    r2mArenaInit(&pc->conv.arena, 0);
+    pc->emit   = c;
+    pc->name   = name;
+    pc->convRc = SUCCESS;
+
+    memset(&parser, 0, sizeof(parser));
+    parser.o = c->o;
+    STATS_START(&parser);
+
+    if (pthread_create(&conv, NULL, decomposer, pc) != 0 ||
+        pthread_create(&emit, NULL, emitter, pc) != 0) {
+        fprintf(stderr, "ERROR: failed to create a thread\n");
+        exit(1);
+    }
+
+    do {
+        b = ringGet(&pc->toParse);
+        STATS_PHASE(&parser, PH_PARSE);
+        b->n    = 0;
+        b->last = FALSE;
+        while (b->n < PIPE_BATCH) {
+            if (fp) {
+                if ((len = getline(&line, &size, fp)) < 0) {
+                    b->last = TRUE;
+                    break;
+                }
+                p = line;
+            } else {
+                if (p == map + mapLen) {
+                    b->last = TRUE;
+                    break;
+                }
+                if ((nl = memchr(p, '\n', map + mapLen - p)) == NULL) {
+                    nl = map + mapLen;
+                }
+                len = nl - p;
+            }
+            ++lineNum;
+            st = parseSpan(c->o, p, len, &b->rec[b->n].st,
+                           &b->rec[b->n].end, &b->rec[b->n].act);
+            if (st > 0) {
+                b->rec[b->n++].lineNum = lineNum;
+            } else if (st < 0) {
+                /* only reports the error: the record does not parse */
+                processSpan(&parser, p, len, lineNum, name);
+                rc = FAILURE;
+            }
+            if (!fp) {
+                p += len + (p + len < map + mapLen);
+            }
+        }
+        STATS_PHASE(&parser, PH_OTHER);
+        ringPut(&pc->toConv, b);
+    } while (!b->last);
+
+    pthread_join(conv, NULL);
+    pthread_join(emit, NULL);
+    if (pc->convRc != SUCCESS) {
+        rc = FAILURE;
+    }
+#ifdef R2M_STATS
+    statsMerge(&c->stats, &parser.stats);
+    statsMerge(&c->stats, &pc->conv.stats);
+#endif /* R2M_STATS */
+    r2mArenaFree(&pc->conv.arena);
+    free(line);
+    free(batches);
+    free(pc);
+    return rc;
+}
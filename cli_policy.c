@@ -0,0 +1,170 @@
+/*
+ * cli_policy.c: policy compaction before conversion (-compact)
+ *
+ * Copyright (c) 2017, 2018, 2019, 2020, 2021 Yoichi Hariguchi
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the
+ * Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall
+ * be included in all copies or substantial portions of the
+ * Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+ */
+
+/*
+ * The whole input is read first: a record may be shadowed by any
+ * other record. The items are compacted by r2mCompact() and the
+ * resulting disjoint ranges go through convert() like ordinary
+ * records, so -optimize, -minimize, -binary, -count and -cache
+ * still apply. The number of entries before and after is reported
+ * on stderr.
+ */
+
+#include "cli.h"
+
+enum {
+    MIN_ITEMS = 1024,           /* initial size of the item array */
+};
+
+
+/*
+ * Entries of [st, end] in the layout selected by the options
+ */
+static u32
+entries (const cliOpts *o, u32 st, u32 end)
+{
+    if (o->minimize) {
+        return r2mCountMin(32, st, end);
+    }
+    if (o->optimize) {
+        return r2mCountOpt(st, end, NULL, NULL);
+    }
+    return r2mCount(st, end);
+}
+
+static int
+parsePrio (const char *s, u32 *prio)
+{
+    char *end;
+    unsigned long v;
+
+    v = strtoul(s, &end, 10);
+    if (*s == '\0' || *s == '-' || *end != '\0' || v > 0xffffffffUL) {
+        return FAILURE;
+    }
+    *prio = v;
+    return SUCCESS;
+}
+
+/**
+ * @name  batchCompact
+ *
+ * @brief Reads "start end [action [priority]]" records, merges them
+ *        into disjoint maximal ranges and converts those
+ *
+ * Where records overlap, the smallest priority wins (0 if omitted),
+ * then the earliest record, i.e. first match.
+ *
+ * @param[in] c    Conversion context
+ * @param[in] fp   Input stream
+ * @param[in] name Name of the input stream (for error messages)
+ *
+ * @retval SUCCESS All the records are successfully converted
+ * @retval FAILURE Otherwise
+ */
+int
+batchCompact (cliCtx *c, FILE *fp, const char *name)
+{
+    char    *line = NULL;
+    size_t   size = 0;
+    u32      lineNum = 0;
+    char    *tok[5];
+    int      nTok;
+    r2mItem *items = NULL, *out = NULL, *tmp;
+    u32      n = 0, cap = 0, nOut, i;
+    r2mItem  it;
+    int      act;
+    u64      before = 0, after = 0;
+    int      rc = SUCCESS;
+    int      st;
+
+
+    while (getline(&line, &size, fp) >= 0) {
+        ++lineNum;
+        if ((nTok = splitFields(line, tok, elementsOf(tok))) == 0) {
+            continue;
+        }
+        if (nTok < 2 || nTok > 4) {
+            fprintf(stderr, "ERROR: %s:%u: wrong number of fields\n",
+                    name, lineNum);
+            rc = FAILURE;
+            continue;
+        }
+        it.prio = 0;
+        if (parseNumber(tok[0], &it.st, c->o) != SUCCESS ||
+            parseNumber(tok[1], &it.end, c->o) != SUCCESS ||
+            parseAction((nTok > 2) ? tok[2] : NULL, &act) != SUCCESS ||
+            (nTok > 3 && parsePrio(tok[3], &it.prio) != SUCCESS)) {
+            fprintf(stderr, "ERROR: %s:%u: failed to parse the record\n",
+                    name, lineNum);
+            rc = FAILURE;
+            continue;
+        }
+        it.act = act;
+        if (n == cap) {
+            cap = (cap) ? 2 * cap : MIN_ITEMS;
+            if ((tmp = realloc(items, cap * sizeof(*items))) == NULL) {
+                fprintf(stderr, "ERROR: out of memory\n");
+                rc = FAILURE;
+                goto done;
+            }
+            items = tmp;
+        }
+        items[n++] = it;
+        before += entries(c->o, it.st, it.end);
+    }
+    if (ferror(fp)) {
+        fprintf(stderr, "ERROR: %s: read error\n", name);
+        rc = FAILURE;
+    }
+
+    if ((out = malloc((2 * (size_t)n + 1) * sizeof(*out))) == NULL ||
+        (st = r2mCompact(items, n, out, 2 * n + 1, &nOut)) != SUCCESS) {
+        fprintf(stderr, "ERROR: failed to compact %s: %s\n", name,
+                r2mStrerror(out ? st : R2M_EFAIL));
+        rc = FAILURE;
+        goto done;
+    }
+    for (i = 0; i < nOut; ++i) {
+        after += entries(c->o, out[i].st, out[i].end);
+        st = convert(c, out[i].st, out[i].end, out[i].act, TRUE);
+        if (st != SUCCESS) {
+            fprintf(stderr, "ERROR: %s: failed to convert %u - %u: %s\n",
+                    name, out[i].st, out[i].end, r2mStrerror(st));
+            rc = FAILURE;
+        }
+    }
+    fprintf(stderr, "compact: %u records %" PRIu64 " entries -> %u ranges %"
+            PRIu64 " entries\n", n, before, nOut, after);
+
+done:
+    free(out);
+    free(items);
+    free(line);
+    return rc;
+}
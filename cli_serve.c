@@ -0,0 +1,341 @@
+/*
+ * cli_serve.c: conversion server on a Unix domain socket (-serve)
+ *
+ * Copyright (c) 2017, 2018, 2019, 2020, 2021 Yoichi Hariguchi
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the
+ * Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall
+ * be included in all copies or substantial portions of the
+ * Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+ */
+
+/*
+ * One process stays resident and converts the r2mSrvReq records of
+ * its clients (see range2masks.h) with the same cliCtx, so the
+ * arena, the cache and the output stage are shared by every request.
+ * A single poll() loop serves all the clients: each readable client
+ * has all of its complete requests converted back to back, and their
+ * responses go out with as few send() calls as possible. Responses
+ * that the socket does not take at once are queued and sent when the
+ * socket becomes writable.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "cli.h"
+
+enum {
+    SRV_MAX_CLIENTS = 64,
+    SRV_INBUF       = 64 * 1024,        /* request bytes read at once */
+    SRV_MAX_PEND    = 1024 * 1024,      /* stop reading beyond this */
+    SRV_PEND_MIN    = 64 * 1024,
+    /* largest response (see cliCached) plus r2mOut slack */
+    SRV_MAX_RSP     = sizeof(r2mSrvRsp) + MAX_PARTS * sizeof(r2mBinRule) +
+                      MAXENT * sizeof(tcamEnt) + R2M_OUT_MINBUF,
+};
+
+typedef struct srvClient_ {
+    int    fd;
+    size_t inLen;
+    u8     in[SRV_INBUF];
+    char  *pend;                /* responses not sent yet */
+    size_t pendOff;
+    size_t pendLen;
+    size_t pendSize;
+} srvClient;
+
+static volatile sig_atomic_t quit;
+
+
+static void
+onSignal (int sig)
+{
+    quit = 1;
+}
+
+/*
+ * r2mOut drain: queues the output for the current client
+ */
+static int
+drainToClient (r2mOut *o)
+{
+    srvClient *cl = o->arg;
+    size_t size;
+    char *p;
+
+    if (cl->pendOff == cl->pendLen) {
+        cl->pendOff = cl->pendLen = 0;
+    }
+    if (cl->pendLen + o->len > cl->pendSize) {
+        size = cl->pendSize ? cl->pendSize : SRV_PEND_MIN;
+        while (size < cl->pendLen + o->len) {
+            size *= 2;
+        }
+        if ((p = realloc(cl->pend, size)) == NULL) {
+            return R2M_ENOSPC;
+        }
+        cl->pend     = p;
+        cl->pendSize = size;
+    }
+    memcpy(cl->pend + cl->pendLen, o->buf, o->len);
+    cl->pendLen += o->len;
+    return SUCCESS;
+}
+
+/*
+ * Sends the queued responses without blocking.
+ * Returns FAILURE if the client is gone.
+ */
+static int
+sendPending (srvClient *cl)
+{
+    ssize_t n;
+
+    while (cl->pendOff < cl->pendLen) {
+        n = send(cl->fd, cl->pend + cl->pendOff, cl->pendLen - cl->pendOff,
+                 MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ?
+                SUCCESS : FAILURE;
+        }
+        cl->pendOff += n;
+    }
+    return SUCCESS;
+}
+
+/*
+ * Appends the response to a request. The whole response is kept in
+ * the output buffer so that its header can be filled in at the end.
+ */
+static void
+reply (cliCtx *c, const r2mSrvReq *req)
+{
+    r2mOut *o = &c->out;
+    r2mSrvRsp rsp;
+    size_t hdr;
+    u32 nRules, nEnts;
+
+
+    if (o->size - o->len < SRV_MAX_RSP && r2mOutFlush(o) != SUCCESS) {
+        return;
+    }
+    hdr     = o->len;
+    o->len += sizeof(rsp);
+    nRules  = c->bin.nRules;
+    nEnts   = c->bin.nEnts;
+    rsp.id  = req->id;
+    if (req->tag != R2M_ACCEPT && req->tag != R2M_REJECT) {
+        rsp.rc = R2M_EINVAL;
+    } else {
+        rsp.rc = convert(c, req->st, req->end, req->tag, FALSE);
+        STATS_PHASE(c, PH_OTHER);
+    }
+    rsp.nRules = c->bin.nRules - nRules;
+    rsp.nEnts  = c->bin.nEnts - nEnts;
+    memcpy(o->buf + hdr, &rsp, sizeof(rsp));
+}
+
+/*
+ * Reads from a readable client and answers its complete requests.
+ * Returns FAILURE if the client is gone.
+ */
+static int
+serveClient (cliCtx *c, srvClient *cl)
+{
+    r2mSrvReq req;
+    size_t off = 0;
+    ssize_t n;
+
+
+    n = recv(cl->fd, cl->in + cl->inLen, sizeof(cl->in) - cl->inLen, 0);
+    if (n <= 0) {
+        return (n < 0 && errno == EINTR) ? SUCCESS : FAILURE;
+    }
+    cl->inLen += n;
+    c->out.arg = cl;
+    while (cl->inLen - off >= sizeof(req)) {
+        memcpy(&req, cl->in + off, sizeof(req));
+        reply(c, &req);
+        off += sizeof(req);
+    }
+    memmove(cl->in, cl->in + off, cl->inLen - off);
+    cl->inLen -= off;
+    if (r2mOutFlush(&c->out) != SUCCESS) {
+        c->out.err = SUCCESS;   /* the other clients may do better */
+        c->out.len = 0;
+        return FAILURE;
+    }
+    return sendPending(cl);
+}
+
+static void
+dropClient (srvClient **cl)
+{
+    close((*cl)->fd);
+    free((*cl)->pend);
+    free(*cl);
+    *cl = NULL;
+}
+
+static int
+listenOn (const char *path)
+{
+    struct sockaddr_un sa;
+    struct stat sb;
+    int fd;
+
+    if (strlen(path) >= sizeof(sa.sun_path)) {
+        fprintf(stderr, "ERROR: socket path too long: %s\n", path);
+        return -1;
+    }
+    memset(&sa, 0, sizeof(sa));
+    sa.sun_family = AF_UNIX;
+    strcpy(sa.sun_path, path);
+    if (stat(path, &sb) == 0 && S_ISSOCK(sb.st_mode)) {
+        unlink(path);           /* left by a previous server */
+    }
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+        bind(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0 ||
+        listen(fd, SOMAXCONN) < 0) {
+        fprintf(stderr, "ERROR: failed to listen on %s: %s\n",
+                path, strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @name  serve
+ *
+ * @brief Converts the requests of the clients of a Unix domain socket
+ *        until SIGINT or SIGTERM (see r2mSrvReq in range2masks.h)
+ *
+ * @param[in] c    Conversion context (c->out and c->bin are taken over)
+ * @param[in] path Path of the socket (a stale socket is replaced)
+ *
+ * @retval SUCCESS The server stopped on a signal
+ * @retval FAILURE The socket could not be set up or poll() failed
+ */
+int
+serve (cliCtx *c, const char *path)
+{
+    srvClient *cl[SRV_MAX_CLIENTS] = { NULL };
+    struct pollfd pfd[SRV_MAX_CLIENTS + 1];
+    int at[SRV_MAX_CLIENTS + 1];    /* client of pfd[i] */
+    union { u16 v; u8 b[2]; } order = { 1 };
+    struct sigaction sa;
+    int lfd, fd, rc = SUCCESS;
+    u32 i, nPfd;
+
+
+    if ((lfd = listenOn(path)) < 0) {
+        return FAILURE;
+    }
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = onSignal;   /* no SA_RESTART: poll() returns */
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    c->out.fd    = -1;
+    c->out.drain = drainToClient;
+    c->bin.o      = &c->out;
+    c->bin.order  = (order.b[0]) ? R2M_BIN_LE : R2M_BIN_BE;
+    c->bin.hdrOff = -1;
+    c->bin.nRules = 0;
+    c->bin.nEnts  = 0;
+
+    while (!quit) {
+        nPfd = 0;
+        pfd[nPfd].fd     = lfd;
+        pfd[nPfd].events = POLLIN;
+        at[nPfd++] = -1;
+        for (i = 0; i < SRV_MAX_CLIENTS; ++i) {
+            if (!cl[i]) {
+                continue;
+            }
+            pfd[nPfd].fd     = cl[i]->fd;
+            pfd[nPfd].events = 0;
+            if (cl[i]->pendLen - cl[i]->pendOff < SRV_MAX_PEND) {
+                pfd[nPfd].events |= POLLIN;
+            }
+            if (cl[i]->pendOff < cl[i]->pendLen) {
+                pfd[nPfd].events |= POLLOUT;
+            }
+            at[nPfd++] = i;
+        }
+        if (poll(pfd, nPfd, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("ERROR: poll()");
+            rc = FAILURE;
+            break;
+        }
+        for (i = 1; i < nPfd; ++i) {
+            srvClient **p = cl + at[i];
+
+            if (((pfd[i].revents & POLLOUT) && sendPending(*p) != SUCCESS) ||
+                ((pfd[i].revents & (POLLIN | POLLHUP | POLLERR)) &&
+                 serveClient(c, *p) != SUCCESS)) {
+                dropClient(p);
+            }
+        }
+        if (pfd[0].revents & POLLIN) {
+            if ((fd = accept(lfd, NULL, NULL)) < 0) {
+                continue;
+            }
+            for (i = 0; i < SRV_MAX_CLIENTS && cl[i]; ++i) {
+                ;
+            }
+            if (i == SRV_MAX_CLIENTS ||
+                (cl[i] = malloc(sizeof(*cl[i]))) == NULL) {
+                close(fd);      /* too many clients */
+                continue;
+            }
+            cl[i]->fd       = fd;
+            cl[i]->inLen    = 0;
+            cl[i]->pend     = NULL;
+            cl[i]->pendOff  = 0;
+            cl[i]->pendLen  = 0;
+            cl[i]->pendSize = 0;
+        }
+    }
+
+    for (i = 0; i < SRV_MAX_CLIENTS; ++i) {
+        if (cl[i]) {
+            dropClient(cl + i);
+        }
+    }
+    close(lfd);
+    unlink(path);
+    c->out.drain = NULL;
+    return rc;
+}
@@ -0,0 +1,152 @@
+/*
+ * cli_stats.c: -stats report
+ *
+ * Copyright (c) 2017, 2018, 2019, 2020, 2021 Yoichi Hariguchi
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the
+ * Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall
+ * be included in all copies or substantial portions of the
+ * Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+ */
+
+/*
+ * The counters are kept per cliCtx (one per -j worker) by the
+ * STATS_xx() macros of cli.h and summed up at the end. The report
+ * goes to stderr so that it never mixes with (binary) output.
+ * Ticks are converted into nanoseconds with the rate measured over
+ * the whole run, so the phases of the workers add up to their CPU
+ * time rather than to the wall clock time.
+ */
+
+#include "cli.h"
+
+#ifdef R2M_STATS
+
+static const char *phaseName[PH_MAX] = {
+    "other", "parse", "decompose", "optimize", "emit",
+};
+
+
+/**
+ * @name  statsMerge
+ *
+ * @brief Adds the counters of a worker to those of the main context
+ *
+ * @param[in,out] dst Counters of the main context
+ * @param[in]     src Counters of a worker
+ */
+void
+statsMerge (cliStats *dst, const cliStats *src)
+{
+    u32 i;
+
+    for (i = 0; i < PH_MAX; ++i) {
+        dst->tsc[i]  += src->tsc[i];
+        dst->workTsc += src->tsc[i];
+    }
+    dst->nRanges += src->nRanges;
+    dst->nEnts   += src->nEnts;
+    dst->nOpt    += src->nOpt;
+    dst->nOptWon += src->nOptWon;
+    for (i = 0; i <= MAXENT; ++i) {
+        dst->hist[i] += src->hist[i];
+    }
+}
+
+static void
+printText (const cliStats *s, double wallNs, double nsPerTick)
+{
+    u64 total = 0;
+    u32 i;
+
+    for (i = 0; i < PH_MAX; ++i) {
+        total += s->tsc[i];
+    }
+    fprintf(stderr, "stats: %" PRIu64 " ranges, %" PRIu64 " entries in"
+            " %.3f ms", s->nRanges, s->nEnts, wallNs / 1e6);
+    if (s->nRanges) {
+        fprintf(stderr, " (%.1f ns/range)", wallNs / s->nRanges);
+    }
+    fprintf(stderr, "\n");
+    if (s->nOpt) {
+        fprintf(stderr, "  layout with several rules: %" PRIu64 " of %"
+                PRIu64 " ranges\n", s->nOptWon, s->nOpt);
+    }
+    for (i = 0; i < PH_MAX; ++i) {
+        fprintf(stderr, "  %-10s %14" PRIu64 " ticks %12.3f ms %5.1f%%\n",
+                phaseName[i], s->tsc[i], s->tsc[i] * nsPerTick / 1e6,
+                (total) ? 100.0 * s->tsc[i] / total : 0.0);
+    }
+    fprintf(stderr, "  entries    ranges\n");
+    for (i = 0; i <= MAXENT; ++i) {
+        if (s->hist[i]) {
+            fprintf(stderr, "  %7u%s %" PRIu64 "\n", i,
+                    (i == MAXENT) ? "+" : " ", s->hist[i]);
+        }
+    }
+}
+
+static void
+printJson (const cliStats *s, double wallNs, double nsPerTick)
+{
+    const char *sep = "";
+    u32 i;
+
+    fprintf(stderr, "{\"ranges\": %" PRIu64 ", \"entries\": %" PRIu64
+            ", \"wall_ns\": %.0f, \"optimized\": %" PRIu64
+            ", \"optimize_won\": %" PRIu64 ", \"phases\": {",
+            s->nRanges, s->nEnts, wallNs, s->nOpt, s->nOptWon);
+    for (i = 0; i < PH_MAX; ++i) {
+        fprintf(stderr, "%s\"%s\": {\"ticks\": %" PRIu64 ", \"ns\": %.0f}",
+                (i) ? ", " : "", phaseName[i], s->tsc[i],
+                s->tsc[i] * nsPerTick);
+    }
+    fprintf(stderr, "}, \"histogram\": {");
+    for (i = 0; i <= MAXENT; ++i) {
+        if (s->hist[i]) {
+            fprintf(stderr, "%s\"%u\": %" PRIu64, sep, i, s->hist[i]);
+            sep = ", ";
+        }
+    }
+    fprintf(stderr, "}}\n");
+}
+
+/**
+ * @name  statsPrint
+ *
+ * @brief Writes the -stats report to stderr
+ *
+ * @param[in] s         Counters (of every worker)
+ * @param[in] o         Options (-stats text|json)
+ * @param[in] wallNs    Duration of the run
+ * @param[in] nsPerTick Rate of cliTsc()
+ */
+void
+statsPrint (const cliStats *s, const cliOpts *o, double wallNs,
+            double nsPerTick)
+{
+    if (o->stats == STATS_JSON) {
+        printJson(s, wallNs, nsPerTick);
+    } else {
+        printText(s, wallNs, nsPerTick);
+    }
+}
+
+#endif /* R2M_STATS */
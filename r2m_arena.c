@@ -0,0 +1,245 @@
+/*
+ * r2m_arena.c: bump allocator for variable-length results
+ *
+ * Copyright (c) 2017, 2018, 2019, 2020, 2021 Yoichi Hariguchi
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the
+ * Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall
+ * be included in all copies or substantial portions of the
+ * Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+ */
+
+/*
+ * Memory is carved out of chunks in allocation order and given back
+ * all at once by r2mArenaReset(), typically once per record or batch.
+ * Chunks are kept across resets, so a steady-state workload does not
+ * call malloc() at all. Pointers stay valid until the next reset.
+ */
+
+#include "range2masks.h"
+
+enum {
+    ARENA_ALIGN     = 16,         /* tcamEntW holds __int128 */
+    ARENA_MINCHUNK  = 4096,
+};
+
+struct r2mArenaChunk_ {
+    struct r2mArenaChunk_ *next;
+    size_t size;                /* bytes of data[] */
+    size_t used;
+    size_t rsvd;                /* data[] at 16 bytes */
+    u8     data[];
+};
+
+
+static inline size_t
+alignUp (size_t n)
+{
+    return (n + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+/**
+ * @name  r2mArenaInit
+ *
+ * @brief Initializes an arena. Nothing is allocated until the first
+ *        r2mArenaAlloc().
+ *
+ * @param[out] a         Arena
+ * @param[in]  chunkSize Size of a chunk (0: default)
+ */
+void
+r2mArenaInit (r2mArena *a, size_t chunkSize)
+{
+    a->head      = NULL;
+    a->cur       = NULL;
+    a->last      = NULL;
+    a->chunkSize = (chunkSize < ARENA_MINCHUNK) ? ARENA_MINCHUNK : chunkSize;
+    a->bytes     = 0;
+}
+
+/**
+ * @name  r2mArenaAlloc
+ *
+ * @brief Allocates memory from an arena
+ *
+ * @param[in] a    Arena
+ * @param[in] size Number of bytes
+ *
+ * @retval Pointer to 'size' bytes (16-byte aligned), or NULL if out of
+ *         memory
+ */
+void *
+r2mArenaAlloc (r2mArena *a, size_t size)
+{
+    r2mArenaChunk *c = a->cur;
+    r2mArenaChunk **pp;
+    size_t sz;
+
+    size = alignUp(size);
+    while (c == NULL || c->size - c->used < size) {
+        pp = (c) ? &c->next : &a->head;
+        if (*pp && (*pp)->size >= size) {
+            c = *pp;            /* kept from before the last reset */
+            c->used = 0;
+            continue;
+        }
+        sz = (size > a->chunkSize) ? size : a->chunkSize;
+        if ((c = malloc(sizeof(*c) + sz)) == NULL) {
+            return NULL;
+        }
+        c->next  = *pp;         /* keep the rest for later */
+        c->size  = sz;
+        c->used  = 0;
+        *pp      = c;
+        a->bytes += sz;
+    }
+    a->cur  = c;
+    a->last = c->data + c->used;
+    c->used += size;
+    return a->last;
+}
+
+/**
+ * @name  r2mArenaTrim
+ *
+ * @brief Shrinks the most recent allocation
+ *
+ * @param[in] a    Arena
+ * @param[in] p    Pointer returned by the last r2mArenaAlloc()
+ *                 (otherwise nothing is done)
+ * @param[in] size New size in bytes
+ */
+void
+r2mArenaTrim (r2mArena *a, void *p, size_t size)
+{
+    if (p && p == a->last) {
+        a->cur->used = ((u8 *)p - a->cur->data) + alignUp(size);
+    }
+}
+
+/**
+ * @name  r2mArenaReset
+ *
+ * @brief Frees everything allocated from an arena (the chunks are kept)
+ *
+ * @param[in] a Arena
+ */
+void
+r2mArenaReset (r2mArena *a)
+{
+    a->cur  = a->head;
+    a->last = NULL;
+    if (a->cur) {
+        a->cur->used = 0;
+    }
+}
+
+/**
+ * @name  r2mArenaFree
+ *
+ * @brief Frees the chunks of an arena
+ *
+ * @param[in] a Arena
+ */
+void
+r2mArenaFree (r2mArena *a)
+{
+    r2mArenaChunk *c, *next;
+
+    for (c = a->head; c; c = next) {
+        next = c->next;
+        free(c);
+    }
+    r2mArenaInit(a, a->chunkSize);
+}
+
+/**
+ * @name  r2mRuleAlloc
+ *
+ * @brief Allocates room for 'maxEnt' entries of a rule
+ *
+ * @param[in]  a      Arena
+ * @param[out] p      Rule (nEnt is 0)
+ * @param[in]  maxEnt Number of entries
+ *
+ * @retval SUCCESS    p->ent has room for 'maxEnt' entries
+ * @retval R2M_EFAIL  Out of memory
+ */
+int
+r2mRuleAlloc (r2mArena *a, aclRule *p, u32 maxEnt)
+{
+    p->nEnt   = 0;
+    p->maxEnt = 0;
+    if ((p->ent = r2mArenaAlloc(a, maxEnt * sizeof(tcamEnt))) == NULL) {
+        return R2M_EFAIL;
+    }
+    p->maxEnt = maxEnt;
+    return SUCCESS;
+}
+
+/**
+ * @name  r2mRuleTrim
+ *
+ * @brief Gives the unused entries of the last allocated rule back
+ *
+ * @param[in]     a Arena
+ * @param[in,out] p Rule allocated by the last r2mRuleAlloc()
+ */
+void
+r2mRuleTrim (r2mArena *a, aclRule *p)
+{
+    r2mArenaTrim(a, p->ent, p->nEnt * sizeof(tcamEnt));
+    if (p->ent == a->last) {
+        p->maxEnt = p->nEnt;
+    }
+}
+
+/**
+ * @name  range2masksArena
+ *
+ * @brief Same as range2masksEngine() but the entries are allocated
+ *        from an arena and take exactly p->nEnt entries of it.
+ *        Every 32-bit range fits (MAXENT).
+ *
+ * @param[in]  eng   Engine to use
+ * @param[in]  st    Number that the range starts
+ * @param[in]  end   Number that the range ends
+ * @param[in]  a     Arena
+ * @param[out] pRule Converted result
+ *
+ * @retval SUCCESS The range is successfully converted
+ * @retval < 0     Error code (see range2entsEngine())
+ */
+int
+range2masksArena (r2mEngine eng, u32 st, u32 end, r2mArena *a,
+                  aclRule *pRule)
+{
+    int rc;
+
+    if (!pRule || !a) {
+        return R2M_EINVAL;
+    }
+    if ((rc = r2mRuleAlloc(a, pRule, MAXENT)) != SUCCESS) {
+        return rc;
+    }
+    rc = range2masksEngine(eng, st, end, pRule);
+    r2mRuleTrim(a, pRule);
+    return rc;
+}
@@ -0,0 +1,113 @@
+#ifndef __R2M_BITS_H__
+#define __R2M_BITS_H__
+
+/*
+ * r2m_bits.h: constant time prefix/mask helpers
+ *
+ * Copyright (c) 2017, 2018, 2019, 2020, 2021 Yoichi Hariguchi
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the
+ * Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall
+ * be included in all copies or substantial portions of the
+ * Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+ */
+
+/*
+ * A mask is contiguous (a netmask) if its complement is 2^n - 1,
+ * i.e. adding 1 to the complement clears all of its bits.
+ * The prefix length of a contiguous mask is its number of 1s.
+ * All the helpers are branch-free except for the final check.
+ */
+
+#include "local_types.h"
+
+#ifdef __SIZEOF_INT128__
+typedef unsigned __int128 r2mU128;
+#endif /* __SIZEOF_INT128__ */
+
+
+static inline bool
+r2mIsContig32 (u32 mask)
+{
+    u32 inv = ~mask;
+
+    return (inv & (inv + 1)) == 0;
+}
+
+static inline bool
+r2mIsContig64 (u64 mask)
+{
+    u64 inv = ~mask;
+
+    return (inv & (inv + 1)) == 0;
+}
+
+/* Prefix length of 'mask', or -1 if 'mask' is not contiguous */
+static inline int
+r2mPlen32 (u32 mask)
+{
+    return r2mIsContig32(mask) ? __builtin_popcount(mask) : -1;
+}
+
+static inline int
+r2mPlen64 (u64 mask)
+{
+    return r2mIsContig64(mask) ? __builtin_popcountll(mask) : -1;
+}
+
+/* Mask of a prefix length (0 <= plen <= 32) */
+static inline u32
+r2mPlen2Mask32 (int plen)
+{
+    return (plen == 0) ? 0 : ~0U << (32 - plen);
+}
+
+static inline u64
+r2mPlen2Mask64 (int plen)
+{
+    return (plen == 0) ? 0 : ~0ULL << (64 - plen);
+}
+
+#ifdef __SIZEOF_INT128__
+static inline bool
+r2mIsContig128 (r2mU128 mask)
+{
+    r2mU128 inv = ~mask;
+
+    return (inv & (inv + 1)) == 0;
+}
+
+static inline int
+r2mPlen128 (r2mU128 mask)
+{
+    return r2mIsContig128(mask)
+        ? __builtin_popcountll((u64)(mask >> 64)) +
+          __builtin_popcountll((u64)mask)
+        : -1;
+}
+
+static inline r2mU128
+r2mPlen2Mask128 (int plen)
+{
+    return (plen == 0) ? 0 : ~(r2mU128)0 << (128 - plen);
+}
+#endif /* __SIZEOF_INT128__ */
+
+#endif /* __R2M_BITS_H__ */
@@ -0,0 +1,223 @@
+/*
+ * r2m_cache.c: bounded memoizing cache of conversion results
+ *
+ * Copyright (c) 2017, 2018, 2019, 2020, 2021 Yoichi Hariguchi
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the
+ * Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall
+ * be included in all copies or substantial portions of the
+ * Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+ */
+
+/*
+ * Open addressing with linear probing over a power-of-2 table.
+ * A key lives within MAX_PROBE slots of its home slot. Keys are never
+ * deleted, only replaced, so a lookup stops at the first empty slot
+ * or after MAX_PROBE slots. When the whole window is taken, the
+ * insertion replaces its slots round-robin.
+ *
+ * What is cached is up to the caller: each slot carries 'valSize'
+ * bytes that r2mCachePut() returns for the caller to fill in.
+ */
+
+#include "range2masks.h"
+
+enum {
+    MAX_PROBE = 8,
+    VAL_ALIGN = 16,             /* alignment of the values (malloc()'s) */
+};
+
+typedef struct slotHdr_ {
+    r2mCacheKey key;
+    u32         used;           /* 0: empty */
+    u32         rsvd;
+} slotHdr;
+
+/* Offset of the value in a slot */
+#define VAL_OFF ((sizeof(slotHdr) + VAL_ALIGN - 1) & ~(size_t)(VAL_ALIGN - 1))
+
+struct r2mCache_ {
+    u8    *slots;               /* nSlots * slotSize bytes: slotHdr,
+                                   padding, value at VAL_OFF */
+    u32    mask;                /* nSlots - 1 */
+    u32    victim;              /* round-robin eviction counter */
+    size_t slotSize;
+    r2mCacheStats st;
+};
+
+
+static inline u32
+hashKey (const r2mCacheKey *k)
+{
+    u64 h = ((u64)k->st << 32) | k->end;
+
+    h ^= ((u64)k->width << 8 | k->flags) * 0x9e3779b97f4a7c15ULL;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return (u32)h;
+}
+
+static inline bool
+keyEq (const r2mCacheKey *a, const r2mCacheKey *b)
+{
+    return a->st == b->st && a->end == b->end &&
+           a->width == b->width && a->flags == b->flags;
+}
+
+static inline slotHdr *
+slotAt (const r2mCache *c, u32 i)
+{
+    return (slotHdr *)(c->slots + (size_t)(i & c->mask) * c->slotSize);
+}
+
+/**
+ * @name  r2mCacheCreate
+ *
+ * @brief Creates a cache
+ *
+ * @param[in] nSlots  Number of slots (rounded up to a power of 2)
+ * @param[in] valSize Size of the value stored in each slot
+ *
+ * @retval Pointer to the cache, or NULL if out of memory
+ */
+r2mCache *
+r2mCacheCreate (u32 nSlots, size_t valSize)
+{
+    r2mCache *c;
+    u32 n = MAX_PROBE;
+
+    while (n < nSlots && n < (1U << 31)) {
+        n <<= 1;
+    }
+    if ((c = calloc(1, sizeof(*c))) == NULL) {
+        return NULL;
+    }
+    c->slotSize = (VAL_OFF + valSize + VAL_ALIGN - 1) &
+                  ~(size_t)(VAL_ALIGN - 1);
+    c->mask     = n - 1;
+    if ((c->slots = calloc(n, c->slotSize)) == NULL) {
+        free(c);
+        return NULL;
+    }
+    c->st.nSlots = n;
+    return c;
+}
+
+/**
+ * @name  r2mCacheDestroy
+ *
+ * @brief Frees a cache
+ *
+ * @param[in] c Cache (may be NULL)
+ */
+void
+r2mCacheDestroy (r2mCache *c)
+{
+    if (c) {
+        free(c->slots);
+        free(c);
+    }
+}
+
+/**
+ * @name  r2mCacheGet
+ *
+ * @brief Looks up a key
+ *
+ * @param[in] c Cache
+ * @param[in] k Key
+ *
+ * @retval Pointer to the value of 'k' (aligned to 16 bytes), or NULL
+ *         if not cached
+ */
+void *
+r2mCacheGet (r2mCache *c, const r2mCacheKey *k)
+{
+    u32 h = hashKey(k);
+    slotHdr *s;
+    u32 i;
+
+    for (i = 0; i < MAX_PROBE; ++i) {
+        s = slotAt(c, h + i);
+        if (!s->used) {
+            break;
+        }
+        if (keyEq(&s->key, k)) {
+            ++c->st.hits;
+            return (u8 *)s + VAL_OFF;
+        }
+    }
+    ++c->st.misses;
+    return NULL;
+}
+
+/**
+ * @name  r2mCachePut
+ *
+ * @brief Reserves the slot of a key (replacing another key if the
+ *        probe window is full). The caller fills in the value.
+ *
+ * @param[in] c Cache
+ * @param[in] k Key
+ *
+ * @retval Pointer to the value of 'k' (valSize bytes, aligned to 16
+ *         bytes)
+ */
+void *
+r2mCachePut (r2mCache *c, const r2mCacheKey *k)
+{
+    u32 h = hashKey(k);
+    slotHdr *s;
+    u32 i;
+
+    for (i = 0; i < MAX_PROBE; ++i) {
+        s = slotAt(c, h + i);
+        if (!s->used) {
+            ++c->st.used;
+            break;
+        }
+        if (keyEq(&s->key, k)) {
+            return (u8 *)s + VAL_OFF;
+        }
+    }
+    if (i == MAX_PROBE) {
+        s = slotAt(c, h + (c->victim++ % MAX_PROBE));
+        ++c->st.evictions;
+    }
+    s->key  = *k;
+    s->used = 1;
+    return (u8 *)s + VAL_OFF;
+}
+
+/**
+ * @name  r2mCacheGetStats
+ *
+ * @brief Returns the counters of a cache
+ *
+ * @param[in]  c  Cache
+ * @param[out] st Counters
+ */
+void
+r2mCacheGetStats (const r2mCache *c, r2mCacheStats *st)
+{
+    *st = c->st;
+}
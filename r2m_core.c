@@ -0,0 +1,484 @@
+/*
+ * r2m_core.c: range to TCAM entry conversion
+ *
+ * Copyright (c) 2017, 2018, 2019, 2020, 2021 Yoichi Hariguchi
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the
+ * Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall
+ * be included in all copies or substantial portions of the
+ * Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+ */
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "range2masks.h"
+#include "r2m_bits.h"
+
+
+/**
+ * @name  r2mStrerror
+ *
+ * @brief Returns a string describing an error code
+ *
+ * @param[in] err Error code returned by a librange2masks function
+ *
+ * @retval Pointer to a static string
+ */
+const char *
+r2mStrerror (int err)
+{
+    switch (err) {
+    case R2M_OK:
+        return "success";
+    case R2M_EFAIL:
+        return "failure";
+    case R2M_EINVAL:
+        return "invalid argument";
+    case R2M_ERANGE:
+        return "range out of bounds";
+    case R2M_ENOSPC:
+        return "not enough memory";
+    case R2M_EVERIFY:
+        return "entries do not match the range";
+    default:
+        return "unknown error";
+    }
+}
+
+/**
+ * @name  mask2plen
+ *
+ * @brief Converts a netmask into a prefix length
+ *
+ * @param[in] mask Netmask
+ *
+ * @retval >= 0 prefix length representing 'mask'
+ * @retval < 0  'mask' is not contiguous
+ */
+int
+mask2plen (u32 mask)
+{
+    return r2mPlen32(mask);
+}
+
+/**
+ * @name  ipv4a2h
+ *
+ * @brief Converts an IPv4 dotted decimal notation to the host order integer
+ *
+ * @param[in]  s    Sgring representing an IPv4 address (w/o prefix length)
+ * @param[out] addr Pointer to the converted IPv4 address
+ *
+ * @retval FAILURE (-1) Wrong IPv4 address format
+ * @retval R2M_EINVAL   's' or 'addr' is NULL
+ * @retval SUCCESS (0)  '*addr' has the IPv4 address in the host order.
+ */
+int
+ipv4a2h (const char *s, u32 *addr)
+{
+    struct in_addr a;
+
+    if (s == NULL || addr == NULL) {
+        return R2M_EINVAL;
+    }
+    if (inet_pton(AF_INET, s, &a) > 0) {
+        *addr = ntohl(a.s_addr);
+        return SUCCESS;
+    }
+    return FAILURE;
+}
+
+/**
+ * @name  range2ents
+ *
+ * @brief Convert an arbitrary range into a set of TCAM entries 
+ *        (st <= range <= end) stored in a caller-supplied array.
+ *        'end' must be < 0xffffffff unless 'st' is 0.
+ *
+ * @param[in]  st     Number that the range starts
+ * @param[in]  end    Number that the range ends
+ * @param[out] ent    Array of (pattern, mask) receiving the result
+ * @param[in]  maxEnt Number of elements of 'ent'
+ * @param[out] pnEnt  Number of entries stored in 'ent'
+ *
+ * @retval SUCCESS    The range is successfully converted
+ * @retval R2M_EINVAL 'ent' or 'pnEnt' is NULL
+ * @retval R2M_ERANGE 'end' is 0xffffffff and 'st' is not 0
+ * @retval R2M_ENOSPC 'maxEnt' is too small. '*pnEnt' entries are
+ *                    stored (from the end of the range).
+ */
+int
+range2ents (u32 st, u32 end, tcamEnt *ent, u32 maxEnt, u32 *pnEnt)
+{
+    u32 patt;
+    u32 mask;
+    u32 i;
+    u32 n;
+
+
+    if (!ent || !pnEnt) {
+        return R2M_EINVAL;
+    }
+    *pnEnt = 0;
+    if (end == ~0) {
+        if (st != 0) {
+            return R2M_ERANGE;
+        }
+    }
+
+    n = 0;
+    for (patt = end; patt >= st; --patt) {
+
+        if (n >= maxEnt) {
+            *pnEnt = n;
+            return R2M_ENOSPC;
+        }
+
+        /* First, find the first 0 from LSB in 'patt'
+           while clearing 1s.
+         */
+        mask = ~0;
+        i    = 1;
+        while (i & patt) {
+            patt ^=  i;         /* clear log(i)-th bit */
+            i    <<= 1;
+            mask <<= 1;         /* mask = (~0) << log(i) */
+        }
+
+        /* Second, if 'patt' becomes too small,
+           retract 'patt' until 'patt' >= 'st'.
+         */
+        while (patt < st) {
+            i    >>= 1;
+            patt |= i;          /* set log(i)-th bit */
+            mask |= i;          /* mask = (~0) << log(i) */
+        }
+        ent[n].patt = patt;
+        ent[n].mask = mask;
+        ++n;
+        if (patt == 0) {        /* prevent infinite loop */
+            break;
+        }
+    }
+    *pnEnt = n;
+    return SUCCESS;
+}
+
+/**
+ * @name  range2entsClz
+ *
+ * @brief Same as range2ents() but computes each entry in closed form.
+ *
+ * The largest block ending at 'end' is 2^k where k is the number of
+ * trailing 1s of 'end' (ctz(~end)). It is further limited to the
+ * largest power of 2 not exceeding the range size (31 - clz(size)).
+ * Each entry therefore costs a few instructions instead of up to
+ * 32 iterations of bit walking.
+ *
+ * @param[in]  st     Number that the range starts
+ * @param[in]  end    Number that the range ends
+ * @param[out] ent    Array of (pattern, mask) receiving the result
+ * @param[in]  maxEnt Number of elements of 'ent'
+ * @param[out] pnEnt  Number of entries stored in 'ent'
+ *
+ * @retval See range2ents()
+ */
+int
+range2entsClz (u32 st, u32 end, tcamEnt *ent, u32 maxEnt, u32 *pnEnt)
+{
+    if (!ent || !pnEnt) {
+        return R2M_EINVAL;
+    }
+    *pnEnt = 0;
+    if (end == ~0 && st != 0) {
+        return R2M_ERANGE;
+    }
+    return range2entsFull(st, end, ent, maxEnt, pnEnt);
+}
+
+/**
+ * @name  range2entsFull
+ *
+ * @brief Same as range2entsClz() but any range is valid, including
+ *        [st, 0xffffffff] (k is then limited by the range size only)
+ *
+ * @param[in]  st     Number that the range starts
+ * @param[in]  end    Number that the range ends
+ * @param[out] ent    Array of (pattern, mask) receiving the result
+ * @param[in]  maxEnt Number of elements of 'ent'
+ * @param[out] pnEnt  Number of entries stored in 'ent'
+ *
+ * @retval SUCCESS    The range is converted (no entry if st > end)
+ * @retval R2M_EINVAL 'ent' or 'pnEnt' is NULL
+ * @retval R2M_ENOSPC 'maxEnt' is too small. '*pnEnt' entries are
+ *                    stored (from the end of the range).
+ */
+int
+range2entsFull (u32 st, u32 end, tcamEnt *ent, u32 maxEnt, u32 *pnEnt)
+{
+    u32 size1;                  /* range size - 1 */
+    u32 mask;
+    int k, kmax;
+    u32 n;
+
+
+    if (!ent || !pnEnt) {
+        return R2M_EINVAL;
+    }
+    *pnEnt = 0;
+    if (st > end) {
+        return SUCCESS;
+    }
+
+    for (n = 0; ; ++n) {
+        if (n >= maxEnt) {
+            *pnEnt = n;
+            return R2M_ENOSPC;
+        }
+        size1 = end - st;
+        if (size1 == ~0) {      /* [0, 0xffffffff] */
+            ent[n].patt = 0;
+            ent[n].mask = 0;
+            break;
+        }
+        k    = (~end) ? __builtin_ctz(~end) : 32;
+        kmax = 31 - __builtin_clz(size1 + 1);
+        if (k > kmax) {
+            k = kmax;
+        }
+        mask = ~0U << k;
+        ent[n].patt = end & mask;
+        ent[n].mask = mask;
+        if (ent[n].patt == st) {
+            break;
+        }
+        end = ent[n].patt - 1;
+    }
+    *pnEnt = n + 1;
+    return SUCCESS;
+}
+
+/**
+ * @name  r2mCount
+ *
+ * @brief Counts the TCAM entries of [st, end] without making them
+ *
+ * Let h be the highest bit where 'st' and 'end' differ. The range is
+ * split at that bit into [st, st | (2^h - 1)] and
+ * [end & ~(2^h - 1), end]. The lower half needs one entry per 1 in
+ * 2^h - (st mod 2^h); the upper half needs one entry per 1 in
+ * (end mod 2^h) + 1. The only exception is an aligned 2^(h+1) block,
+ * which is one entry.
+ *
+ * Unlike range2masks(), 'end' may be 0xffffffff for any 'st'.
+ *
+ * @param[in] st  Number that the range starts
+ * @param[in] end Number that the range ends
+ *
+ * @retval Number of entries range2masks() makes (0 if st > end)
+ */
+u32
+r2mCount (u32 st, u32 end)
+{
+    u32 low;                    /* 2^h - 1 */
+    u32 x, y;
+    int h;
+
+    if (st >= end) {
+        return (st == end) ? 1 : 0;
+    }
+    h   = 31 - __builtin_clz(st ^ end);
+    low = (u32)((1ULL << h) - 1);
+    x   = st & low;
+    y   = end & low;
+    if (x == 0 && y == low) {
+        return 1;
+    }
+    return __builtin_popcountll((1ULL << h) - x) +
+           __builtin_popcountll((u64)y + 1);
+}
+
+/**
+ * @name  r2mCountOpt
+ *
+ * @brief Counts the TCAM entries of the -optimize layouts of
+ *        [st, end] and returns the smaller one.
+ *
+ * [0, n] needs one entry per 1 in n + 1, so reject [0, st-1] +
+ * accept [0, end] costs popcount(st) + popcount(end + 1).
+ * The plain range wins ties, like the CLI does.
+ *
+ * @param[in]  st       Number that the range starts
+ * @param[in]  end      Number that the range ends
+ * @param[out] pnReject Number of reject entries (may be NULL)
+ * @param[out] pnAccept Number of accept entries (may be NULL)
+ *
+ * @retval Number of entries of the better layout
+ */
+u32
+r2mCountOpt (u32 st, u32 end, u32 *pnReject, u32 *pnAccept)
+{
+    u32 nDirect = r2mCount(st, end);
+    u32 nRej = 0;
+    u32 nAcc = nDirect;
+
+    if (st != 0 && st <= end) {
+        u32 r = __builtin_popcount(st);
+        u32 a = __builtin_popcountll((u64)end + 1);
+
+        if (r + a < nDirect) {
+            nRej = r;
+            nAcc = a;
+        }
+    }
+    if (pnReject) {
+        *pnReject = nRej;
+    }
+    if (pnAccept) {
+        *pnAccept = nAcc;
+    }
+    return nRej + nAcc;
+}
+
+/**
+ * @name  range2entsEngine
+ *
+ * @brief Calls range2ents() or one of its alternatives
+ *
+ * @param[in]  eng    Engine to use
+ * @param[in]  st     Number that the range starts
+ * @param[in]  end    Number that the range ends
+ * @param[out] ent    Array of (pattern, mask) receiving the result
+ * @param[in]  maxEnt Number of elements of 'ent'
+ * @param[out] pnEnt  Number of entries stored in 'ent'
+ *
+ * @retval R2M_EINVAL 'eng' is unknown
+ * @retval Otherwise  See range2ents()
+ */
+int
+range2entsEngine (r2mEngine eng, u32 st, u32 end,
+                  tcamEnt *ent, u32 maxEnt, u32 *pnEnt)
+{
+    switch (eng) {
+    case R2M_ENGINE_LOOP:
+        return range2ents(st, end, ent, maxEnt, pnEnt);
+    case R2M_ENGINE_CLZ:
+        return range2entsClz(st, end, ent, maxEnt, pnEnt);
+    default:
+        return R2M_EINVAL;
+    }
+}
+
+/**
+ * @name  range2masks
+ *
+ * @brief Convert an arbitrary range into a set of TCAM entries 
+ *        (st <= range <= end). 'end' must be < 0xffffffff.
+ *
+ * @param[in]  st    Number that the range starts
+ * @param[in]  end   Number that the range ends
+ * @param[in,out] pRule Converted result. pRule->ent has room for
+ *                      pRule->maxEnt entries (MAXENT always fits).
+ *
+ * @retval SUCCESS The range is successfully converted
+ * @retval < 0     Error code (see range2ents())
+ */
+int
+range2masks (u32 st, u32 end, aclRule* pRule)
+{
+    if (!pRule) {
+        return R2M_EINVAL;
+    }
+    return range2ents(st, end, pRule->ent, pRule->maxEnt, &pRule->nEnt);
+}
+
+/**
+ * @name  range2masksEngine
+ *
+ * @brief Same as range2masks() but uses the engine 'eng'
+ *
+ * @param[in]  eng   Engine to use
+ * @param[in]  st    Number that the range starts
+ * @param[in]  end   Number that the range ends
+ * @param[in,out] pRule Converted result (see range2masks())
+ *
+ * @retval SUCCESS The range is successfully converted
+ * @retval < 0     Error code (see range2entsEngine())
+ */
+int
+range2masksEngine (r2mEngine eng, u32 st, u32 end, aclRule* pRule)
+{
+    if (!pRule) {
+        return R2M_EINVAL;
+    }
+    return range2entsEngine(eng, st, end, pRule->ent, pRule->maxEnt,
+                            &pRule->nEnt);
+}
+
+static const char *engineNames[R2M_ENGINE_MAX] = {
+    [R2M_ENGINE_LOOP] = "loop",
+    [R2M_ENGINE_CLZ]  = "clz",
+};
+
+/**
+ * @name  r2mEngineName
+ *
+ * @brief Returns the name of an engine
+ *
+ * @param[in] eng Engine
+ *
+ * @retval Pointer to a static string ("unknown" if 'eng' is invalid)
+ */
+const char *
+r2mEngineName (r2mEngine eng)
+{
+    if (eng < 0 || eng >= R2M_ENGINE_MAX) {
+        return "unknown";
+    }
+    return engineNames[eng];
+}
+
+/**
+ * @name  r2mEngineByName
+ *
+ * @brief Looks up an engine by name
+ *
+ * @param[in]  name Engine name (e.g. "loop", "clz")
+ * @param[out] eng  Pointer to the engine found
+ *
+ * @retval SUCCESS    '*eng' has the engine
+ * @retval R2M_EINVAL 'name' is not an engine name
+ */
+int
+r2mEngineByName (const char *name, r2mEngine *eng)
+{
+    int i;
+
+    if (!name || !eng) {
+        return R2M_EINVAL;
+    }
+    for (i = 0; i < R2M_ENGINE_MAX; ++i) {
+        if (strcmp(name, engineNames[i]) == 0) {
+            *eng = i;
+            return SUCCESS;
+        }
+    }
+    return R2M_EINVAL;
+}
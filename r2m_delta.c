@@ -0,0 +1,271 @@
+/*
+ * r2m_delta.c: minimal TCAM updates when a range changes
+ *
+ * Copyright (c) 2017, 2018, 2019, 2020, 2021 Yoichi Hariguchi
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the
+ * Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall
+ * be included in all copies or substantial portions of the
+ * Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+ */
+
+/*
+ * When a rule changes from [a, b] to [c, d], the entries already in
+ * the TCAM do not have to be replaced by the canonical entries of
+ * [c, d]. Any old entry that lies inside [c, d] can stay; only the
+ * gaps between the kept entries need new ones. Two layouts are
+ * compared and the one with fewer writes (deletes + adds) wins,
+ * then the one with fewer entries:
+ *
+ *  1. canonical: the entries of range2masks(c, d); delete the old
+ *     ones it does not have, add the ones the TCAM does not have
+ *  2. reuse:     keep every old entry inside [c, d], delete the rest
+ *     and add the entries of the gaps
+ *
+ * The entries of a rule never overlap, so their order in the TCAM
+ * does not matter.
+ */
+
+#include "range2masks.h"
+
+
+typedef struct span_ {
+    u32 lo;
+    u32 hi;
+} span;
+
+static inline span
+spanOf (const tcamEnt *e)
+{
+    span s = { e->patt & e->mask, (e->patt & e->mask) | ~e->mask };
+
+    return s;
+}
+
+static bool
+has (const tcamEnt *set, u32 n, const tcamEnt *e)
+{
+    u32 i;
+
+    for (i = 0; i < n; ++i) {
+        if (set[i].patt == e->patt && set[i].mask == e->mask) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/* Appends the entries of [st, end] ('end' may be 0xffffffff) */
+static int
+append (u32 st, u32 end, tcamEnt *ent, u32 maxEnt, u32 *pnEnt)
+{
+    u32 n;
+    int rc;
+
+    if (*pnEnt + MAXENT > maxEnt) {
+        return R2M_ENOSPC;
+    }
+    rc = range2entsFull(st, end, ent + *pnEnt, MAXENT, &n);
+    if (rc == SUCCESS) {
+        *pnEnt += n;
+    }
+    return rc;
+}
+
+static int
+cmpLo (const void *a, const void *b)
+{
+    u32 x = spanOf(a).lo, y = spanOf(b).lo;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * Layout 2. Returns R2M_EINVAL if the kept entries overlap.
+ */
+static int
+reuse (const tcamEnt *old, u32 nOld, u32 st, u32 end, r2mArena *a,
+       r2mDelta *d)
+{
+    tcamEnt *keep;
+    u32 nKeep = 0, maxAdd, i;
+    u64 next = st;              /* first value not covered yet */
+    span s;
+    int rc;
+
+    keep   = r2mArenaAlloc(a, (nOld + 1) * sizeof(*keep));
+    d->del = r2mArenaAlloc(a, (nOld + 1) * sizeof(*d->del));
+    if (!keep || !d->del) {
+        return R2M_EFAIL;
+    }
+    d->nDel = 0;
+    for (i = 0; i < nOld; ++i) {
+        s = spanOf(old + i);
+        if (st <= s.lo && s.hi <= end) {
+            keep[nKeep++] = old[i];
+        } else {
+            d->del[d->nDel++] = old[i];
+        }
+    }
+    qsort(keep, nKeep, sizeof(*keep), cmpLo);
+
+    /* each gap needs at most MAXENT entries */
+    maxAdd = (nKeep + 1) * MAXENT;
+    if ((d->add = r2mArenaAlloc(a, maxAdd * sizeof(*d->add))) == NULL) {
+        return R2M_EFAIL;
+    }
+    d->nAdd = 0;
+    for (i = 0; i < nKeep; ++i) {
+        s = spanOf(keep + i);
+        if (s.lo < next) {
+            return R2M_EINVAL;  /* overlapping old entries */
+        }
+        if (s.lo > next &&
+            (rc = append(next, s.lo - 1, d->add, maxAdd, &d->nAdd))
+            != SUCCESS) {
+            return rc;
+        }
+        next = (u64)s.hi + 1;
+    }
+    if (next <= end &&
+        (rc = append(next, end, d->add, maxAdd, &d->nAdd)) != SUCCESS) {
+        return rc;
+    }
+    r2mArenaTrim(a, d->add, d->nAdd * sizeof(*d->add));
+    d->nKeep = nKeep;
+    return SUCCESS;
+}
+
+/*
+ * Layout 1
+ */
+static int
+canonical (const tcamEnt *old, u32 nOld, u32 st, u32 end, r2mArena *a,
+           r2mDelta *d)
+{
+    tcamEnt *ent;
+    u32 n = 0, i;
+    int rc;
+
+    ent    = r2mArenaAlloc(a, MAXENT * sizeof(*ent));
+    d->del = r2mArenaAlloc(a, (nOld + 1) * sizeof(*d->del));
+    d->add = r2mArenaAlloc(a, MAXENT * sizeof(*d->add));
+    if (!ent || !d->del || !d->add) {
+        return R2M_EFAIL;
+    }
+    if ((rc = append(st, end, ent, MAXENT, &n)) != SUCCESS) {
+        return rc;
+    }
+    d->nDel  = 0;
+    d->nAdd  = 0;
+    d->nKeep = 0;
+    for (i = 0; i < nOld; ++i) {
+        if (has(ent, n, old + i)) {
+            ++d->nKeep;
+        } else {
+            d->del[d->nDel++] = old[i];
+        }
+    }
+    for (i = 0; i < n; ++i) {
+        if (!has(old, nOld, ent + i)) {
+            d->add[d->nAdd++] = ent[i];
+        }
+    }
+    return SUCCESS;
+}
+
+/**
+ * @name  r2mDeltaEnts
+ *
+ * @brief Computes the TCAM writes that change the entries of a rule
+ *        into entries of [st, end] (see the top of this file)
+ *
+ * @param[in]  old  Entries in the TCAM (disjoint, e.g. made by
+ *                  range2masks())
+ * @param[in]  nOld Number of entries of 'old'
+ * @param[in]  st   Number that the new range starts
+ * @param[in]  end  Number that the new range ends (0xffffffff is fine)
+ * @param[in]  a    Arena for d->del and d->add
+ * @param[out] d    Entries to delete and to add
+ *
+ * @retval SUCCESS    'd' is set
+ * @retval R2M_EINVAL NULL pointer or st > end
+ * @retval R2M_EFAIL  Out of memory
+ */
+int
+r2mDeltaEnts (const tcamEnt *old, u32 nOld, u32 st, u32 end, r2mArena *a,
+              r2mDelta *d)
+{
+    r2mDelta d1, d2;
+    int rc1, rc2;
+
+
+    if ((!old && nOld) || !a || !d || st > end) {
+        return R2M_EINVAL;
+    }
+    if ((rc1 = canonical(old, nOld, st, end, a, &d1)) != SUCCESS) {
+        return rc1;
+    }
+    rc2 = reuse(old, nOld, st, end, a, &d2);
+    if (rc2 == R2M_EFAIL) {
+        return rc2;
+    }
+    if (rc2 == SUCCESS &&
+        (d2.nDel + d2.nAdd < d1.nDel + d1.nAdd ||
+         (d2.nDel + d2.nAdd == d1.nDel + d1.nAdd &&
+          d2.nKeep + d2.nAdd < d1.nKeep + d1.nAdd))) {
+        *d = d2;
+    } else {
+        *d = d1;
+    }
+    return SUCCESS;
+}
+
+/**
+ * @name  r2mDeltaRange
+ *
+ * @brief r2mDeltaEnts() for a rule whose entries were made by
+ *        range2masks(oldSt, oldEnd)
+ *
+ * @param[in]  oldSt  Number that the old range starts
+ * @param[in]  oldEnd Number that the old range ends (< oldSt: no
+ *                    old entries, i.e. a new rule)
+ * @param[in]  st     Number that the new range starts
+ * @param[in]  end    Number that the new range ends
+ * @param[in]  a      Arena for d->del and d->add
+ * @param[out] d      Entries to delete and to add
+ *
+ * @retval See r2mDeltaEnts()
+ */
+int
+r2mDeltaRange (u32 oldSt, u32 oldEnd, u32 st, u32 end, r2mArena *a,
+          r2mDelta *d)
+{
+    tcamEnt old[MAXENT];
+    u32 nOld = 0;
+    int rc;
+
+
+    if (oldSt <= oldEnd &&
+        (rc = append(oldSt, oldEnd, old, MAXENT, &nOld)) != SUCCESS) {
+        return rc;
+    }
+    return r2mDeltaEnts(old, nOld, st, end, a, d);
+}
@@ -0,0 +1,221 @@
+/*
+ * r2m_dirpe.c: database-independent range pre-encoding (DIRPE)
+ *
+ * Copyright (c) 2017, 2018, 2019, 2020, 2021 Yoichi Hariguchi
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the
+ * Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall
+ * be included in all copies or substantial portions of the
+ * Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+ */
+
+/*
+ * A W-bit key is cut into k = W/c chunks of c bits, and each chunk
+ * value v is stored in the TCAM as a fence (thermometer) code of
+ * 2^c - 1 bits whose v low bits are 1. A chunk is then in [a, b]
+ * exactly when its fence bits below a are 1 and those from b up are
+ * 0: one ternary chunk pattern per chunk range, instead of up to
+ * 2c - 2 prefixes.
+ *
+ * [st, end] is split like into prefixes, but in base 2^c: every
+ * piece has its upper chunks fixed, one chunk ranging over [a, b]
+ * and every lower chunk wild. That is at most 2k - 1 entries (at
+ * most 1 for c = W) for k (2^c - 1) bits of key. The packet side
+ * encodes its keys with r2mDirpeKey(). c = 1 is the binary code:
+ * the same entries as the prefix engines.
+ */
+
+#include "range2masks.h"
+
+#ifdef __SIZEOF_INT128__
+
+typedef struct dirpe_ {
+    u32      c;                 /* bits per chunk */
+    u32      fw;                /* fence bits per chunk (2^c - 1) */
+    tcamEntW *ent;
+    u32      maxEnt;
+    u32      nEnt;
+} dirpe;
+
+
+static inline r2mU128
+fence (u32 v)
+{
+    return ((r2mU128)1 << v) - 1;
+}
+
+/*
+ * Appends the entry of [st, end] where the chunks above 'pos' are
+ * those of 'st', chunk 'pos' is in [a, b] and the lower ones are wild
+ */
+static int
+put (dirpe *d, u32 st, u32 pos, u32 a, u32 b, u32 k)
+{
+    r2mU128 patt = 0, mask = 0;
+    u32 j, v, off;
+
+    if (d->nEnt == d->maxEnt) {
+        return R2M_ENOSPC;
+    }
+    for (j = pos + 1; j < k; ++j) {
+        v    = (st >> (j * d->c)) & ((1U << d->c) - 1);
+        off  = j * d->fw;
+        patt |= fence(v) << off;
+        mask |= fence(d->fw) << off;
+    }
+    off   = pos * d->fw;
+    patt |= fence(a) << off;
+    mask |= (fence(a) | (fence(d->fw) & ~fence(b))) << off;
+    d->ent[d->nEnt].patt = patt;
+    d->ent[d->nEnt].mask = mask;
+    ++d->nEnt;
+    return SUCCESS;
+}
+
+/*
+ * [st, end] whose chunks above 'pos' are the same
+ */
+static int
+split (dirpe *d, u32 st, u32 end, u32 pos, u32 k)
+{
+    u32 low = (pos == 0) ? 0 : (u32)(((u64)1 << (pos * d->c)) - 1);
+    u32 sd  = (st >> (pos * d->c)) & ((1U << d->c) - 1);
+    u32 ed  = (end >> (pos * d->c)) & ((1U << d->c) - 1);
+    int rc;
+
+    if ((st & low) == 0 && (end & low) == low) {
+        return put(d, st, pos, sd, ed, k);
+    }
+    if (sd == ed) {
+        return split(d, st, end, pos - 1, k);
+    }
+    if (st & low) {
+        if ((rc = split(d, st, st | low, pos - 1, k)) != SUCCESS) {
+            return rc;
+        }
+        ++sd;
+    }
+    if ((end & low) != low) {
+        --ed;
+    }
+    if (sd <= ed && (rc = put(d, st, pos, sd, ed, k)) != SUCCESS) {
+        return rc;
+    }
+    if ((end & low) != low) {
+        return split(d, end & ~low, end, pos - 1, k);
+    }
+    return SUCCESS;
+}
+
+/**
+ * @name  r2mDirpeWidth
+ *
+ * @brief Returns the number of TCAM bits of a DIRPE encoded key
+ *
+ * @param[in] width Bits of the key (1 ... 32)
+ * @param[in] chunk Bits per chunk (must divide 'width')
+ *
+ * @retval (width / chunk) * (2^chunk - 1), or 0 if the combination
+ *         is not supported (more than 128 bits)
+ */
+u32
+r2mDirpeWidth (u32 width, u32 chunk)
+{
+    u32 bits;
+
+    if (width == 0 || width > 32 || chunk == 0 || chunk > 7 ||
+        width % chunk) {
+        return 0;
+    }
+    bits = (width / chunk) * ((1U << chunk) - 1);
+    return (bits <= 128) ? bits : 0;
+}
+
+/**
+ * @name  r2mDirpeKey
+ *
+ * @brief Encodes a key for the entries of range2entsDirpe()
+ *
+ * @param[in] width Bits of the key
+ * @param[in] chunk Bits per chunk
+ * @param[in] key   Key (< 2^width)
+ *
+ * @retval Encoded key (r2mDirpeWidth() low bits), 0 if unsupported
+ */
+r2mU128
+r2mDirpeKey (u32 width, u32 chunk, u32 key)
+{
+    u32 fw = (1U << chunk) - 1;
+    r2mU128 v = 0;
+    u32 j;
+
+    if (r2mDirpeWidth(width, chunk) == 0) {
+        return 0;
+    }
+    for (j = 0; j < width / chunk; ++j) {
+        v |= fence((key >> (j * chunk)) & fw) << (j * fw);
+    }
+    return v;
+}
+
+/**
+ * @name  range2entsDirpe
+ *
+ * @brief Converts a range into DIRPE encoded TCAM entries (from the
+ *        start of the range towards the end; they are disjoint)
+ *
+ * @param[in]  width  Bits of the key
+ * @param[in]  chunk  Bits per chunk (see r2mDirpeWidth())
+ * @param[in]  st     Number that the range starts
+ * @param[in]  end    Number that the range ends ([0, 2^W-1] is fine)
+ * @param[out] ent    Entries (r2mDirpeWidth() low bits significant)
+ * @param[in]  maxEnt Room of 'ent'; R2M_MAXENT_DIRPE(width, chunk)
+ *                    is always enough
+ * @param[out] pnEnt  Number of entries
+ *
+ * @retval SUCCESS    The range is successfully converted
+ * @retval R2M_EINVAL Unsupported width/chunk or NULL pointer
+ * @retval R2M_ERANGE 'st' or 'end' does not fit in W bits
+ * @retval R2M_ENOSPC 'maxEnt' is too small
+ */
+int
+range2entsDirpe (u32 width, u32 chunk, u32 st, u32 end, tcamEntW *ent,
+                 u32 maxEnt, u32 *pnEnt)
+{
+    u32 max = (width >= 32) ? ~0U : (1U << width) - 1;
+    dirpe d = { chunk, (1U << chunk) - 1, ent, maxEnt, 0 };
+    int rc;
+
+    if (!ent || !pnEnt || r2mDirpeWidth(width, chunk) == 0) {
+        return R2M_EINVAL;
+    }
+    *pnEnt = 0;
+    if (st > max || end > max) {
+        return R2M_ERANGE;
+    }
+    if (st > end) {
+        return SUCCESS;
+    }
+    rc = split(&d, st, end, width / chunk - 1, width / chunk);
+    *pnEnt = d.nEnt;
+    return rc;
+}
+
+#endif /* __SIZEOF_INT128__ */
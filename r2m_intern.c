@@ -0,0 +1,218 @@
+/*
+ * r2m_intern.c: hash-consed table of the entries shared by rules
+ *
+ * Copyright (c) 2017, 2018, 2019, 2020, 2021 Yoichi Hariguchi
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the
+ * Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall
+ * be included in all copies or substantial portions of the
+ * Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+ */
+
+/*
+ * Each distinct (patt, mask) pair gets the next ID, 0, 1, 2, ...,
+ * so the table is the array of the entries in the order they were
+ * first seen. The index is open addressing with linear probing over
+ * a power-of-2 array of ID + 1 (0: empty), at most half full; it is
+ * doubled and rebuilt from the entries when it would be fuller.
+ * Nothing is ever removed.
+ */
+
+#include "range2masks.h"
+
+enum {
+    MIN_ENTS = 256,             /* initial room of the table */
+};
+
+struct r2mIntern_ {
+    tcamEnt *ent;               /* ent[id] */
+    u32      nEnt;
+    u32      maxEnt;            /* room of ent[] */
+    u32     *idx;               /* [mask + 1]: ID + 1 (0: empty) */
+    u32      mask;
+    u64      nRef;              /* r2mInternAdd() calls that succeeded */
+};
+
+
+static inline u32
+hashEnt (const tcamEnt *e)
+{
+    u64 h = ((u64)e->patt << 32) | e->mask;
+
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return (u32)h;
+}
+
+/* Makes room for one more entry (the index twice as large as ent[]) */
+static int
+grow (r2mIntern *t)
+{
+    tcamEnt *ent;
+    u32 *idx;
+    u32 n, i, h;
+
+    if (t->nEnt < t->maxEnt) {
+        return SUCCESS;
+    }
+    if (t->maxEnt >= (1U << 30)) {
+        return R2M_ENOSPC;
+    }
+    n = 2 * t->maxEnt;
+    if ((ent = realloc(t->ent, n * sizeof(*ent))) == NULL) {
+        return R2M_EFAIL;
+    }
+    t->ent = ent;
+    if ((idx = calloc(2 * (size_t)n, sizeof(*idx))) == NULL) {
+        return R2M_EFAIL;
+    }
+    free(t->idx);
+    t->idx    = idx;
+    t->mask   = 2 * n - 1;
+    t->maxEnt = n;
+    for (i = 0; i < t->nEnt; ++i) {
+        for (h = hashEnt(ent + i); idx[h & t->mask]; ++h) {
+            ;
+        }
+        idx[h & t->mask] = i + 1;
+    }
+    return SUCCESS;
+}
+
+/**
+ * @name  r2mInternCreate
+ *
+ * @brief Creates an empty table
+ *
+ * @param[in] nHint Expected number of distinct entries (0: default)
+ *
+ * @retval Pointer to the table, or NULL if out of memory
+ */
+r2mIntern *
+r2mInternCreate (u32 nHint)
+{
+    r2mIntern *t;
+    u32 n = MIN_ENTS;
+
+    while (n < nHint && n < (1U << 30)) {
+        n <<= 1;
+    }
+    if ((t = calloc(1, sizeof(*t))) == NULL) {
+        return NULL;
+    }
+    t->ent = malloc(n * sizeof(*t->ent));
+    t->idx = calloc(2 * (size_t)n, sizeof(*t->idx));
+    if (!t->ent || !t->idx) {
+        r2mInternDestroy(t);
+        return NULL;
+    }
+    t->maxEnt = n;
+    t->mask   = 2 * n - 1;
+    return t;
+}
+
+/**
+ * @name  r2mInternDestroy
+ *
+ * @brief Frees a table
+ *
+ * @param[in] t Table (may be NULL)
+ */
+void
+r2mInternDestroy (r2mIntern *t)
+{
+    if (t) {
+        free(t->idx);
+        free(t->ent);
+        free(t);
+    }
+}
+
+/**
+ * @name  r2mInternAdd
+ *
+ * @brief Looks up an entry and adds it if it is new
+ *
+ * @param[in]  t   Table
+ * @param[in]  e   Entry
+ * @param[out] pId ID of the entry (index of r2mInternEnts())
+ *
+ * @retval SUCCESS    *pId is set
+ * @retval R2M_EINVAL A NULL pointer was given
+ * @retval R2M_ENOSPC The table has 2^30 entries
+ * @retval R2M_EFAIL  Out of memory. The table is unchanged.
+ */
+int
+r2mInternAdd (r2mIntern *t, const tcamEnt *e, u32 *pId)
+{
+    u32 h, id;
+    int rc;
+
+    if (!t || !e || !pId) {
+        return R2M_EINVAL;
+    }
+    for (h = hashEnt(e); (id = t->idx[h & t->mask]) != 0; ++h) {
+        if (t->ent[id - 1].patt == e->patt &&
+            t->ent[id - 1].mask == e->mask) {
+            *pId = id - 1;
+            ++t->nRef;
+            return SUCCESS;
+        }
+    }
+    if (t->nEnt == t->maxEnt) {
+        if ((rc = grow(t)) != SUCCESS) {
+            return rc;
+        }
+        for (h = hashEnt(e); t->idx[h & t->mask]; ++h) {
+            ;
+        }
+    }
+    t->ent[t->nEnt] = *e;
+    t->idx[h & t->mask] = ++t->nEnt;
+    *pId = t->nEnt - 1;
+    ++t->nRef;
+    return SUCCESS;
+}
+
+/**
+ * @name  r2mInternEnts
+ *
+ * @brief Returns the table: entry 'id' is at index 'id'
+ *
+ * @param[in]  t     Table
+ * @param[out] pnEnt Number of distinct entries (may be NULL)
+ * @param[out] pnRef Number of entries added, with the duplicates
+ *                   (may be NULL)
+ *
+ * @retval Entries (valid until the next r2mInternAdd())
+ */
+const tcamEnt *
+r2mInternEnts (const r2mIntern *t, u32 *pnEnt, u64 *pnRef)
+{
+    if (pnEnt) {
+        *pnEnt = t->nEnt;
+    }
+    if (pnRef) {
+        *pnRef = t->nRef;
+    }
+    return t->ent;
+}
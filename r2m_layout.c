@@ -0,0 +1,554 @@
+/*
+ * r2m_layout.c: priority-ordered TCAM slot layout with few moves
+ *
+ * Copyright (c) 2017, 2018, 2019, 2020, 2021 Yoichi Hariguchi
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the
+ * Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall
+ * be included in all copies or substantial portions of the
+ * Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+ */
+
+/*
+ * A TCAM of nSlots slots answers with the lowest matching slot, so
+ * the entries must be in priority order (smaller first); the order
+ * within a priority does not matter (e.g. the entries of one rule,
+ * or the [0, start-1] and the [0, end] entries of -optimize, which
+ * are two priorities).
+ *
+ * r2mLayoutPlan() places the entries band by band (a band: the
+ * entries of one priority) and spreads the free slots evenly as gaps
+ * after the bands, so most insertions find a free slot where their
+ * priority may go and cost no move.
+ *
+ * Otherwise r2mLayoutInsert() takes the nearest free slot below (or
+ * above) that place and moves one entry per band in between: the
+ * first (or last) entry of each band goes to the hole at the other
+ * end of the band. The cheaper direction is taken, so an insertion
+ * costs as many moves as bands it has to cross, the fewest for an
+ * ordered layout, and the table stays ordered after every move.
+ * Deleting costs nothing.
+ *
+ * The bands are kept in an array sorted by priority with their first
+ * and last slots, and the slots in use in a bitmap with a summary bit
+ * per 64-slot word ("has a free slot", "has a slot in use"). Finding
+ * the place is a binary search of the bands, each move a bitmap
+ * search that tests a word per 4096 slots of distance, so an insertion
+ * is O(log bands + moves) for the CPU as well. Only a new priority
+ * (or the last entry of one deleted) shifts the band array.
+ */
+
+#include "range2masks.h"
+
+#define NONE    (~0U)
+
+typedef struct band_ {
+    u32 prio;
+    u32 first;                  /* slots of the first and the last */
+    u32 last;                   /* entries of the priority */
+    u32 n;                      /* entries */
+} band;
+
+struct r2mLayout_ {
+    u32   nSlots;
+    u32   nUsed;
+    u32  *prio;                 /* [nSlots] priority of the entry */
+    u64  *bits;                 /* [nWord] 1: in use (also the bits
+                                   past nSlots) */
+    u64  *sum[2];               /* [(nWord + 63) / 64] bit per word:
+                                   [0]: has a free slot, [1]: in use */
+    u32   nWord;
+    band *band;                 /* sorted by prio */
+    u32   nBand;
+    u32   maxBand;              /* room of band[] */
+};
+
+typedef struct order_ {
+    u32 prio;
+    u32 idx;
+} order;
+
+
+static int
+cmpOrder (const void *a, const void *b)
+{
+    const order *x = a, *y = b;
+
+    if (x->prio != y->prio) {
+        return (x->prio < y->prio) ? -1 : 1;
+    }
+    return (x->idx < y->idx) ? -1 : (x->idx > y->idx);
+}
+
+static inline bool
+isUsed (const r2mLayout *l, u32 s)
+{
+    return (l->bits[s / 64] >> (s % 64)) & 1;
+}
+
+static inline void
+setUsed (r2mLayout *l, u32 s, bool used)
+{
+    u32 i = s / 64;
+    u64 bit = 1ULL << (i % 64);
+
+    if (used) {
+        l->bits[i] |= 1ULL << (s % 64);
+    } else {
+        l->bits[i] &= ~(1ULL << (s % 64));
+    }
+    l->sum[0][i / 64] = (l->bits[i] != ~0ULL) ? l->sum[0][i / 64] | bit :
+                                                l->sum[0][i / 64] & ~bit;
+    l->sum[1][i / 64] = (l->bits[i] != 0) ? l->sum[1][i / 64] | bit :
+                                            l->sum[1][i / 64] & ~bit;
+}
+
+/* Bits of word 'i' that are 'used' */
+static inline u64
+wordOf (const r2mLayout *l, u32 i, int used)
+{
+    return (used) ? l->bits[i] : ~l->bits[i];
+}
+
+/* First slot >= s that is 'used', or nSlots */
+static u32
+nextSlot (const r2mLayout *l, u32 s, int used)
+{
+    u32 i = s / 64, j;
+    u64 w;
+
+    if (s >= l->nSlots) {
+        return l->nSlots;
+    }
+    w = wordOf(l, i, used) & (~0ULL << (s % 64));
+    if (w == 0) {
+        j = (i + 1) / 64;
+        w = (((i + 1) % 64) ? l->sum[used][j] & (~0ULL << ((i + 1) % 64)) :
+             ((j < (l->nWord + 63) / 64) ? l->sum[used][j] : 0));
+        while (w == 0) {
+            if (++j >= (l->nWord + 63) / 64) {
+                return l->nSlots;
+            }
+            w = l->sum[used][j];
+        }
+        i = 64 * j + __builtin_ctzll(w);
+        w = wordOf(l, i, used);
+    }
+    s = 64 * i + __builtin_ctzll(w);
+    return (s < l->nSlots) ? s : l->nSlots;
+}
+
+/* Last slot <= s that is 'used', or NONE */
+static u32
+prevSlot (const r2mLayout *l, u32 s, int used)
+{
+    u32 i, j;
+    u64 w;
+
+    if (s == NONE) {
+        return NONE;
+    }
+    i = s / 64;
+    w = wordOf(l, i, used) & (~0ULL >> (63 - s % 64));
+    if (w == 0) {
+        if (i == 0) {
+            return NONE;
+        }
+        j = (i - 1) / 64;
+        w = l->sum[used][j] & (~0ULL >> (63 - (i - 1) % 64));
+        while (w == 0) {
+            if (j-- == 0) {
+                return NONE;
+            }
+            w = l->sum[used][j];
+        }
+        i = 64 * j + 63 - __builtin_clzll(w);
+        w = wordOf(l, i, used);
+    }
+    return 64 * i + 63 - __builtin_clzll(w);
+}
+
+/* Index of the first band with prio >= 'prio' (nBand if none) */
+static u32
+findBand (const r2mLayout *l, u32 prio)
+{
+    u32 lo = 0, hi = l->nBand, mid;
+
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (l->band[mid].prio < prio) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/* Room for one more band */
+static int
+growBands (r2mLayout *l)
+{
+    band *b;
+    u32 n;
+
+    if (l->nBand < l->maxBand) {
+        return SUCCESS;
+    }
+    n = (l->maxBand) ? 2 * l->maxBand : 64;
+    if ((b = realloc(l->band, n * sizeof(*b))) == NULL) {
+        return R2M_EFAIL;
+    }
+    l->band    = b;
+    l->maxBand = n;
+    return SUCCESS;
+}
+
+/* Empties the slots (the bits past nSlots stay in use) */
+static void
+clearSlots (r2mLayout *l)
+{
+    u32 i;
+
+    memset(l->bits, 0, l->nWord * sizeof(*l->bits));
+    if (l->nSlots % 64) {
+        l->bits[l->nWord - 1] = ~0ULL << (l->nSlots % 64);
+    }
+    memset(l->sum[1], 0, ((l->nWord + 63) / 64) * sizeof(u64));
+    memset(l->sum[0], 0, ((l->nWord + 63) / 64) * sizeof(u64));
+    for (i = 0; i < l->nWord; ++i) {
+        if (l->bits[i] != ~0ULL) {
+            l->sum[0][i / 64] |= 1ULL << (i % 64);
+        }
+        if (l->bits[i] != 0) {          /* the bits past nSlots: found */
+            l->sum[1][i / 64] |= 1ULL << (i % 64);  /* but clamped */
+        }
+    }
+    l->nBand = 0;
+    l->nUsed = 0;
+}
+
+static inline void
+move (r2mLayout *l, u32 from, u32 to, r2mMove *mv)
+{
+    mv->from = from;
+    mv->to   = to;
+    l->prio[to] = l->prio[from];
+    setUsed(l, to, TRUE);
+    setUsed(l, from, FALSE);
+}
+
+/**
+ * @name  r2mLayoutCreate
+ *
+ * @brief Creates an empty layout
+ *
+ * @param[in] nSlots Number of slots of the TCAM
+ *
+ * @retval Pointer to the layout, or NULL if out of memory (or
+ *         nSlots is 0)
+ */
+r2mLayout *
+r2mLayoutCreate (u32 nSlots)
+{
+    r2mLayout *l;
+
+    if (nSlots == 0 || (l = calloc(1, sizeof(*l))) == NULL) {
+        return NULL;
+    }
+    l->nWord  = (nSlots + 63) / 64;
+    l->prio   = calloc(nSlots, sizeof(*l->prio));
+    l->bits   = calloc(l->nWord, sizeof(*l->bits));
+    l->sum[0] = calloc((l->nWord + 63) / 64, sizeof(u64));
+    l->sum[1] = calloc((l->nWord + 63) / 64, sizeof(u64));
+    if (!l->prio || !l->bits || !l->sum[0] || !l->sum[1]) {
+        r2mLayoutDestroy(l);
+        return NULL;
+    }
+    l->nSlots = nSlots;
+    clearSlots(l);
+    return l;
+}
+
+/**
+ * @name  r2mLayoutDestroy
+ *
+ * @brief Frees a layout
+ *
+ * @param[in] l Layout (may be NULL)
+ */
+void
+r2mLayoutDestroy (r2mLayout *l)
+{
+    if (l) {
+        free(l->band);
+        free(l->sum[1]);
+        free(l->sum[0]);
+        free(l->bits);
+        free(l->prio);
+        free(l);
+    }
+}
+
+/**
+ * @name  r2mLayoutPlan
+ *
+ * @brief Lays out a new table: the entries sorted by priority (then
+ *        by index), a gap of free slots after each priority
+ *
+ * @param[in]  l    Layout (its entries are dropped)
+ * @param[in]  prio Priority of each entry (smaller wins)
+ * @param[in]  n    Number of entries
+ * @param[out] slot Slot of each entry
+ *
+ * @retval SUCCESS    The entries are placed
+ * @retval R2M_EINVAL A NULL pointer was given
+ * @retval R2M_ENOSPC n is larger than the number of slots
+ * @retval R2M_EFAIL  Out of memory. The layout is unchanged.
+ */
+int
+r2mLayoutPlan (r2mLayout *l, const u32 *prio, u32 n, u32 *slot)
+{
+    order *o;
+    band *b;
+    u32 nBand, gap, extra, nFree, s, i, k;
+
+    if (!l || (n && (!prio || !slot))) {
+        return R2M_EINVAL;
+    }
+    if (n > l->nSlots) {
+        return R2M_ENOSPC;
+    }
+    if ((o = malloc(((n) ? n : 1) * sizeof(*o))) == NULL) {
+        return R2M_EFAIL;
+    }
+    for (i = 0; i < n; ++i) {
+        o[i].prio = prio[i];
+        o[i].idx  = i;
+    }
+    qsort(o, n, sizeof(*o), cmpOrder);
+    for (nBand = 0, i = 0; i < n; ++i) {
+        nBand += (i == 0 || o[i].prio != o[i - 1].prio);
+    }
+    if (nBand > l->maxBand) {
+        if ((b = realloc(l->band, nBand * sizeof(*b))) == NULL) {
+            free(o);
+            return R2M_EFAIL;
+        }
+        l->band    = b;
+        l->maxBand = nBand;
+    }
+
+    clearSlots(l);
+    nFree = l->nSlots - n;
+    gap   = (nBand) ? nFree / nBand : 0;
+    extra = (nBand) ? nFree % nBand : 0;
+    for (s = 0, k = 0, i = 0; i < n; ++i) {
+        if (i == 0 || o[i].prio != o[i - 1].prio) {
+            b = l->band + k;
+            b->prio  = o[i].prio;
+            b->first = s;
+            b->n     = 0;
+        }
+        slot[o[i].idx] = s;
+        l->prio[s] = o[i].prio;
+        setUsed(l, s, TRUE);
+        b->last = s;
+        ++b->n;
+        ++s;
+        if (i + 1 == n || o[i + 1].prio != o[i].prio) {
+            s += gap + (k++ < extra);           /* end of a band */
+        }
+    }
+    l->nBand = nBand;
+    l->nUsed = n;
+    free(o);
+    return SUCCESS;
+}
+
+/**
+ * @name  r2mLayoutInsert
+ *
+ * @brief Finds a slot for a new entry, and the moves that make it
+ *        free if needed
+ *
+ * The moves are to be written in order (each copies the entry of
+ * 'from' into the free slot 'to', then 'from' is free); the new
+ * entry goes to *pSlot last. Every step keeps the priority order.
+ *
+ * @param[in]  l     Layout
+ * @param[in]  prio  Priority of the new entry (smaller wins)
+ * @param[out] mv    Moves
+ * @param[in]  maxMv Number of elements of 'mv'
+ * @param[out] pnMv  Number of moves stored in 'mv'
+ * @param[out] pSlot Slot of the new entry
+ *
+ * @retval SUCCESS    The entry is placed
+ * @retval R2M_EINVAL A NULL pointer was given
+ * @retval R2M_ENOSPC No free slot, or more than 'maxMv' moves. The
+ *                    layout is unchanged.
+ * @retval R2M_EFAIL  Out of memory (a new priority). The layout is
+ *                    unchanged.
+ */
+int
+r2mLayoutInsert (r2mLayout *l, u32 prio, r2mMove *mv, u32 maxMv,
+                 u32 *pnMv, u32 *pSlot)
+{
+    u32 b, next, lo, hi, up, down, nUp = NONE, nDown = NONE;
+    u32 s, v, j, n = 0;
+    bool own;
+    band *p;
+
+    if (!l || !pnMv || !pSlot || (maxMv && !mv)) {
+        return R2M_EINVAL;
+    }
+    *pnMv = 0;
+    b    = findBand(l, prio);
+    own  = (b < l->nBand && l->band[b].prio == prio);
+    next = (own) ? b + 1 : b;
+    if (!own && growBands(l) != SUCCESS) {
+        return R2M_EFAIL;
+    }
+    /*
+     * The entry may go to a free slot in [lo, hi): after the last
+     * entry of a smaller priority, before the first of a larger one.
+     */
+    lo = (b > 0) ? l->band[b - 1].last + 1 : 0;
+    hi = (next < l->nBand) ? l->band[next].first : l->nSlots;
+    if ((s = nextSlot(l, lo, FALSE)) < hi) {
+        goto place;
+    }
+
+    /* [lo, hi) is full: the nearest free slots around it */
+    down = nextSlot(l, hi, FALSE);
+    up   = (lo > 0) ? prevSlot(l, lo - 1, FALSE) : NONE;
+    if (down < l->nSlots) {
+        for (nDown = 0; next + nDown < l->nBand &&
+             l->band[next + nDown].first < down; ++nDown) {
+            ;
+        }
+    }
+    if (up != NONE) {
+        for (nUp = 0; nUp < b && l->band[b - 1 - nUp].last > up; ++nUp) {
+            ;
+        }
+    }
+    if (nUp == NONE && nDown == NONE) {
+        return R2M_ENOSPC;
+    }
+    if (((nDown <= nUp) ? nDown : nUp) > maxMv) {
+        return R2M_ENOSPC;
+    }
+
+    if (nDown <= nUp) {
+        /* the first entry of each band goes to the hole below it */
+        for (v = down, j = next + nDown; j-- > next; v = s) {
+            p = l->band + j;
+            s = p->first;
+            move(l, s, v, mv + n++);
+            p->first = nextSlot(l, s + 1, TRUE);
+            p->last  = (v > p->last) ? v : p->last;
+        }
+    } else {
+        /* the last entry of each band goes to the hole above it */
+        for (v = up, j = b - nUp; j < b; ++j, v = s) {
+            p = l->band + j;
+            s = p->last;
+            move(l, s, v, mv + n++);
+            p->last  = prevSlot(l, s - 1, TRUE);
+            p->first = (v < p->first) ? v : p->first;
+        }
+    }
+    s = v;
+    *pnMv = n;
+
+place:
+    if (!own) {
+        memmove(l->band + b + 1, l->band + b,
+                (l->nBand - b) * sizeof(*l->band));
+        ++l->nBand;
+        p = l->band + b;
+        p->prio  = prio;
+        p->first = s;
+        p->last  = s;
+        p->n     = 0;
+    }
+    p = l->band + b;
+    if (s < p->first) {
+        p->first = s;
+    }
+    if (s > p->last) {
+        p->last = s;
+    }
+    ++p->n;
+    l->prio[s] = prio;
+    setUsed(l, s, TRUE);
+    ++l->nUsed;
+    *pSlot = s;
+    return SUCCESS;
+}
+
+/**
+ * @name  r2mLayoutDelete
+ *
+ * @brief Frees the slot of an entry
+ *
+ * @param[in] l    Layout
+ * @param[in] slot Slot of the entry
+ *
+ * @retval SUCCESS    The slot is free
+ * @retval R2M_EINVAL 'slot' is out of range or free already
+ */
+int
+r2mLayoutDelete (r2mLayout *l, u32 slot)
+{
+    band *p;
+    u32 b;
+
+    if (!l || slot >= l->nSlots || !isUsed(l, slot)) {
+        return R2M_EINVAL;
+    }
+    setUsed(l, slot, FALSE);
+    --l->nUsed;
+    b = findBand(l, l->prio[slot]);
+    p = l->band + b;
+    if (--p->n == 0) {
+        memmove(p, p + 1, (l->nBand - b - 1) * sizeof(*p));
+        --l->nBand;
+    } else if (slot == p->first) {
+        p->first = nextSlot(l, slot + 1, TRUE);
+    } else if (slot == p->last) {
+        p->last = prevSlot(l, slot - 1, TRUE);
+    }
+    return SUCCESS;
+}
+
+/**
+ * @name  r2mLayoutUsed
+ *
+ * @brief Returns the number of slots in use
+ *
+ * @param[in] l Layout
+ */
+u32
+r2mLayoutUsed (const r2mLayout *l)
+{
+    return l->nUsed;
+}
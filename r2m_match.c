@@ -0,0 +1,366 @@
+/*
+ * r2m_match.c: software TCAM classifier
+ *
+ * Copyright (c) 2017, 2018, 2019, 2020, 2021 Yoichi Hariguchi
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the
+ * Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall
+ * be included in all copies or substantial portions of the
+ * Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+ */
+
+/*
+ * A set of rules (entries, priority, action) is compiled into the
+ * answer of a first-match TCAM for every 32-bit key: the key space
+ * is cut into disjoint intervals at the bounds of the entries, each
+ * labeled with the rule that wins there. A lookup is then a
+ * branch-free binary search of the interval starts, whatever the
+ * number of entries.
+ *
+ * The labels come from one sweep over the bounds with a heap of the
+ * entries that cover the current point, ordered by (priority, rule
+ * index): O(n log n) for n entries. Entries whose mask is not
+ * contiguous have no interval; they are kept in an array in the
+ * same order and compared with (key & mask) == patt after the
+ * search, only while they take precedence over the interval's rule.
+ */
+
+#include "range2masks.h"
+#include "r2m_bits.h"
+
+enum {
+    NO_RULE     = -1,
+    MATCH_LANES = 8,            /* keys searched together */
+};
+
+typedef struct mEnt_ {
+    u32 lo;                     /* prefix entries: [lo, hi] */
+    u32 hi;
+    u32 patt;                   /* others: (key & mask) == patt */
+    u32 mask;
+    u32 prio;
+    s32 rule;
+} mEnt;
+
+struct r2mMatch_ {
+    u32   nIv;                  /* number of intervals */
+    u32  *lo;                   /* [nIv] starts (lo[0] == 0) */
+    s32  *res;                  /* [nIv] rules (NO_RULE: no match) */
+    u32   nRes;                 /* entries with non-contiguous masks */
+    mEnt *resid;                /* [nRes] in precedence order */
+    const r2mMatchRule *rules;  /* for the priorities */
+};
+
+
+static inline bool
+before (const mEnt *a, const mEnt *b)
+{
+    return a->prio < b->prio || (a->prio == b->prio && a->rule < b->rule);
+}
+
+static inline bool
+ruleBefore (const r2mMatchRule *rules, s32 a, s32 b)
+{
+    return b == NO_RULE || rules[a].prio < rules[b].prio ||
+           (rules[a].prio == rules[b].prio && a < b);
+}
+
+static int
+cmpLo (const void *a, const void *b)
+{
+    u32 x = ((const mEnt *)a)->lo, y = ((const mEnt *)b)->lo;
+
+    return (x > y) - (x < y);
+}
+
+static int
+cmpPrec (const void *a, const void *b)
+{
+    return before(a, b) ? -1 : before(b, a);
+}
+
+static int
+cmpU32 (const void *a, const void *b)
+{
+    u32 x = *(const u32 *)a, y = *(const u32 *)b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * Binary heap of entries, the one that takes precedence on top
+ */
+static void
+heapPush (const mEnt **h, u32 *n, const mEnt *e)
+{
+    u32 i = (*n)++;
+
+    while (i > 0 && before(e, h[(i - 1) / 2])) {
+        h[i] = h[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    h[i] = e;
+}
+
+static void
+heapPop (const mEnt **h, u32 *n)
+{
+    const mEnt *e = h[--*n];
+    u32 i = 0, k;
+
+    while ((k = 2 * i + 1) < *n) {
+        if (k + 1 < *n && before(h[k + 1], h[k])) {
+            ++k;
+        }
+        if (!before(h[k], e)) {
+            break;
+        }
+        h[i] = h[k];
+        i = k;
+    }
+    h[i] = e;
+}
+
+/*
+ * Labels the intervals between the bounds of the prefix entries
+ */
+static int
+sweep (r2mMatch *m, mEnt *ent, u32 n)
+{
+    const mEnt **heap;
+    u32 *bound;
+    u32 nBound = 0, nHeap = 0, i, k = 0;
+    s32 r;
+
+    heap  = malloc((n + 1) * sizeof(*heap));
+    bound = malloc((2 * n + 1) * sizeof(*bound));
+    m->lo  = malloc((2 * n + 1) * sizeof(*m->lo));
+    m->res = malloc((2 * n + 1) * sizeof(*m->res));
+    if (!heap || !bound || !m->lo || !m->res) {
+        free(heap);
+        free(bound);
+        return R2M_EFAIL;
+    }
+    bound[nBound++] = 0;
+    for (i = 0; i < n; ++i) {
+        bound[nBound++] = ent[i].lo;
+        if (ent[i].hi != ~0) {
+            bound[nBound++] = ent[i].hi + 1;
+        }
+    }
+    qsort(bound, nBound, sizeof(*bound), cmpU32);
+    qsort(ent, n, sizeof(*ent), cmpLo);
+
+    m->nIv = 0;
+    for (i = 0; i < nBound; ++i) {
+        if (i > 0 && bound[i] == bound[i - 1]) {
+            continue;
+        }
+        for (; k < n && ent[k].lo == bound[i]; ++k) {
+            heapPush(heap, &nHeap, ent + k);
+        }
+        while (nHeap && heap[0]->hi < bound[i]) {
+            heapPop(heap, &nHeap);
+        }
+        r = (nHeap) ? heap[0]->rule : NO_RULE;
+        if (m->nIv == 0 || m->res[m->nIv - 1] != r) {
+            m->lo[m->nIv]  = bound[i];
+            m->res[m->nIv] = r;
+            ++m->nIv;
+        }
+    }
+    free(heap);
+    free(bound);
+    return SUCCESS;
+}
+
+/**
+ * @name  r2mMatchCreate
+ *
+ * @brief Compiles rules into a classifier. Among the rules whose
+ *        entries match a key, the one with the smallest priority
+ *        wins, then the one that comes first in 'rules'.
+ *
+ * @param[in] rules Rules; they must stay valid (and unchanged) while
+ *                  the classifier is used
+ * @param[in] n     Number of rules
+ *
+ * @retval Pointer to the classifier, or NULL if out of memory
+ */
+r2mMatch *
+r2mMatchCreate (const r2mMatchRule *rules, u32 n)
+{
+    r2mMatch *m;
+    mEnt *ent;
+    u32 i, k, nEnt = 0, nPfx = 0;
+
+    for (i = 0; i < n; ++i) {
+        nEnt += rules[i].nEnt;
+    }
+    if ((m = calloc(1, sizeof(*m))) == NULL) {
+        return NULL;
+    }
+    m->rules = rules;
+    ent      = malloc((nEnt + 1) * sizeof(*ent));
+    m->resid = malloc((nEnt + 1) * sizeof(*m->resid));
+    if (!ent || !m->resid) {
+        free(ent);
+        r2mMatchDestroy(m);
+        return NULL;
+    }
+    for (i = 0; i < n; ++i) {
+        for (k = 0; k < rules[i].nEnt; ++k) {
+            const tcamEnt *e = rules[i].ent + k;
+            mEnt *d = (r2mIsContig32(e->mask)) ? ent + nPfx++ :
+                                                 m->resid + m->nRes++;
+
+            d->patt = e->patt & e->mask;
+            d->mask = e->mask;
+            d->lo   = d->patt;
+            d->hi   = d->patt | ~e->mask;
+            d->prio = rules[i].prio;
+            d->rule = i;
+        }
+    }
+    qsort(m->resid, m->nRes, sizeof(*m->resid), cmpPrec);
+    if (sweep(m, ent, nPfx) != SUCCESS) {
+        free(ent);
+        r2mMatchDestroy(m);
+        return NULL;
+    }
+    free(ent);
+    return m;
+}
+
+/**
+ * @name  r2mMatchDestroy
+ *
+ * @brief Frees a classifier made by r2mMatchCreate()
+ *
+ * @param[in] m Classifier (may be NULL)
+ */
+void
+r2mMatchDestroy (r2mMatch *m)
+{
+    if (m) {
+        free(m->lo);
+        free(m->res);
+        free(m->resid);
+        free(m);
+    }
+}
+
+/**
+ * @name  r2mMatchSize
+ *
+ * @brief Returns the memory footprint of a classifier
+ *
+ * @param[in] m Classifier
+ *
+ * @retval Size in bytes (w/o the rules)
+ */
+size_t
+r2mMatchSize (const r2mMatch *m)
+{
+    return sizeof(*m) + m->nIv * (sizeof(*m->lo) + sizeof(*m->res)) +
+           m->nRes * sizeof(*m->resid);
+}
+
+static inline s32
+lookup (const r2mMatch *m, u32 key)
+{
+    const u32 *base = m->lo;
+    u32 len = m->nIv, half, i;
+    s32 r;
+
+    while (len > 1) {
+        half  = len / 2;
+        base  = (base[half] <= key) ? base + half : base;
+        len  -= half;
+    }
+    r = m->res[base - m->lo];
+    for (i = 0; i < m->nRes; ++i) {
+        const mEnt *e = m->resid + i;
+
+        if (r != NO_RULE && !ruleBefore(m->rules, e->rule, r)) {
+            break;
+        }
+        if ((key & e->mask) == e->patt) {
+            return e->rule;
+        }
+    }
+    return r;
+}
+
+/**
+ * @name  r2mMatchLookup
+ *
+ * @brief Classifies a key
+ *
+ * @param[in] m   Classifier
+ * @param[in] key Key
+ *
+ * @retval Index of the rule that matches, or -1 if none does
+ */
+int
+r2mMatchLookup (const r2mMatch *m, u32 key)
+{
+    return lookup(m, key);
+}
+
+/**
+ * @name  r2mMatchBatch
+ *
+ * @brief Classifies keys (same as r2mMatchLookup() for each)
+ *
+ * @param[in]  m    Classifier
+ * @param[in]  key  Keys
+ * @param[in]  n    Number of keys
+ * @param[out] rule Index of the rule of each key (-1: no match)
+ */
+void
+r2mMatchBatch (const r2mMatch *m, const u32 *key, u32 n, s32 *rule)
+{
+    const u32 *base[MATCH_LANES];
+    u32 len, half, i = 0, j;
+
+    /*
+     * The searches of MATCH_LANES keys take the same number of steps,
+     * so they go in lock step and their loads overlap.
+     */
+    for (; m->nRes == 0 && i + MATCH_LANES <= n; i += MATCH_LANES) {
+        for (j = 0; j < MATCH_LANES; ++j) {
+            base[j] = m->lo;
+        }
+        for (len = m->nIv; len > 1; len -= half) {
+            half = len / 2;
+            for (j = 0; j < MATCH_LANES; ++j) {
+                base[j] = (base[j][half] <= key[i + j]) ? base[j] + half :
+                                                          base[j];
+            }
+        }
+        for (j = 0; j < MATCH_LANES; ++j) {
+            rule[i + j] = m->res[base[j] - m->lo];
+        }
+    }
+    for (; i < n; ++i) {
+        rule[i] = lookup(m, key[i]);
+    }
+}
@@ -0,0 +1,399 @@
+/*
+ * r2m_multi.c: multi-field rules (cross product of ranges)
+ *
+ * Copyright (c) 2017, 2018, 2019, 2020, 2021 Yoichi Hariguchi
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the
+ * Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall
+ * be included in all copies or substantial portions of the
+ * Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+ */
+
+/*
+ * A key of several range fields matches a rule when every field is
+ * in its range, so a TCAM needs the cross product of the per-field
+ * entries. Field f may instead use an accept cover [L, R] of its
+ * range, L = st & ~(2^i - 1) and R = end | (2^j - 1), with reject
+ * entries for the holes [L, st-1] and [end+1, R] that wildcard the
+ * other fields. First match on the rejects followed by the product
+ * of the covers has the same meaning, and costs
+ *
+ *   sum(rejects of f) + prod(covers of f)
+ *
+ * The rejects add up, but the covers multiply, so the best choice
+ * per field is not the best per rule. For each field only the
+ * Pareto front of (accept, reject) counts over (i, j) matters; the
+ * fronts are searched exhaustively within a budget, otherwise by
+ * coordinate descent. Everything is counted in closed form
+ * (r2mCount()), so r2mMultiEstimate() never makes an entry.
+ *
+ * r2mMultiCompile() only makes the per-field entries (a sum, not a
+ * product); r2mMultiNext() streams the combined entries with an
+ * odometer.
+ */
+
+#include "range2masks.h"
+
+enum {
+    MAX_FRONT    = 33,          /* Pareto front of a 32-bit field */
+    SEARCH_LIMIT = 1 << 16,     /* combinations searched exhaustively */
+    DESCENT_MAX  = 16,          /* passes of coordinate descent */
+};
+
+typedef struct cand_ {
+    u32 L;                      /* accept cover [L, R] */
+    u32 R;
+    u32 nAcc;
+    u32 nRej;
+} cand;
+
+typedef struct choice_ {
+    u32  nFront[R2M_MAXFIELD];
+    cand front[R2M_MAXFIELD][MAX_FRONT];
+    u32  pick[R2M_MAXFIELD];    /* index into front[f] */
+    u64  cost;
+    u64  direct;                /* product of the direct counts */
+} choice;
+
+
+static inline u32
+fieldMax (u32 width)
+{
+    return (width >= 32) ? ~0U : (1U << width) - 1;
+}
+
+static int
+cmpCand (const void *a, const void *b)
+{
+    const cand *x = a, *y = b;
+
+    if (x->nAcc != y->nAcc) {
+        return (x->nAcc > y->nAcc) - (x->nAcc < y->nAcc);
+    }
+    return (x->nRej > y->nRej) - (x->nRej < y->nRej);
+}
+
+/*
+ * Pareto front of a field. front[0] is the direct decomposition
+ * (nRej == 0), the rest is sorted by nAcc (nRej decreasing).
+ */
+static u32
+frontier (const r2mField *f, cand *front)
+{
+    cand all[MAX_FRONT * MAX_FRONT];
+    u32 rL[MAX_FRONT], rR[MAX_FRONT], L[MAX_FRONT], R[MAX_FRONT];
+    u32 max = fieldMax(f->width);
+    u32 i, j, n, nf;
+    u64 low;
+
+    for (i = 0; i <= f->width; ++i) {
+        low   = (1ULL << i) - 1;
+        L[i]  = f->st & ~(u32)low;
+        rL[i] = (L[i] < f->st) ? r2mCount(L[i], f->st - 1) : 0;
+        R[i]  = (f->end | (u32)low) & max;
+        rR[i] = (R[i] > f->end) ? r2mCount(f->end + 1, R[i]) : 0;
+    }
+    n = 0;
+    for (i = 0; i <= f->width; ++i) {
+        for (j = 0; j <= f->width; ++j) {
+            all[n].L    = L[i];
+            all[n].R    = R[j];
+            all[n].nAcc = r2mCount(L[i], R[j]);
+            all[n].nRej = rL[i] + rR[j];
+            ++n;
+        }
+    }
+    qsort(all, n, sizeof(all[0]), cmpCand);
+    nf = 0;
+    for (i = 0; i < n && nf < MAX_FRONT; ++i) {
+        if (nf == 0 || all[i].nRej < front[nf - 1].nRej) {
+            front[nf++] = all[i];
+        }
+    }
+
+    /*
+     * The direct layout (the only one without rejects) is the last
+     * one of the front; make it the first.
+     */
+    if (nf > 1) {
+        cand t = front[0];
+
+        front[0]      = front[nf - 1];
+        front[nf - 1] = t;
+    }
+    return nf;
+}
+
+static u64
+costOf (const choice *c, u32 n, const u32 *pick)
+{
+    u64 rej = 0, acc = 1;
+    u32 f;
+
+    for (f = 0; f < n; ++f) {
+        rej += c->front[f][pick[f]].nRej;
+        acc *= c->front[f][pick[f]].nAcc;
+    }
+    return rej + acc;
+}
+
+/*
+ * Chooses the cover of each field. Returns FAILURE on a bad field.
+ */
+static int
+choose (const r2mField *fld, u32 n, choice *c)
+{
+    u32 pick[R2M_MAXFIELD];
+    u64 space = 1, cost;
+    u32 f, k, pass;
+    bool better;
+
+    if (n == 0 || n > R2M_MAXFIELD) {
+        return FAILURE;
+    }
+    c->direct = 1;
+    for (f = 0; f < n; ++f) {
+        if (fld[f].width == 0 || fld[f].width > 32 ||
+            fld[f].st > fld[f].end || fld[f].end > fieldMax(fld[f].width)) {
+            return FAILURE;
+        }
+        c->nFront[f] = frontier(fld + f, c->front[f]);
+        c->pick[f]   = 0;
+        c->direct   *= c->front[f][0].nAcc;
+        if (space <= SEARCH_LIMIT) {
+            space *= c->nFront[f];
+        }
+    }
+    c->cost = costOf(c, n, c->pick);
+
+    if (space <= SEARCH_LIMIT) {
+        /* odometer over all the combinations */
+        memset(pick, 0, sizeof(pick));
+        for (;;) {
+            if ((cost = costOf(c, n, pick)) < c->cost) {
+                c->cost = cost;
+                memcpy(c->pick, pick, sizeof(pick));
+            }
+            for (f = 0; f < n && ++pick[f] == c->nFront[f]; ++f) {
+                pick[f] = 0;
+            }
+            if (f == n) {
+                break;
+            }
+        }
+        return SUCCESS;
+    }
+
+    memcpy(pick, c->pick, sizeof(pick));
+    for (pass = 0; pass < DESCENT_MAX; ++pass) {
+        better = FALSE;
+        for (f = 0; f < n; ++f) {
+            for (k = 0; k < c->nFront[f]; ++k) {
+                pick[f] = k;
+                if ((cost = costOf(c, n, pick)) < c->cost) {
+                    c->cost    = cost;
+                    c->pick[f] = k;
+                    better     = TRUE;
+                }
+            }
+            pick[f] = c->pick[f];
+        }
+        if (!better) {
+            break;
+        }
+    }
+    return SUCCESS;
+}
+
+/*
+ * Appends the entries of [st, end] ('end' may be 0xffffffff) to
+ * ent[*pnEnt]; 'ent' has room for *pnEnt + MAXENT entries
+ */
+static int
+decomp (u32 st, u32 end, tcamEnt *ent, u32 *pnEnt)
+{
+    u32 n;
+    int rc;
+
+    rc = range2entsFull(st, end, ent + *pnEnt, MAXENT, &n);
+    if (rc == SUCCESS) {
+        *pnEnt += n;
+    }
+    return rc;
+}
+
+/**
+ * @name  r2mMultiEstimate
+ *
+ * @brief Counts the entries of a multi-field rule without making them
+ *
+ * @param[in]  fld      Fields
+ * @param[in]  n        Number of fields (1 ... R2M_MAXFIELD)
+ * @param[out] pnDirect Product of the direct per-field counts, i.e.
+ *                      the size without covers (may be NULL)
+ *
+ * @retval Number of entries r2mMultiCompile() makes (0: bad field)
+ */
+u64
+r2mMultiEstimate (const r2mField *fld, u32 n, u64 *pnDirect)
+{
+    choice c;
+
+    if (!fld || choose(fld, n, &c) != SUCCESS) {
+        return 0;
+    }
+    if (pnDirect) {
+        *pnDirect = c.direct;
+    }
+    return c.cost;
+}
+
+/**
+ * @name  r2mMultiCompile
+ *
+ * @brief Chooses the cover of each field and makes the per-field
+ *        entries (see r2mMultiNext() for the combined entries)
+ *
+ * @param[in]  fld Fields
+ * @param[in]  n   Number of fields (1 ... R2M_MAXFIELD)
+ * @param[in]  a   Arena for the per-field entries
+ * @param[out] m   Compiled rule
+ *
+ * @retval SUCCESS    'm' is ready
+ * @retval R2M_EINVAL NULL pointer, bad number of fields, or a field
+ *                    that is empty or wider than its width
+ * @retval R2M_EFAIL  Out of memory
+ */
+int
+r2mMultiCompile (const r2mField *fld, u32 n, r2mArena *a, r2mMulti *m)
+{
+    choice c;
+    const cand *p;
+    r2mMultiField *mf;
+    u32 f;
+    int rc;
+
+
+    if (!fld || !a || !m || choose(fld, n, &c) != SUCCESS) {
+        return R2M_EINVAL;
+    }
+    m->nField = n;
+    m->nRej   = 0;
+    m->nAcc   = 1;
+    m->direct = c.direct;
+    for (f = 0; f < n; ++f) {
+        p  = &c.front[f][c.pick[f]];
+        mf = m->f + f;
+        mf->width = fld[f].width;
+        mf->L     = p->L;
+        mf->R     = p->R;
+        mf->nRej  = 0;
+        mf->nAcc  = 0;
+        mf->rej   = r2mArenaAlloc(a, 2 * MAXENT * sizeof(tcamEnt));
+        if (mf->rej == NULL) {
+            return R2M_EFAIL;
+        }
+        if ((p->L < fld[f].st &&
+             (rc = decomp(p->L, fld[f].st - 1, mf->rej, &mf->nRej))
+             != SUCCESS) ||
+            (p->R > fld[f].end &&
+             (rc = decomp(fld[f].end + 1, p->R, mf->rej, &mf->nRej))
+             != SUCCESS)) {
+            return rc;
+        }
+        r2mArenaTrim(a, mf->rej, mf->nRej * sizeof(tcamEnt));
+        if ((mf->acc = r2mArenaAlloc(a, MAXENT * sizeof(tcamEnt))) == NULL) {
+            return R2M_EFAIL;
+        }
+        if ((rc = decomp(p->L, p->R, mf->acc, &mf->nAcc)) != SUCCESS) {
+            return rc;
+        }
+        r2mArenaTrim(a, mf->acc, mf->nAcc * sizeof(tcamEnt));
+        m->nRej += mf->nRej;
+        m->nAcc *= mf->nAcc;
+    }
+    return SUCCESS;
+}
+
+/**
+ * @name  r2mMultiIterInit
+ *
+ * @brief Starts streaming the combined entries of a compiled rule
+ *
+ * @param[out] it Iterator
+ * @param[in]  m  Compiled rule (must outlive 'it')
+ */
+void
+r2mMultiIterInit (r2mMultiIter *it, const r2mMulti *m)
+{
+    it->m     = m;
+    it->field = 0;
+    it->idx   = 0;
+    memset(it->odo, 0, sizeof(it->odo));
+}
+
+/**
+ * @name  r2mMultiNext
+ *
+ * @brief Returns the next combined entry in priority order: all the
+ *        rejects of field 0, 1, ... (other fields wildcarded), then
+ *        the product of the accept covers
+ *
+ * @param[in,out] it      Iterator
+ * @param[out]    ent     One entry per field (m->nField)
+ * @param[out]    pReject TRUE if the entry has the inverse action
+ *
+ * @retval TRUE  'ent' has an entry
+ * @retval FALSE No more entries
+ */
+bool
+r2mMultiNext (r2mMultiIter *it, tcamEnt *ent, bool *pReject)
+{
+    const r2mMulti *m = it->m;
+    u32 f;
+
+    while (it->field < m->nField && it->idx == m->f[it->field].nRej) {
+        ++it->field;
+        it->idx = 0;
+    }
+    if (it->field < m->nField) {
+        for (f = 0; f < m->nField; ++f) {
+            ent[f].patt = 0;
+            ent[f].mask = 0;
+        }
+        ent[it->field] = m->f[it->field].rej[it->idx++];
+        *pReject = TRUE;
+        return TRUE;
+    }
+    if (it->field > m->nField) {
+        return FALSE;
+    }
+    for (f = 0; f < m->nField; ++f) {
+        ent[f] = m->f[f].acc[it->odo[f]];
+    }
+    *pReject = FALSE;
+    for (f = 0; f < m->nField && ++it->odo[f] == m->f[f].nAcc; ++f) {
+        it->odo[f] = 0;
+    }
+    if (f == m->nField) {
+        ++it->field;            /* the odometer wrapped: done */
+    }
+    return TRUE;
+}
@@ -0,0 +1,257 @@
+/*
+ * r2m_opt.c: minimum first-match layout of a range
+ *
+ * Copyright (c) 2017, 2018, 2019, 2020, 2021 Yoichi Hariguchi
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the
+ * Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall
+ * be included in all copies or substantial portions of the
+ * Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+ */
+
+/*
+ * A first-match TCAM may use entries of both actions: an entry of
+ * the inverse action carves a hole into a larger entry below it
+ * (e.g. -optimize: reject [0, st-1], then accept [0, end]). Every
+ * such layout of prefixes is a set of trie nodes where a node
+ * colors its subtree unless a deeper node overrides it.
+ *
+ * Let f(v, c) be the fewest entries inside the subtree of node v
+ * that color it correctly when c (IN: the action of the range,
+ * OUT: anything else, i.e. no match) arrives from above. If v is
+ * uniform with color u, f(v, c) = (c != u). Otherwise, with the
+ * children l and r,
+ *
+ *   f(v, c) = min(f(l, c) + f(r, c), 1 + f(l, !c) + f(r, !c))
+ *
+ * where the second term places v itself with color !c. Only the
+ * nodes on the paths to 'st' and 'end' are not uniform, so the
+ * exact minimum over all the layouts costs O(W): no search (or
+ * search budget) is needed. The root gets OUT for free.
+ *
+ * A placed node must have a higher priority than the placed nodes
+ * above it, and the nodes at the same depth (number of placed
+ * ancestors) are disjoint. So the entries are written deepest
+ * first and the actions alternate by depth.
+ */
+
+#include "range2masks.h"
+
+enum {
+    OUT = 0,
+    IN  = 1,
+};
+
+typedef struct optCtx_ {
+    u64      st;
+    u64      end;
+    u32      width;
+    tcamEnt *ent;               /* result */
+    u8      *inv;
+    u8       depth[MAXENT];     /* depth of ent[i] */
+    u32      maxEnt;
+    u32      nEnt;
+    bool     full;              /* ent[] overflowed */
+} optCtx;
+
+
+/* Color of a uniform node, or -1 if [lo, lo + 2^l) is not uniform */
+static inline int
+uniform (const optCtx *x, u64 lo, int l)
+{
+    u64 hi = lo + (1ULL << l) - 1;
+
+    if (hi < x->st || lo > x->end) {
+        return OUT;
+    }
+    if (x->st <= lo && hi <= x->end) {
+        return IN;
+    }
+    return -1;
+}
+
+/* f(v, OUT) and f(v, IN) of v = [lo, lo + 2^l) */
+static void
+cost (const optCtx *x, u64 lo, int l, u32 f[2])
+{
+    u32 a[2], b[2];
+    u32 s0, s1;
+    int u;
+
+    if ((u = uniform(x, lo, l)) >= 0) {
+        f[u]  = 0;
+        f[!u] = 1;
+        return;
+    }
+    cost(x, lo, l - 1, a);
+    cost(x, lo + (1ULL << (l - 1)), l - 1, b);
+    s0 = a[OUT] + b[OUT];
+    s1 = a[IN] + b[IN];
+    f[OUT] = (s0 < 1 + s1) ? s0 : 1 + s1;
+    f[IN]  = (s1 < 1 + s0) ? s1 : 1 + s0;
+}
+
+static void
+add (optCtx *x, u64 lo, int l, int color, int depth)
+{
+    u32 wmask = (x->width == 32) ? ~0U : (1U << x->width) - 1;
+
+    if (x->nEnt == MAXENT || x->nEnt == x->maxEnt) {
+        x->full = TRUE;
+        return;
+    }
+    x->ent[x->nEnt].patt = (u32)lo;
+    x->ent[x->nEnt].mask = (u32)~((1ULL << l) - 1) & wmask;
+    x->inv[x->nEnt]      = (color == OUT);
+    x->depth[x->nEnt]    = depth;
+    ++x->nEnt;
+}
+
+/* Places the entries of v = [lo, lo + 2^l) when 'color' arrives */
+static void
+place (optCtx *x, u64 lo, int l, int color, int depth)
+{
+    u32 a[2], b[2];
+    int u;
+
+    if ((u = uniform(x, lo, l)) >= 0) {
+        if (u != color) {
+            add(x, lo, l, u, depth);
+        }
+        return;
+    }
+    cost(x, lo, l - 1, a);
+    cost(x, lo + (1ULL << (l - 1)), l - 1, b);
+    if (1 + a[!color] + b[!color] < a[color] + b[color]) {
+        color = !color;
+        add(x, lo, l, color, depth++);
+    }
+    place(x, lo, l - 1, color, depth);
+    place(x, lo + (1ULL << (l - 1)), l - 1, color, depth);
+}
+
+/**
+ * @name  r2mCountMin
+ *
+ * @brief Counts the entries of the minimum first-match layout of
+ *        [st, end] (see r2mOptimize()) without making them
+ *
+ * @param[in] width Key width W (1 ... 32)
+ * @param[in] st    Number that the range starts
+ * @param[in] end   Number that the range ends (< 2^W)
+ *
+ * @retval Number of entries (0 if the range is empty or invalid)
+ */
+u32
+r2mCountMin (u32 width, u32 st, u32 end)
+{
+    optCtx x;
+    u32 f[2];
+
+    if (width == 0 || width > 32 || st > end ||
+        (width < 32 && end >> width)) {
+        return 0;
+    }
+    x.st    = st;
+    x.end   = end;
+    x.width = width;
+    cost(&x, 0, width, f);
+    return f[OUT];
+}
+
+/**
+ * @name  r2mOptimize
+ *
+ * @brief Converts [st, end] into the fewest TCAM entries for a
+ *        first-match TCAM, using entries of both actions
+ *
+ * The result is never larger than the one of range2masks() or the
+ * -optimize layout; e.g. [1, 2^32 - 2] takes 3 entries instead of 62.
+ * The entries are in priority order (ent[0] first). inv[i] is 1 if
+ * ent[i] has the inverse action of the range. The low W bits of the
+ * entries are significant.
+ *
+ * @param[in]  width  Key width W (1 ... 32)
+ * @param[in]  st     Number that the range starts
+ * @param[in]  end    Number that the range ends (< 2^W; 2^W - 1 is
+ *                    fine)
+ * @param[out] ent    Array of (pattern, mask) receiving the result
+ * @param[out] inv    Action of each entry (0: the range's, 1: inverse)
+ * @param[in]  maxEnt Number of elements of 'ent' and 'inv'
+ * @param[out] pnEnt  Number of entries stored in 'ent'
+ *
+ * @retval SUCCESS    The range is converted (no entry if st > end)
+ * @retval R2M_EINVAL NULL pointer or 'width' is out of range
+ * @retval R2M_ERANGE 'end' does not fit in W bits
+ * @retval R2M_ENOSPC 'maxEnt' is too small
+ */
+int
+r2mOptimize (u32 width, u32 st, u32 end, tcamEnt *ent, u8 *inv,
+             u32 maxEnt, u32 *pnEnt)
+{
+    optCtx x;
+    u32 i, j, n;
+
+
+    if (!ent || !inv || !pnEnt || width == 0 || width > 32) {
+        return R2M_EINVAL;
+    }
+    *pnEnt = 0;
+    if (width < 32 && end >> width) {
+        return R2M_ERANGE;
+    }
+    if (st > end) {
+        return SUCCESS;
+    }
+    x.st     = st;
+    x.end    = end;
+    x.width  = width;
+    x.ent    = ent;
+    x.inv    = inv;
+    x.maxEnt = maxEnt;
+    x.nEnt   = 0;
+    x.full   = FALSE;
+    place(&x, 0, width, OUT, 0);
+    if (x.full) {
+        return R2M_ENOSPC;
+    }
+
+    /*
+     * Deepest first; stable within a depth. n <= MAXENT, so an
+     * insertion sort is as fast as anything else.
+     */
+    n = x.nEnt;
+    for (i = 1; i < n; ++i) {
+        tcamEnt e = ent[i];
+        u8 v = inv[i];
+        u8 d = x.depth[i];
+
+        for (j = i; j > 0 && x.depth[j - 1] < d; --j) {
+            ent[j]     = ent[j - 1];
+            inv[j]     = inv[j - 1];
+            x.depth[j] = x.depth[j - 1];
+        }
+        ent[j]     = e;
+        inv[j]     = v;
+        x.depth[j] = d;
+    }
+    *pnEnt = n;
+    return SUCCESS;
+}
@@ -0,0 +1,808 @@
+/*
+ * r2m_out.c: buffered, printf-free text output
+ *
+ * Copyright (c) 2017, 2018, 2019, 2020, 2021 Yoichi Hariguchi
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the
+ * Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall
+ * be included in all copies or substantial portions of the
+ * Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+ */
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "range2masks.h"
+#include "r2m_bits.h"
+
+enum {
+    MAX_LINE = 64,              /* longest line emitted at once */
+};
+
+static const char hexDigits[] = "0123456789abcdef";
+
+/* The binary records are written field by field; keep them packed */
+_Static_assert(sizeof(r2mBinHdr) == 16, "r2mBinHdr must be 16 bytes");
+_Static_assert(sizeof(r2mBinRule) == 16, "r2mBinRule must be 16 bytes");
+_Static_assert(sizeof(tcamEnt) == 8, "tcamEnt must be 8 bytes");
+
+
+/**
+ * @name  r2mOutInit
+ *
+ * @brief Initializes an output stage on a caller-supplied buffer
+ *
+ * @param[out] o    Output stage
+ * @param[in]  fd   File descriptor written by r2mOutFlush().
+ *                  If < 0, the output is kept in 'buf' and
+ *                  r2mOutFlush() only fails when 'buf' is full.
+ * @param[in]  buf  Buffer
+ * @param[in]  size Size of 'buf' (must be >= R2M_OUT_MINBUF)
+ *
+ * @retval SUCCESS    'o' is ready
+ * @retval R2M_EINVAL Otherwise
+ */
+int
+r2mOutInit (r2mOut *o, int fd, char *buf, size_t size)
+{
+    if (!o || !buf || size < R2M_OUT_MINBUF) {
+        return R2M_EINVAL;
+    }
+    o->fd   = fd;
+    o->buf  = buf;
+    o->len  = 0;
+    o->size = size;
+    o->err  = SUCCESS;
+    o->drain = NULL;
+    o->arg   = NULL;
+    return SUCCESS;
+}
+
+/**
+ * @name  r2mOutFlush
+ *
+ * @brief Writes the buffered output with as few write() calls as
+ *        possible (one unless interrupted or short), or hands it to
+ *        o->drain() if set
+ *
+ * @param[in] o Output stage
+ *
+ * @retval SUCCESS    The buffer is empty
+ * @retval R2M_EFAIL  write() failed (errno is set). The error
+ *                    sticks and every later output is discarded.
+ *                    An error returned by o->drain() sticks as well.
+ * @retval R2M_ENOSPC 'o' has no file descriptor and is full.
+ *                    The error sticks as well.
+ */
+int
+r2mOutFlush (r2mOut *o)
+{
+    size_t off = 0;
+    ssize_t n;
+
+    if (o->err != SUCCESS) {
+        return o->err;
+    }
+    if (o->drain) {
+        if ((o->err = o->drain(o)) == SUCCESS) {
+            o->len = 0;
+        }
+        return o->err;
+    }
+    if (o->fd < 0) {
+        if (o->size - o->len < MAX_LINE) {
+            o->err = R2M_ENOSPC;
+        }
+        return o->err;
+    }
+    while (off < o->len) {
+        n = write(o->fd, o->buf + off, o->len - off);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            o->err = R2M_EFAIL;
+            break;
+        }
+        off += n;
+    }
+    o->len = 0;
+    return o->err;
+}
+
+/*
+ * Makes sure that MAX_LINE bytes can be appended.
+ * Returns the write position, or NULL if the output is lost.
+ */
+static inline char *
+reserve (r2mOut *o)
+{
+    if (o->size - o->len < MAX_LINE && r2mOutFlush(o) != SUCCESS) {
+        return NULL;
+    }
+    return o->buf + o->len;
+}
+
+static inline char *
+putDec (char *p, u64 v)
+{
+    char tmp[20];
+    int n = 0;
+
+    do {
+        tmp[n++] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    while (n) {
+        *p++ = tmp[--n];
+    }
+    return p;
+}
+
+static inline char *
+putHex32 (char *p, u32 v)
+{
+    int i;
+
+    for (i = 28; i >= 0; i -= 4) {
+        *p++ = hexDigits[(v >> i) & 0xf];
+    }
+    return p;
+}
+
+static inline char *
+putStr (char *p, const char *s, size_t len)
+{
+    memcpy(p, s, len);
+    return p + len;
+}
+
+#define PUTLIT(_p_,_lit_) putStr((_p_), (_lit_), sizeof(_lit_) - 1)
+
+/* a.b.c.d/len */
+static inline char *
+putPrefix (char *p, u32 patt, u32 mask)
+{
+    int plen = r2mPlen32(mask);
+
+    p = putDec(p, patt >> 24);
+    *p++ = '.';
+    p = putDec(p, (patt >> 16) & 0xff);
+    *p++ = '.';
+    p = putDec(p, (patt >> 8) & 0xff);
+    *p++ = '.';
+    p = putDec(p, patt & 0xff);
+    *p++ = '/';
+    if (plen < 0) {
+        return PUTLIT(p, "-1");
+    }
+    return putDec(p, plen);
+}
+
+/**
+ * @name  r2mOutStr
+ *
+ * @brief Appends a string (of any length)
+ *
+ * @param[in] o Output stage
+ * @param[in] s String
+ */
+void
+r2mOutStr (r2mOut *o, const char *s)
+{
+    size_t len = strlen(s);
+    size_t n;
+    char *p;
+
+    while (len) {
+        if ((p = reserve(o)) == NULL) {
+            return;
+        }
+        n = o->size - o->len;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(p, s, n);
+        o->len += n;
+        s      += n;
+        len    -= n;
+    }
+}
+
+/**
+ * @name  r2mOutU32
+ *
+ * @brief Appends a decimal number
+ *
+ * @param[in] o Output stage
+ * @param[in] v Number
+ */
+void
+r2mOutU32 (r2mOut *o, u32 v)
+{
+    char *p;
+
+    if ((p = reserve(o)) != NULL) {
+        o->len = putDec(p, v) - o->buf;
+    }
+}
+
+/**
+ * @name  r2mOutU64
+ *
+ * @brief Appends a 64-bit decimal number
+ *
+ * @param[in] o Output stage
+ * @param[in] v Number
+ */
+void
+r2mOutU64 (r2mOut *o, u64 v)
+{
+    char *p;
+
+    if ((p = reserve(o)) != NULL) {
+        o->len = putDec(p, v) - o->buf;
+    }
+}
+
+/**
+ * @name  r2mOutRange
+ *
+ * @brief Appends "<label>: <st> - <end>\n"
+ *
+ * @param[in] o     Output stage
+ * @param[in] label Label (e.g. "Accept")
+ * @param[in] st    Number that the range starts
+ * @param[in] end   Number that the range ends
+ */
+void
+r2mOutRange (r2mOut *o, const char *label, u32 st, u32 end)
+{
+    char *p;
+
+    r2mOutStr(o, label);
+    if ((p = reserve(o)) == NULL) {
+        return;
+    }
+    p = PUTLIT(p, ": ");
+    p = putDec(p, st);
+    p = PUTLIT(p, " - ");
+    p = putDec(p, end);
+    *p++ = '\n';
+    o->len = p - o->buf;
+}
+
+/**
+ * @name  r2mOutPrefix
+ *
+ * @brief Appends "a.b.c.d/len\n"
+ *
+ * @param[in] o    Output stage
+ * @param[in] patt Pattern
+ * @param[in] mask Mask
+ */
+void
+r2mOutPrefix (r2mOut *o, u32 patt, u32 mask)
+{
+    char *p;
+
+    if ((p = reserve(o)) == NULL) {
+        return;
+    }
+    p = putPrefix(p, patt, mask);
+    *p++ = '\n';
+    o->len = p - o->buf;
+}
+
+/**
+ * @name  r2mOutEntry
+ *
+ * @brief Appends the verbose form of an entry:
+ *        "patt:   <hex> (<st> - <end>)\n"
+ *        "mask:   <hex>\n"
+ *        "prefix: a.b.c.d/len\n"
+ *
+ * @param[in] o    Output stage
+ * @param[in] patt Pattern
+ * @param[in] mask Mask
+ */
+void
+r2mOutEntry (r2mOut *o, u32 patt, u32 mask)
+{
+    char *p;
+
+    if ((p = reserve(o)) == NULL) {
+        return;
+    }
+    p = PUTLIT(p, "patt:   ");
+    p = putHex32(p, patt);
+    p = PUTLIT(p, " (");
+    p = putDec(p, patt);
+    p = PUTLIT(p, " - ");
+    p = putDec(p, patt | ((~patt) & (~mask)));
+    p = PUTLIT(p, ")\nmask:   ");
+    p = putHex32(p, mask);
+    *p++ = '\n';
+    o->len = p - o->buf;
+
+    if ((p = reserve(o)) == NULL) {
+        return;
+    }
+    p = PUTLIT(p, "prefix: ");
+    p = putPrefix(p, patt, mask);
+    *p++ = '\n';
+    o->len = p - o->buf;
+}
+
+/**
+ * @name  r2mOutRule
+ *
+ * @brief Appends all the entries of a rule: the prefixes, then
+ *        (if 'verbose') a blank line and the verbose form of each
+ *        entry.
+ *
+ * @param[in] o       Output stage
+ * @param[in] p       Rule
+ * @param[in] verbose Append the patt/mask section as well
+ */
+void
+r2mOutRule (r2mOut *o, const aclRule *p, bool verbose)
+{
+    u32 i;
+
+    for (i = 0; i < p->nEnt; ++i) {
+        r2mOutPrefix(o, p->ent[i].patt, p->ent[i].mask);
+    }
+    if (!verbose) {
+        return;
+    }
+    r2mOutStr(o, "\n\n");
+    for (i = 0; i < p->nEnt; ++i) {
+        r2mOutEntry(o, p->ent[i].patt, p->ent[i].mask);
+    }
+}
+
+/* "*", a.b.c.d/len (32 bits) or 0x<hex>/len */
+static inline char *
+putField (char *p, u32 patt, u32 mask, u32 width)
+{
+    u32 wmask = (width >= 32) ? ~0U : (1U << width) - 1;
+    int plen, i;
+
+    mask &= wmask;
+    if (mask == 0) {
+        *p++ = '*';
+        return p;
+    }
+    if (width >= 32) {
+        return putPrefix(p, patt, mask);
+    }
+    p = PUTLIT(p, "0x");
+    for (i = ((width + 3) / 4 - 1) * 4; i >= 0; i -= 4) {
+        *p++ = hexDigits[(patt >> i) & 0xf];
+    }
+    *p++ = '/';
+    if ((plen = r2mPlen32(mask | ~wmask)) < 0) {
+        return PUTLIT(p, "-1");
+    }
+    return putDec(p, plen - (32 - width));
+}
+
+/**
+ * @name  r2mOutMultiEnt
+ *
+ * @brief Appends "<label> <field> <field> ...\n" for a combined entry
+ *        of a multi-field rule; a wildcarded field is "*"
+ *
+ * @param[in] o     Output stage
+ * @param[in] label Label (e.g. "Accept")
+ * @param[in] m     Compiled rule
+ * @param[in] ent   One entry per field
+ */
+void
+r2mOutMultiEnt (r2mOut *o, const char *label, const r2mMulti *m,
+                const tcamEnt *ent)
+{
+    char *p;
+    u32 f;
+
+    r2mOutStr(o, label);
+    for (f = 0; f < m->nField; ++f) {
+        if ((p = reserve(o)) == NULL) {
+            return;
+        }
+        *p++ = ' ';
+        p = putField(p, ent[f].patt, ent[f].mask, m->f[f].width);
+        o->len = p - o->buf;
+    }
+    r2mOutStr(o, "\n");
+}
+
+#ifdef __SIZEOF_INT128__
+enum {
+    MAX_WIDE_LINE = 2 * 128 + 2, /* longest line of a 128-bit entry */
+};
+
+static char *
+putDec128 (char *p, r2mU128 v)
+{
+    char tmp[40];
+    int n = 0;
+
+    do {
+        tmp[n++] = '0' + (int)(v % 10);
+        v /= 10;
+    } while (v);
+    while (n) {
+        *p++ = tmp[--n];
+    }
+    return p;
+}
+
+/* 'width' / 4 hex digits */
+static char *
+putHexW (char *p, r2mU128 v, u32 width)
+{
+    int i;
+
+    for (i = (int)width - 4; i >= 0; i -= 4) {
+        *p++ = hexDigits[(int)(v >> i) & 0xf];
+    }
+    return p;
+}
+
+/* a.b.c.d/len (32 bits), IPv6/len (128 bits) or 0x<hex>/len */
+static char *
+putPrefixW (char *p, r2mU128 patt, r2mU128 mask, u32 width)
+{
+    r2mU128 hi = (width == 128) ? 0 : ~(r2mU128)0 << width;
+    char buf[INET6_ADDRSTRLEN];
+    u8 a[16];
+    int plen, i;
+
+    if (width == 32) {
+        return putPrefix(p, (u32)patt, (u32)mask);
+    }
+    if (width == 128) {
+        for (i = 15; i >= 0; --i, patt >>= 8) {
+            a[i] = (u8)patt;
+        }
+        inet_ntop(AF_INET6, a, buf, sizeof(buf));
+        p = putStr(p, buf, strlen(buf));
+    } else {
+        p = PUTLIT(p, "0x");
+        p = putHexW(p, patt, width);
+    }
+    *p++ = '/';
+    if ((plen = r2mPlen128(mask | hi)) < 0) {
+        return PUTLIT(p, "-1");
+    }
+    return putDec(p, plen - (128 - width));
+}
+
+/**
+ * @name  r2mOutRangeWide
+ *
+ * @brief r2mOutRange() for W-bit keys
+ *
+ * @param[in] o     Output stage
+ * @param[in] label Label (e.g. "Accept")
+ * @param[in] st    Number that the range starts
+ * @param[in] end   Number that the range ends
+ */
+void
+r2mOutRangeWide (r2mOut *o, const char *label, r2mU128 st, r2mU128 end)
+{
+    char line[MAX_WIDE_LINE];
+    char *p = line;
+
+    r2mOutStr(o, label);
+    p = PUTLIT(p, ": ");
+    p = putDec128(p, st);
+    p = PUTLIT(p, " - ");
+    p = putDec128(p, end);
+    *p++ = '\n';
+    *p = '\0';
+    r2mOutStr(o, line);
+}
+
+/**
+ * @name  r2mOutRuleWide
+ *
+ * @brief r2mOutRule() for W-bit entries. 32-bit entries look exactly
+ *        like the ones of r2mOutRule().
+ *
+ * @param[in] o       Output stage
+ * @param[in] width   W (8, 16, 32, 64 or 128)
+ * @param[in] ent     Entries
+ * @param[in] nEnt    Number of entries
+ * @param[in] verbose Append the patt/mask section as well
+ */
+void
+r2mOutRuleWide (r2mOut *o, u32 width, const tcamEntW *ent, u32 nEnt,
+                bool verbose)
+{
+    r2mU128 hi = (width == 128) ? 0 : ~(r2mU128)0 << width;
+    char line[MAX_WIDE_LINE];
+    char *p;
+    u32 i;
+
+    for (i = 0; i < nEnt; ++i) {
+        p = putPrefixW(line, ent[i].patt, ent[i].mask, width);
+        *p++ = '\n';
+        *p = '\0';
+        r2mOutStr(o, line);
+    }
+    if (!verbose) {
+        return;
+    }
+    r2mOutStr(o, "\n\n");
+    for (i = 0; i < nEnt; ++i) {
+        p = PUTLIT(line, "patt:   ");
+        p = putHexW(p, ent[i].patt, width);
+        p = PUTLIT(p, " (");
+        p = putDec128(p, ent[i].patt);
+        p = PUTLIT(p, " - ");
+        p = putDec128(p, ent[i].patt | (~ent[i].mask & ~hi));
+        p = PUTLIT(p, ")\nmask:   ");
+        p = putHexW(p, ent[i].mask, width);
+        *p++ = '\n';
+        *p = '\0';
+        r2mOutStr(o, line);
+        p = PUTLIT(line, "prefix: ");
+        p = putPrefixW(p, ent[i].patt, ent[i].mask, width);
+        *p++ = '\n';
+        *p = '\0';
+        r2mOutStr(o, line);
+    }
+}
+
+/**
+ * @name  r2mOutTernaryW
+ *
+ * @brief Appends an entry as a ternary string ('0', '1' or '*' per
+ *        bit, most significant first) and a newline
+ *
+ * @param[in] o     Output stage
+ * @param[in] patt  Pattern
+ * @param[in] mask  Mask (0: don't care)
+ * @param[in] width Number of bits (1 ... 128)
+ * @param[in] group Bits between '.' separators from the least
+ *                  significant bit (0: none)
+ */
+void
+r2mOutTernaryW (r2mOut *o, r2mU128 patt, r2mU128 mask, u32 width,
+                u32 group)
+{
+    char line[MAX_WIDE_LINE];
+    char *p = line;
+    int i;
+
+    for (i = (int)width - 1; i >= 0; --i) {
+        if (!((mask >> i) & 1)) {
+            *p++ = '*';
+        } else {
+            *p++ = ((patt >> i) & 1) ? '1' : '0';
+        }
+        if (group && i && i % group == 0) {
+            *p++ = '.';
+        }
+    }
+    *p++ = '\n';
+    *p = '\0';
+    r2mOutStr(o, line);
+}
+#endif /* __SIZEOF_INT128__ */
+
+static inline char *
+put32 (char *p, u32 v, int order)
+{
+    if (order == R2M_BIN_BE) {
+        p[0] = v >> 24;
+        p[1] = v >> 16;
+        p[2] = v >> 8;
+        p[3] = v;
+    } else {
+        p[0] = v;
+        p[1] = v >> 8;
+        p[2] = v >> 16;
+        p[3] = v >> 24;
+    }
+    return p + 4;
+}
+
+static inline u32
+get32 (const u8 *p, int order)
+{
+    if (order == R2M_BIN_BE) {
+        return ((u32)p[0] << 24) | ((u32)p[1] << 16) | ((u32)p[2] << 8) | p[3];
+    }
+    return ((u32)p[3] << 24) | ((u32)p[2] << 16) | ((u32)p[1] << 8) | p[0];
+}
+
+static void
+mkBinHdr (char *p, int order, u32 nRules, u32 nEnts)
+{
+    memcpy(p, R2M_BIN_MAGIC, 4);
+    p[4] = R2M_BIN_VERSION;
+    p[5] = order;
+    if (order == R2M_BIN_BE) {
+        p[6] = 0;
+        p[7] = sizeof(r2mBinHdr);
+    } else {
+        p[6] = sizeof(r2mBinHdr);
+        p[7] = 0;
+    }
+    put32(p + 8, nRules, order);
+    put32(p + 12, nEnts, order);
+}
+
+/**
+ * @name  r2mBinBegin
+ *
+ * @brief Starts binary output: appends a header whose counts are
+ *        filled in by r2mBinEnd() if the output is seekable
+ *
+ * @param[out] b     Binary output context
+ * @param[in]  o     Output stage
+ * @param[in]  order R2M_BIN_LE or R2M_BIN_BE
+ *
+ * @retval SUCCESS    The header is appended
+ * @retval R2M_EINVAL Wrong parameter
+ */
+int
+r2mBinBegin (r2mBin *b, r2mOut *o, int order)
+{
+    char *p;
+
+    if (!b || !o || (order != R2M_BIN_LE && order != R2M_BIN_BE)) {
+        return R2M_EINVAL;
+    }
+    b->o      = o;
+    b->order  = order;
+    b->nRules = 0;
+    b->nEnts  = 0;
+    b->hdrOff = (o->fd < 0) ? -1 : lseek(o->fd, 0, SEEK_CUR);
+    if (b->hdrOff >= 0) {
+        b->hdrOff += o->len;
+    }
+    if ((p = reserve(o)) == NULL) {
+        return o->err;
+    }
+    mkBinHdr(p, order, 0, 0);
+    o->len += sizeof(r2mBinHdr);
+    return SUCCESS;
+}
+
+/**
+ * @name  r2mBinPutRule
+ *
+ * @brief Appends a rule record followed by its tcamEnt records
+ *
+ * @param[in] b    Binary output context
+ * @param[in] st   Number that the range of the rule starts
+ * @param[in] end  Number that the range of the rule ends
+ * @param[in] tag  R2M_ACCEPT or R2M_REJECT
+ * @param[in] seq  Index of the rule in its input record
+ * @param[in] nSeq Number of rules of the input record
+ * @param[in] p    Entries of the rule
+ */
+void
+r2mBinPutRule (r2mBin *b, u32 st, u32 end, int tag, int seq, int nSeq,
+               const aclRule *p)
+{
+    r2mOut *o = b->o;
+    char *q;
+    u32 i;
+
+    if ((q = reserve(o)) == NULL) {
+        return;
+    }
+    q = put32(q, st, b->order);
+    q = put32(q, end, b->order);
+    q = put32(q, p->nEnt, b->order);
+    *q++ = tag;
+    *q++ = seq;
+    *q++ = nSeq;
+    *q++ = 0;
+    o->len = q - o->buf;
+    for (i = 0; i < p->nEnt; ++i) {
+        if ((q = reserve(o)) == NULL) {
+            return;
+        }
+        q = put32(q, p->ent[i].patt, b->order);
+        q = put32(q, p->ent[i].mask, b->order);
+        o->len = q - o->buf;
+    }
+    ++b->nRules;
+    b->nEnts += p->nEnt;
+}
+
+/**
+ * @name  r2mBinEnd
+ *
+ * @brief Flushes the binary output and, if the output is seekable,
+ *        writes the rule and entry counts into the header
+ *
+ * @param[in] b Binary output context
+ *
+ * @retval SUCCESS   The output is complete
+ * @retval < 0       Error code of r2mOutFlush(), or R2M_EFAIL if
+ *                   the header could not be rewritten
+ */
+int
+r2mBinEnd (r2mBin *b)
+{
+    char hdr[sizeof(r2mBinHdr)];
+    int rc;
+
+    if ((rc = r2mOutFlush(b->o)) != SUCCESS) {
+        return rc;
+    }
+    if (b->hdrOff < 0) {
+        return SUCCESS;
+    }
+    mkBinHdr(hdr, b->order, b->nRules, b->nEnts);
+    if (pwrite(b->o->fd, hdr, sizeof(hdr), b->hdrOff) != sizeof(hdr)) {
+        return R2M_EFAIL;
+    }
+    return SUCCESS;
+}
+
+/**
+ * @name  r2mBinCheck
+ *
+ * @brief Validates the header of binary output (e.g. mmap()ed)
+ *
+ * @param[in]  p     Beginning of the binary output
+ * @param[in]  len   Length of the binary output
+ * @param[out] order R2M_BIN_LE or R2M_BIN_BE (may be NULL)
+ *
+ * @retval SUCCESS    'p' starts with a valid header (and, if the
+ *                    header has counts, 'len' matches them)
+ * @retval R2M_EINVAL Otherwise
+ */
+int
+r2mBinCheck (const void *p, size_t len, u32 *order)
+{
+    const u8 *h = p;
+    u32 hdrLen, nRules, nEnts;
+
+    if (!p || len < sizeof(r2mBinHdr) ||
+        memcmp(h, R2M_BIN_MAGIC, 4) != 0 || h[4] != R2M_BIN_VERSION ||
+        (h[5] != R2M_BIN_LE && h[5] != R2M_BIN_BE)) {
+        return R2M_EINVAL;
+    }
+    hdrLen = (h[5] == R2M_BIN_BE) ? (h[6] << 8) | h[7] : (h[7] << 8) | h[6];
+    if (hdrLen != sizeof(r2mBinHdr)) {
+        return R2M_EINVAL;
+    }
+    nRules = get32(h + 8, h[5]);
+    nEnts  = get32(h + 12, h[5]);
+    if (nRules != 0 &&
+        len != sizeof(r2mBinHdr) + (u64)nRules * sizeof(r2mBinRule) +
+               (u64)nEnts * sizeof(tcamEnt)) {
+        return R2M_EINVAL;      /* truncated */
+    }
+    if (order) {
+        *order = h[5];
+    }
+    return SUCCESS;
+}
@@ -0,0 +1,355 @@
+/*
+ * r2m_pack.c: compact store of converted rules
+ *
+ * Copyright (c) 2017, 2018, 2019, 2020, 2021 Yoichi Hariguchi
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the
+ * Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall
+ * be included in all copies or substantial portions of the
+ * Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+ */
+
+/*
+ * A rule of n prefixes takes 5 + n bytes instead of the 8 * n of
+ * its tcamEnt (or the 8 * MAXENT of a result array). The entries of
+ * range2masks() are a chain from the end of the range downwards:
+ * each ends right below the one before, so the end of the range and
+ * the prefix lengths are enough:
+ *
+ *   [nEnt] [end (4 bytes)] [plen] [plen] ...       1 + 4 + nEnt bytes
+ *
+ * Other lists of prefixes (e.g. r2mOptimize()) are kept as they are:
+ *
+ *   [nEnt | RAW] ([patt (4 bytes)] [plen]) ...     1 + 5 * nEnt bytes
+ *
+ * Rules are appended to one byte array. Every INDEX_STEP-th rule's
+ * offset is kept, so r2mPackIterInit() skips at most INDEX_STEP - 1
+ * rules, reading their first byte only.
+ */
+
+#include "range2masks.h"
+#include "r2m_bits.h"
+
+enum {
+    RAW        = 0x80,          /* header: not a chain */
+    MAX_NENT   = RAW - 1,
+    INDEX_STEP = 16,
+    MIN_BYTES  = 4096,          /* initial room of the byte array */
+};
+
+struct r2mPack_ {
+    u8     *buf;
+    size_t  len;
+    size_t  size;
+    size_t *idx;                /* [n / INDEX_STEP] offset of a rule */
+    u32     nIdx;               /* room of idx[] */
+    u32     n;                  /* rules */
+    u64     nEnt;               /* entries of all the rules */
+};
+
+
+static inline void
+put32 (u8 *p, u32 v)
+{
+    memcpy(p, &v, sizeof(v));
+}
+
+static inline u32
+get32 (const u8 *p)
+{
+    u32 v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/* Bytes of the rule whose header is 'h' */
+static inline size_t
+recLen (u8 h)
+{
+    return (h & RAW) ? 1 + 5 * (size_t)(h & MAX_NENT) :
+           (h) ? 1 + 4 + (size_t)h : 1;
+}
+
+/* True if ent[] is the chain of prefixes that range2masks() makes */
+static bool
+isChain (const tcamEnt *ent, u32 n)
+{
+    u32 i, end = ent[0].patt | ~ent[0].mask;
+
+    for (i = 0; i < n; ++i) {
+        if ((ent[i].patt | ~ent[i].mask) != end ||
+            (i + 1 < n && ent[i].patt == 0)) {
+            return FALSE;
+        }
+        end = ent[i].patt - 1;
+    }
+    return TRUE;
+}
+
+/* Room for 'n' more bytes and one more index */
+static int
+reserve (r2mPack *p, size_t n)
+{
+    size_t size;
+    size_t *idx;
+    u8 *buf;
+
+    if (p->n % INDEX_STEP == 0 && p->n / INDEX_STEP == p->nIdx) {
+        u32 nIdx = (p->nIdx) ? 2 * p->nIdx : 64;
+
+        if ((idx = realloc(p->idx, nIdx * sizeof(*idx))) == NULL) {
+            return R2M_EFAIL;
+        }
+        p->idx  = idx;
+        p->nIdx = nIdx;
+    }
+    if (p->len + n <= p->size) {
+        return SUCCESS;
+    }
+    for (size = (p->size) ? p->size : MIN_BYTES; size < p->len + n; ) {
+        size *= 2;
+    }
+    if ((buf = realloc(p->buf, size)) == NULL) {
+        return R2M_EFAIL;
+    }
+    p->buf  = buf;
+    p->size = size;
+    return SUCCESS;
+}
+
+/**
+ * @name  r2mPackCreate
+ *
+ * @brief Creates an empty store
+ *
+ * @retval Pointer to the store, or NULL if out of memory
+ */
+r2mPack *
+r2mPackCreate (void)
+{
+    return calloc(1, sizeof(r2mPack));
+}
+
+/**
+ * @name  r2mPackDestroy
+ *
+ * @brief Frees a store
+ *
+ * @param[in] p Store (may be NULL)
+ */
+void
+r2mPackDestroy (r2mPack *p)
+{
+    if (p) {
+        free(p->idx);
+        free(p->buf);
+        free(p);
+    }
+}
+
+/**
+ * @name  r2mPackAdd
+ *
+ * @brief Appends the entries of a rule
+ *
+ * @param[in]  p    Store
+ * @param[in]  ent  Entries (prefixes, in the order to give back)
+ * @param[in]  nEnt Number of entries (at most 127)
+ * @param[out] pId  ID of the rule: 0, 1, 2, ... (may be NULL)
+ *
+ * @retval SUCCESS    The rule is stored
+ * @retval R2M_EINVAL A NULL pointer, too many entries, or an entry
+ *                    that is not a prefix (mask not contiguous, or
+ *                    pattern bits outside the mask)
+ * @retval R2M_EFAIL  Out of memory. The store is unchanged.
+ */
+int
+r2mPackAdd (r2mPack *p, const tcamEnt *ent, u32 nEnt, u32 *pId)
+{
+    bool chain;
+    u8 *q;
+    u32 i;
+    int rc;
+
+    if (!p || (nEnt && !ent) || nEnt > MAX_NENT) {
+        return R2M_EINVAL;
+    }
+    for (i = 0; i < nEnt; ++i) {
+        if (!r2mIsContig32(ent[i].mask) || (ent[i].patt & ~ent[i].mask)) {
+            return R2M_EINVAL;
+        }
+    }
+    chain = (nEnt == 0 || isChain(ent, nEnt));
+    if ((rc = reserve(p, recLen((chain) ? nEnt : nEnt | RAW))) != SUCCESS) {
+        return rc;
+    }
+    if (p->n % INDEX_STEP == 0) {
+        p->idx[p->n / INDEX_STEP] = p->len;
+    }
+
+    q = p->buf + p->len;
+    if (chain) {
+        *q++ = nEnt;
+        if (nEnt) {
+            put32(q, ent[0].patt | ~ent[0].mask);
+            q += 4;
+        }
+        for (i = 0; i < nEnt; ++i) {
+            *q++ = r2mPlen32(ent[i].mask);
+        }
+    } else {
+        *q++ = nEnt | RAW;
+        for (i = 0; i < nEnt; ++i) {
+            put32(q, ent[i].patt);
+            q[4] = r2mPlen32(ent[i].mask);
+            q += 5;
+        }
+    }
+    p->len   = q - p->buf;
+    p->nEnt += nEnt;
+    if (pId) {
+        *pId = p->n;
+    }
+    ++p->n;
+    return SUCCESS;
+}
+
+/**
+ * @name  r2mPackSize
+ *
+ * @brief Returns the memory used by a store
+ *
+ * @param[in]  p     Store
+ * @param[out] pn    Number of rules (may be NULL)
+ * @param[out] pnEnt Number of entries of all the rules (may be NULL)
+ *
+ * @retval Bytes of the encoded rules and of the index
+ */
+size_t
+r2mPackSize (const r2mPack *p, u32 *pn, u64 *pnEnt)
+{
+    if (pn) {
+        *pn = p->n;
+    }
+    if (pnEnt) {
+        *pnEnt = p->nEnt;
+    }
+    return p->len + ((p->n + INDEX_STEP - 1) / INDEX_STEP) * sizeof(*p->idx);
+}
+
+/**
+ * @name  r2mPackIterInit
+ *
+ * @brief Starts decoding the entries of a rule
+ *
+ * @param[out] it Iterator (valid until the next r2mPackAdd())
+ * @param[in]  p  Store
+ * @param[in]  id ID of the rule
+ *
+ * @retval SUCCESS    'it' is ready for r2mPackNext()
+ * @retval R2M_EINVAL A NULL pointer, or no such rule
+ */
+int
+r2mPackIterInit (r2mPackIter *it, const r2mPack *p, u32 id)
+{
+    const u8 *q;
+    u32 i;
+
+    if (!it || !p || id >= p->n) {
+        return R2M_EINVAL;
+    }
+    q = p->buf + p->idx[id / INDEX_STEP];
+    for (i = id % INDEX_STEP; i; --i) {
+        q += recLen(*q);
+    }
+    it->nEnt = *q & MAX_NENT;
+    it->raw  = (*q & RAW) != 0;
+    it->i    = 0;
+    it->end  = (!it->raw && it->nEnt) ? get32(q + 1) : 0;
+    it->p    = q + ((it->raw || it->nEnt == 0) ? 1 : 5);
+    return SUCCESS;
+}
+
+/**
+ * @name  r2mPackNext
+ *
+ * @brief Decodes the next entry of a rule
+ *
+ * @param[in,out] it  Iterator
+ * @param[out]    ent Entry
+ *
+ * @retval TRUE  'ent' is set
+ * @retval FALSE No more entries
+ */
+bool
+r2mPackNext (r2mPackIter *it, tcamEnt *ent)
+{
+    if (it->i >= it->nEnt) {
+        return FALSE;
+    }
+    ++it->i;
+    if (it->raw) {
+        ent->patt = get32(it->p);
+        ent->mask = r2mPlen2Mask32(it->p[4]);
+        it->p += 5;
+        return TRUE;
+    }
+    ent->mask = r2mPlen2Mask32(*it->p++);
+    ent->patt = it->end & ent->mask;
+    it->end   = ent->patt - 1;
+    return TRUE;
+}
+
+/**
+ * @name  r2mPackGet
+ *
+ * @brief Decodes all the entries of a rule
+ *
+ * @param[in]  p      Store
+ * @param[in]  id     ID of the rule
+ * @param[out] ent    Array receiving the entries
+ * @param[in]  maxEnt Number of elements of 'ent'
+ * @param[out] pnEnt  Number of entries of the rule
+ *
+ * @retval SUCCESS    The entries are stored
+ * @retval R2M_EINVAL A NULL pointer, or no such rule
+ * @retval R2M_ENOSPC 'maxEnt' is too small (the first 'maxEnt'
+ *                    entries are stored)
+ */
+int
+r2mPackGet (const r2mPack *p, u32 id, tcamEnt *ent, u32 maxEnt, u32 *pnEnt)
+{
+    r2mPackIter it;
+    u32 n = 0;
+    int rc;
+
+    if (!ent || !pnEnt) {
+        return R2M_EINVAL;
+    }
+    if ((rc = r2mPackIterInit(&it, p, id)) != SUCCESS) {
+        return rc;
+    }
+    *pnEnt = it.nEnt;
+    while (n < maxEnt && r2mPackNext(&it, ent + n)) {
+        ++n;
+    }
+    return (n < it.nEnt) ? R2M_ENOSPC : SUCCESS;
+}
@@ -0,0 +1,281 @@
+/*
+ * r2m_parse.c: single pass number/IPv4 address tokenizer
+ *
+ * Copyright (c) 2017, 2018, 2019, 2020, 2021 Yoichi Hariguchi
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the
+ * Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall
+ * be included in all copies or substantial portions of the
+ * Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+ */
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "range2masks.h"
+
+
+static inline bool
+isDigit (char c)
+{
+    return (u8)(c - '0') < 10;
+}
+
+static inline int
+hexVal (char c)
+{
+    if (isDigit(c)) {
+        return c - '0';
+    }
+    c |= 0x20;                  /* to lower case */
+    if ((u8)(c - 'a') < 6) {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+/*
+ * Parses up to 'maxOctets' dot separated decimal octets.
+ * Returns the number of octets parsed, or -1 on a format error.
+ */
+static int
+parseOctets (const char *s, const char *end, u32 *val, int maxOctets)
+{
+    u32 addr = 0;
+    u32 oct;
+    int nOct = 0;
+    int nDig;
+
+    for (;;) {
+        oct  = 0;
+        nDig = 0;
+        while (s < end && isDigit(*s)) {
+            if (nDig > 0 && oct == 0) {
+                return -1;      /* leading 0 (inet_pton rejects it too) */
+            }
+            oct = oct * 10 + (*s++ - '0');
+            if (++nDig > 3 || oct > 255) {
+                return -1;
+            }
+        }
+        if (nDig == 0 || nOct == maxOctets) {
+            return -1;
+        }
+        addr = (addr << 8) | oct;
+        ++nOct;
+        if (s == end) {
+            break;
+        }
+        if (*s++ != '.') {
+            return -1;
+        }
+    }
+    *val = addr;
+    return nOct;
+}
+
+/**
+ * @name  r2mParseNum
+ *
+ * @brief Classifies and converts a decimal number, a hexadecimal
+ *        number ("0x" prefix) or an IPv4 address in a single pass
+ *
+ * The token does not have to be NUL terminated; all of its 'len'
+ * bytes must be consumed. Unlike strtoul(..., 0), a leading "0" does
+ * not mean octal and hexadecimal digits require the "0x" prefix.
+ *
+ * With R2M_PARSE_ADDR in 'flags', every token without "0x" is an
+ * IPv4 address whose missing trailing octets are 0, e.g. "10" is
+ * 10.0.0.0 and "172.16" is 172.16.0.0. Otherwise a dot-less token
+ * of digits is a decimal number and an address needs all 4 octets.
+ *
+ * @param[in]  s     Token
+ * @param[in]  len   Length of the token
+ * @param[in]  flags 0 or R2M_PARSE_ADDR
+ * @param[out] val   Pointer to the converted value
+ * @param[out] kind  Pointer to the token type (may be NULL)
+ *
+ * @retval SUCCESS    '*val' and '*kind' are set
+ * @retval R2M_EINVAL 's' or 'val' is NULL
+ * @retval R2M_ERANGE The number does not fit in 32 bits
+ * @retval FAILURE    's' is neither a number nor an IPv4 address
+ */
+int
+r2mParseNum (const char *s, size_t len, u32 flags, u32 *val, r2mTok *kind)
+{
+    const char *end;
+    u64 v;
+    int d;
+    int n;
+
+
+    if (!s || !val) {
+        return R2M_EINVAL;
+    }
+    end = s + len;
+    if (len > 2 && s[0] == '0' && (s[1] | 0x20) == 'x') {
+        v = 0;
+        for (s += 2; s < end; ++s) {
+            if ((d = hexVal(*s)) < 0) {
+                return FAILURE;
+            }
+            v = (v << 4) | d;
+            if (v > 0xffffffffULL) {
+                return R2M_ERANGE;
+            }
+        }
+        *val = v;
+        if (kind) {
+            *kind = R2M_TOK_HEX;
+        }
+        return SUCCESS;
+    }
+    if (len == 0) {
+        return FAILURE;
+    }
+    if (flags & R2M_PARSE_ADDR) {
+        if ((n = parseOctets(s, end, val, 4)) < 0) {
+            return FAILURE;
+        }
+        *val <<= 8 * (4 - n);
+        if (kind) {
+            *kind = R2M_TOK_IPV4;
+        }
+        return SUCCESS;
+    }
+
+    /*
+     * Decimal number unless a '.' shows up; then restart as IPv4.
+     */
+    v = 0;
+    for (; s < end && isDigit(*s); ++s) {
+        v = v * 10 + (*s - '0');
+        if (v > 0xffffffffULL) {
+            /* too long for an octet as well */
+            return R2M_ERANGE;
+        }
+    }
+    if (s == end) {
+        *val = v;
+        if (kind) {
+            *kind = R2M_TOK_DEC;
+        }
+        return SUCCESS;
+    }
+    if (*s != '.') {
+        return FAILURE;
+    }
+    if (parseOctets(end - len, end, val, 4) != 4) {
+        return FAILURE;
+    }
+    if (kind) {
+        *kind = R2M_TOK_IPV4;
+    }
+    return SUCCESS;
+}
+
+#ifdef __SIZEOF_INT128__
+/**
+ * @name  r2mParseWide
+ *
+ * @brief r2mParseNum() for W-bit keys: a decimal or hexadecimal
+ *        ("0x" prefix) number of up to W bits, an IPv4 address if W
+ *        is 32 and an IPv6 address if W is 128
+ *
+ * @param[in]  s     Token (need not be NUL terminated)
+ * @param[in]  len   Length of the token
+ * @param[in]  flags 0 or R2M_PARSE_ADDR (IPv4 addresses, see
+ *                   r2mParseNum())
+ * @param[in]  width W (1 ... 128)
+ * @param[out] val   Pointer to the converted value
+ *
+ * @retval SUCCESS    '*val' is set
+ * @retval R2M_EINVAL 's' or 'val' is NULL, or 'width' is out of range
+ * @retval R2M_ERANGE The number does not fit in W bits
+ * @retval FAILURE    's' is not a number or an address
+ */
+int
+r2mParseWide (const char *s, size_t len, u32 flags, u32 width,
+              r2mU128 *val)
+{
+    const char *end;
+    r2mU128 max, v;
+    char buf[INET6_ADDRSTRLEN];
+    u8 a[16];
+    u32 v32;
+    int d, i, rc;
+
+
+    if (!s || !val || width == 0 || width > 128) {
+        return R2M_EINVAL;
+    }
+    if (width == 32) {
+        if ((rc = r2mParseNum(s, len, flags, &v32, NULL)) == SUCCESS) {
+            *val = v32;
+        }
+        return rc;
+    }
+    if (width == 128 && memchr(s, ':', len)) {
+        if (len >= sizeof(buf)) {
+            return FAILURE;
+        }
+        memcpy(buf, s, len);
+        buf[len] = '\0';
+        if (inet_pton(AF_INET6, buf, a) != 1) {
+            return FAILURE;
+        }
+        for (v = 0, i = 0; i < 16; ++i) {
+            v = (v << 8) | a[i];
+        }
+        *val = v;
+        return SUCCESS;
+    }
+
+    max = (width == 128) ? ~(r2mU128)0 : ((r2mU128)1 << width) - 1;
+    end = s + len;
+    v   = 0;
+    if (len > 2 && s[0] == '0' && (s[1] | 0x20) == 'x') {
+        for (s += 2; s < end; ++s) {
+            if ((d = hexVal(*s)) < 0) {
+                return FAILURE;
+            }
+            if (v > (max >> 4)) {
+                return R2M_ERANGE;
+            }
+            v = (v << 4) | d;
+        }
+    } else {
+        if (len == 0) {
+            return FAILURE;
+        }
+        for (; s < end; ++s) {
+            if (!isDigit(*s)) {
+                return FAILURE;
+            }
+            d = *s - '0';
+            if (v > (max - d) / 10) {
+                return R2M_ERANGE;
+            }
+            v = v * 10 + d;
+        }
+    }
+    *val = v;
+    return SUCCESS;
+}
+#endif /* __SIZEOF_INT128__ */
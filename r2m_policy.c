@@ -0,0 +1,211 @@
+/*
+ * r2m_policy.c: compaction of a set of prioritized ranges
+ *
+ * Copyright (c) 2017, 2018, 2019, 2020, 2021 Yoichi Hariguchi
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the
+ * Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall
+ * be included in all copies or substantial portions of the
+ * Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+ */
+
+/*
+ * r2mCompact() turns a first-match list of (range, action, priority)
+ * items into disjoint maximal intervals with the same meaning:
+ *
+ *  1. Every item start and end + 1 is a boundary; between two
+ *     consecutive boundaries the set of covering items is constant.
+ *  2. Sweeping the boundaries in order, the items that start are
+ *     pushed into a heap ordered by (priority, index); the heap top
+ *     is dropped while it has already ended. The top decides the
+ *     action of the segment (no top: no match).
+ *  3. A segment that continues the previous output interval with the
+ *     same action is merged into it.
+ *
+ * This takes O(n log n) and the output has at most 2n - 1 intervals.
+ * The intervals never overlap, so their order does not matter any
+ * more and each one decomposes independently.
+ */
+
+#include "range2masks.h"
+
+typedef struct compactCtx_ {
+    const r2mItem *in;
+    u32 *heap;                  /* indices into in[] */
+    u32  nHeap;
+} compactCtx;
+
+
+/* TRUE if in[a] wins over in[b] */
+static inline bool
+wins (const r2mItem *in, u32 a, u32 b)
+{
+    return (in[a].prio != in[b].prio) ? in[a].prio < in[b].prio : a < b;
+}
+
+static void
+heapPush (compactCtx *x, u32 i)
+{
+    u32 k = x->nHeap++;
+
+    while (k > 0 && wins(x->in, i, x->heap[(k - 1) / 2])) {
+        x->heap[k] = x->heap[(k - 1) / 2];
+        k = (k - 1) / 2;
+    }
+    x->heap[k] = i;
+}
+
+static void
+heapPop (compactCtx *x)
+{
+    u32 i = x->heap[--x->nHeap];
+    u32 k = 0, c;
+
+    for (;;) {
+        c = 2 * k + 1;
+        if (c >= x->nHeap) {
+            break;
+        }
+        if (c + 1 < x->nHeap && wins(x->in, x->heap[c + 1], x->heap[c])) {
+            ++c;
+        }
+        if (!wins(x->in, x->heap[c], i)) {
+            break;
+        }
+        x->heap[k] = x->heap[c];
+        k = c;
+    }
+    x->heap[k] = i;
+}
+
+static int
+cmpU64 (const void *a, const void *b)
+{
+    u64 v1 = *(const u64 *)a;
+    u64 v2 = *(const u64 *)b;
+
+    return (v1 > v2) - (v1 < v2);
+}
+
+/**
+ * @name  r2mCompact
+ *
+ * @brief Merges a first-match list of ranges into disjoint maximal
+ *        intervals of the same meaning
+ *
+ * Where items overlap, the one with the smallest 'prio' wins (the
+ * earlier one on a tie), like the first match of a TCAM whose entries
+ * are sorted by 'prio'. Empty items (st > end) are ignored. Adjacent
+ * intervals of the same action are coalesced. The output is sorted by
+ * 'st'; its 'prio' is the one of the first item that contributed.
+ *
+ * @param[in]  in     Items
+ * @param[in]  n      Number of items
+ * @param[out] out    Disjoint intervals (2n - 1 are always enough)
+ * @param[in]  maxOut Number of elements of 'out'
+ * @param[out] pnOut  Number of intervals stored in 'out'
+ *
+ * @retval SUCCESS    'out' has the intervals
+ * @retval R2M_EINVAL NULL pointer
+ * @retval R2M_ENOSPC 'maxOut' is too small
+ * @retval R2M_EFAIL  Out of memory
+ */
+int
+r2mCompact (const r2mItem *in, u32 n, r2mItem *out, u32 maxOut,
+            u32 *pnOut)
+{
+    compactCtx x;
+    u64 *order;                 /* st << 32 | index, sorted */
+    u64 *bound;
+    u64 lo, hi;
+    u32 i, k, nb, nOut;
+    r2mItem *last;
+    int rc = SUCCESS;
+
+
+    if (!in || !out || !pnOut) {
+        return R2M_EINVAL;
+    }
+    *pnOut = 0;
+    order  = malloc((size_t)n * sizeof(*order));
+    bound  = malloc((size_t)n * 2 * sizeof(*bound));
+    x.heap = malloc((size_t)n * sizeof(*x.heap));
+    if (n && (!order || !bound || !x.heap)) {
+        rc = R2M_EFAIL;
+        goto done;
+    }
+    x.in    = in;
+    x.nHeap = 0;
+
+    nb = 0;
+    k  = 0;
+    for (i = 0; i < n; ++i) {
+        if (in[i].st > in[i].end) {
+            continue;
+        }
+        order[k++]  = (u64)in[i].st << 32 | i;
+        bound[nb++] = in[i].st;
+        bound[nb++] = (u64)in[i].end + 1;
+    }
+    n = k;
+    qsort(order, n, sizeof(*order), cmpU64);
+    qsort(bound, nb, sizeof(*bound), cmpU64);
+
+    nOut = 0;
+    last = NULL;
+    for (i = 0, k = 0; i < nb; ++i) {
+        lo = bound[i];
+        if (i + 1 < nb && bound[i + 1] == lo) {
+            continue;           /* duplicate boundary */
+        }
+        while (k < n && (order[k] >> 32) == lo) {
+            heapPush(&x, (u32)order[k++]);
+        }
+        while (x.nHeap && in[x.heap[0]].end < lo) {
+            heapPop(&x);
+        }
+        if (x.nHeap == 0 || i + 1 == nb) {
+            last = NULL;        /* no match up to the next boundary */
+            continue;
+        }
+        hi = bound[i + 1] - 1;
+        if (last && last->act == in[x.heap[0]].act &&
+            (u64)last->end + 1 == lo) {
+            last->end = hi;
+            continue;
+        }
+        if (nOut == maxOut) {
+            rc = R2M_ENOSPC;
+            break;
+        }
+        last = out + nOut++;
+        last->st   = lo;
+        last->end  = hi;
+        last->act  = in[x.heap[0]].act;
+        last->prio = in[x.heap[0]].prio;
+    }
+    *pnOut = nOut;
+
+done:
+    free(order);
+    free(bound);
+    free(x.heap);
+    return rc;
+}
@@ -0,0 +1,211 @@
+/*
+ * r2m_port.c: table driven engine for 16-bit (L4 port) ranges
+ *
+ * Copyright (c) 2017, 2018, 2019, 2020, 2021 Yoichi Hariguchi
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the
+ * Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall
+ * be included in all copies or substantial portions of the
+ * Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+ */
+
+/*
+ * For every x in [0, 0xffff] two decompositions are precomputed:
+ *
+ *   pre[x] = [0, x]
+ *   suf[x] = [x, 0xffff]
+ *
+ * Let h be the highest bit where 'st' and 'end' differ and
+ * low = 2^h - 1. [st, end] is split at bit h into
+ *
+ *   [end & ~low, end]: pre[end & low], upper bits taken from 'end'
+ *   [st, st | low]:    suf[st | ~low], upper bits taken from 'st'
+ *
+ * (suf[st | ~low] only has blocks of up to 2^h entries that lie in
+ * the low h bits, so replacing the upper bits is enough.)
+ * Both tables are stored back to back, 16-bit pattern and mask per
+ * entry, and indexed by per-value offsets. Each holds
+ * sum(popcount(1 ... 2^16)) = 524289 entries: about 4.5MB in total.
+ */
+
+#include "range2masks.h"
+
+enum {
+    PORT_MAX   = 0xffff,
+    PORT_NVALS = PORT_MAX + 1,
+    PORT_NENTS = 524289,        /* entries per table */
+};
+
+typedef struct ent16_ {
+    u16 patt;
+    u16 mask;
+} ent16;
+
+struct r2mPortTbl_ {
+    u32   preOff[PORT_NVALS + 1]; /* pre[x]: ents[preOff[x]...] */
+    u32   sufOff[PORT_NVALS + 1]; /* suf[x]: ents[sufOff[x]...] */
+    ent16 ents[2 * PORT_NENTS];
+};
+
+
+static u32
+fillTbl (ent16 *dst, u32 *off, u32 base, bool suffix)
+{
+    tcamEnt ent[2 * 16];
+    u32 n, i, x;
+
+    for (x = 0; x < PORT_NVALS; ++x) {
+        off[x] = base;
+        if (suffix) {
+            range2entsClz(x, PORT_MAX, ent, elementsOf(ent), &n);
+        } else {
+            range2entsClz(0, x, ent, elementsOf(ent), &n);
+        }
+        for (i = 0; i < n; ++i) {
+            dst[base + i].patt = ent[i].patt;
+            dst[base + i].mask = ent[i].mask;
+        }
+        base += n;
+    }
+    off[x] = base;
+    return base;
+}
+
+/**
+ * @name  r2mPortTblCreate
+ *
+ * @brief Allocates and fills the tables of range2entsPort()
+ *
+ * @retval Pointer to the tables, or NULL if out of memory
+ */
+r2mPortTbl *
+r2mPortTblCreate (void)
+{
+    r2mPortTbl *t;
+    u32 n;
+
+    if ((t = malloc(sizeof(*t))) == NULL) {
+        return NULL;
+    }
+    n = fillTbl(t->ents, t->preOff, 0, FALSE);
+    n = fillTbl(t->ents, t->sufOff, n, TRUE);
+    assert(n == elementsOf(t->ents));
+    return t;
+}
+
+/**
+ * @name  r2mPortTblDestroy
+ *
+ * @brief Frees the tables made by r2mPortTblCreate()
+ *
+ * @param[in] t Tables (may be NULL)
+ */
+void
+r2mPortTblDestroy (r2mPortTbl *t)
+{
+    free(t);
+}
+
+/**
+ * @name  r2mPortTblSize
+ *
+ * @brief Returns the memory footprint of the tables
+ *
+ * @retval Size of the tables in bytes
+ */
+size_t
+r2mPortTblSize (void)
+{
+    return sizeof(r2mPortTbl);
+}
+
+/**
+ * @name  range2entsPort
+ *
+ * @brief Same as range2ents() but a 16-bit range is converted with
+ *        two table lookups and two copies. Ranges beyond 0xffff are
+ *        handed to range2entsClz().
+ *
+ * @param[in]  t      Tables made by r2mPortTblCreate()
+ * @param[in]  st     Number that the range starts
+ * @param[in]  end    Number that the range ends
+ * @param[out] ent    Array of (pattern, mask) receiving the result
+ * @param[in]  maxEnt Number of elements of 'ent'
+ * @param[out] pnEnt  Number of entries stored in 'ent'
+ *
+ * @retval See range2ents()
+ */
+int
+range2entsPort (const r2mPortTbl *t, u32 st, u32 end,
+                tcamEnt *ent, u32 maxEnt, u32 *pnEnt)
+{
+    const ent16 *pre, *suf;
+    u32 nPre, nSuf;
+    u32 low, hi;
+    u32 i, n;
+
+
+    if (!t || !ent || !pnEnt) {
+        return R2M_EINVAL;
+    }
+    if (end > PORT_MAX) {
+        return range2entsClz(st, end, ent, maxEnt, pnEnt);
+    }
+    *pnEnt = 0;
+    if (st > end) {
+        return SUCCESS;
+    }
+    if (maxEnt == 0) {
+        return R2M_ENOSPC;
+    }
+    if (st == end) {
+        ent[0].patt = st;
+        ent[0].mask = ~0;
+        *pnEnt = 1;
+        return SUCCESS;
+    }
+
+    low = (1U << (31 - __builtin_clz(st ^ end))) - 1;
+    if ((st & low) == 0 && (end & low) == low) {
+        ent[0].patt = st & ~(2 * low + 1);      /* aligned 2^(h+1) */
+        ent[0].mask = ~(2 * low + 1);
+        *pnEnt = 1;
+        return SUCCESS;
+    }
+    pre  = t->ents + t->preOff[end & low];
+    nPre = t->preOff[(end & low) + 1] - t->preOff[end & low];
+    suf  = t->ents + t->sufOff[(st | ~low) & PORT_MAX];
+    nSuf = t->sufOff[((st | ~low) & PORT_MAX) + 1] -
+           t->sufOff[(st | ~low) & PORT_MAX];
+
+    n  = 0;
+    hi = end & ~low;
+    for (i = 0; i < nPre && n < maxEnt; ++i, ++n) {
+        ent[n].patt = pre[i].patt | hi;
+        ent[n].mask = pre[i].mask | ~PORT_MAX;
+    }
+    hi = st & ~low;
+    for (i = 0; i < nSuf && n < maxEnt; ++i, ++n) {
+        ent[n].patt = (suf[i].patt & low) | hi;
+        ent[n].mask = suf[i].mask | ~PORT_MAX;
+    }
+    *pnEnt = n;
+    return (n < nPre + nSuf) ? R2M_ENOSPC : SUCCESS;
+}
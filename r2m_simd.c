@@ -0,0 +1,338 @@
+/*
+ * r2m_simd.c: batch decomposition in SIMD lanes (AVX2/AVX-512)
+ *
+ * Copyright (c) 2017, 2018, 2019, 2020, 2021 Yoichi Hariguchi
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the
+ * Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall
+ * be included in all copies or substantial portions of the
+ * Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+ */
+
+/*
+ * Each lane runs the closed-form step of range2entsClz() on its own
+ * range: the block ending at 'end' is min(lowbit(end + 1),
+ * pow2floor(end - st + 1)), found with add/and/shift/min only, so 8
+ * (AVX2) or 16 (AVX-512) ranges advance per step. A lane drops out
+ * when its block reaches 'st'. Results go to a structure of arrays:
+ * the entries of range i are patt/mask[i * stride ...].
+ *
+ * Ranges the lanes cannot express (end == 0xffffffff) and the tail
+ * of the batch go through the scalar path.
+ */
+
+#include "range2masks.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+# define R2M_X86 1
+# include <immintrin.h>
+#endif /* __x86_64__ || __i386__ */
+
+
+/*
+ * Scalar path: range2entsClz() writing into the SoA
+ */
+static int
+soaScalar (u32 st, u32 end, r2mSoa *o, u32 i)
+{
+    u32 *patt = o->patt + (size_t)i * o->stride;
+    u32 *mask = o->mask + (size_t)i * o->stride;
+    u32 size1;
+    int k, kmax;
+    u32 n;
+
+    o->count[i] = 0;
+    if (end == ~0 && st != 0) {
+        return R2M_ERANGE;
+    }
+    if (st > end) {
+        return SUCCESS;
+    }
+    for (n = 0; ; ++n) {
+        if (n >= o->stride) {
+            o->count[i] = n;
+            return R2M_ENOSPC;
+        }
+        size1 = end - st;
+        if (size1 == ~0) {
+            patt[n] = 0;
+            mask[n] = 0;
+            break;
+        }
+        k    = (~end) ? __builtin_ctz(~end) : 32;
+        kmax = 31 - __builtin_clz(size1 + 1);
+        if (k > kmax) {
+            k = kmax;
+        }
+        mask[n] = ~0U << k;
+        patt[n] = end & mask[n];
+        if (patt[n] == st) {
+            break;
+        }
+        end = patt[n] - 1;
+    }
+    o->count[i] = n + 1;
+    return SUCCESS;
+}
+
+/*
+ * Sets up a block of lanes: ranges the vector code can't do are done
+ * here. Returns the bitmap of the lanes left to the vector code.
+ */
+static u32
+laneSetup (const u32 *st, const u32 *end, r2mSoa *o, u32 base, u32 nLanes,
+           int *rc)
+{
+    u32 act = 0;
+    u32 l;
+
+    for (l = 0; l < nLanes; ++l) {
+        o->count[base + l] = 0;
+        if (end[base + l] == ~0 || o->stride == 0) {
+            rc[l] = soaScalar(st[base + l], end[base + l], o, base + l);
+        } else if (st[base + l] <= end[base + l]) {
+            act  |= 1U << l;
+            rc[l] = SUCCESS;
+        } else {
+            rc[l] = SUCCESS;
+        }
+    }
+    return act;
+}
+
+#ifdef R2M_X86
+
+__attribute__((target("avx2")))
+static void
+blockAvx2 (const u32 *st, const u32 *end, r2mSoa *o, u32 base, int *rc)
+{
+    const __m256i one  = _mm256_set1_epi32(1);
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i vst, vend, v, size, patt, mask, done;
+    u32 tp[8], tm[8], cnt[8] = { 0 };
+    u32 act, l, fin;
+
+    act  = laneSetup(st, end, o, base, 8, rc);
+    vst  = _mm256_loadu_si256((const __m256i *)(st + base));
+    vend = _mm256_loadu_si256((const __m256i *)(end + base));
+    while (act) {
+        /* pow2floor(end - st + 1) */
+        v = _mm256_add_epi32(_mm256_sub_epi32(vend, vst), one);
+        v = _mm256_or_si256(v, _mm256_srli_epi32(v, 1));
+        v = _mm256_or_si256(v, _mm256_srli_epi32(v, 2));
+        v = _mm256_or_si256(v, _mm256_srli_epi32(v, 4));
+        v = _mm256_or_si256(v, _mm256_srli_epi32(v, 8));
+        v = _mm256_or_si256(v, _mm256_srli_epi32(v, 16));
+        v = _mm256_add_epi32(_mm256_srli_epi32(v, 1), one);
+        /* min with lowbit(end + 1) */
+        size = _mm256_add_epi32(vend, one);
+        size = _mm256_and_si256(size, _mm256_sub_epi32(zero, size));
+        size = _mm256_min_epu32(size, v);
+
+        patt = _mm256_add_epi32(_mm256_sub_epi32(vend, size), one);
+        mask = _mm256_sub_epi32(zero, size);
+        done = _mm256_cmpeq_epi32(patt, vst);
+        vend = _mm256_sub_epi32(patt, one);
+
+        _mm256_storeu_si256((__m256i *)tp, patt);
+        _mm256_storeu_si256((__m256i *)tm, mask);
+        fin = _mm256_movemask_ps(_mm256_castsi256_ps(done));
+        for (l = 0; l < 8; ++l) {
+            if (!(act & (1U << l))) {
+                continue;
+            }
+            if (cnt[l] == o->stride) {
+                rc[l] = R2M_ENOSPC;
+                act &= ~(1U << l);
+                continue;
+            }
+            o->patt[(size_t)(base + l) * o->stride + cnt[l]] = tp[l];
+            o->mask[(size_t)(base + l) * o->stride + cnt[l]] = tm[l];
+            ++cnt[l];
+        }
+        act &= ~fin;
+    }
+    for (l = 0; l < 8; ++l) {
+        if (cnt[l]) {
+            o->count[base + l] = cnt[l];
+        }
+    }
+}
+
+__attribute__((target("avx512f")))
+static void
+blockAvx512 (const u32 *st, const u32 *end, r2mSoa *o, u32 base, int *rc)
+{
+    const __m512i one  = _mm512_set1_epi32(1);
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i lane = _mm512_set_epi32(15, 14, 13, 12, 11, 10, 9, 8,
+                                          7, 6, 5, 4, 3, 2, 1, 0);
+    const __m512i vstride = _mm512_set1_epi32(o->stride);
+    const __m512i laneOff = _mm512_mullo_epi32(lane, vstride);
+    __m512i vst, vend, v, size, patt, mask, cnt, idx;
+    u32 *pBase = o->patt + (size_t)base * o->stride;
+    u32 *mBase = o->mask + (size_t)base * o->stride;
+    __mmask16 act, full, fin;
+    u32 tc[16];
+    u32 l;
+
+    act  = laneSetup(st, end, o, base, 16, rc);
+    vst  = _mm512_loadu_si512(st + base);
+    vend = _mm512_loadu_si512(end + base);
+    cnt  = zero;
+    while (act) {
+        v = _mm512_add_epi32(_mm512_sub_epi32(vend, vst), one);
+        v = _mm512_or_si512(v, _mm512_srli_epi32(v, 1));
+        v = _mm512_or_si512(v, _mm512_srli_epi32(v, 2));
+        v = _mm512_or_si512(v, _mm512_srli_epi32(v, 4));
+        v = _mm512_or_si512(v, _mm512_srli_epi32(v, 8));
+        v = _mm512_or_si512(v, _mm512_srli_epi32(v, 16));
+        v = _mm512_add_epi32(_mm512_srli_epi32(v, 1), one);
+        size = _mm512_add_epi32(vend, one);
+        size = _mm512_and_si512(size, _mm512_sub_epi32(zero, size));
+        size = _mm512_min_epu32(size, v);
+
+        patt = _mm512_add_epi32(_mm512_sub_epi32(vend, size), one);
+        mask = _mm512_sub_epi32(zero, size);
+
+        /* lanes out of room stop with ENOSPC */
+        full = _mm512_mask_cmpeq_epi32_mask(act, cnt, vstride);
+        if (full) {
+            for (l = 0; l < 16; ++l) {
+                if (full & (1U << l)) {
+                    rc[l] = R2M_ENOSPC;
+                }
+            }
+            act &= ~full;
+        }
+        idx = _mm512_add_epi32(laneOff, cnt);
+        _mm512_mask_i32scatter_epi32(pBase, act, idx, patt, 4);
+        _mm512_mask_i32scatter_epi32(mBase, act, idx, mask, 4);
+        cnt = _mm512_mask_add_epi32(cnt, act, cnt, one);
+
+        fin  = _mm512_mask_cmpeq_epi32_mask(act, patt, vst);
+        act &= ~fin;
+        vend = _mm512_sub_epi32(patt, one);
+    }
+    _mm512_storeu_si512(tc, cnt);
+    for (l = 0; l < 16; ++l) {
+        if (tc[l]) {
+            o->count[base + l] = tc[l];
+        }
+    }
+}
+
+#endif /* R2M_X86 */
+
+/**
+ * @name  r2mSimdBest
+ *
+ * @brief Returns the widest instruction set this CPU supports
+ *
+ * @retval R2M_ISA_AVX512, R2M_ISA_AVX2 or R2M_ISA_SCALAR
+ */
+int
+r2mSimdBest (void)
+{
+#ifdef R2M_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return R2M_ISA_AVX512;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return R2M_ISA_AVX2;
+    }
+#endif /* R2M_X86 */
+    return R2M_ISA_SCALAR;
+}
+
+/**
+ * @name  range2entsBatch
+ *
+ * @brief Converts 'n' ranges [st[i], end[i]] at once into a
+ *        structure of arrays, 8 or 16 ranges per step if the CPU
+ *        can. The entries of range i are the same as those of
+ *        range2ents(st[i], end[i], ...).
+ *
+ * @param[in]  isa R2M_ISA_AUTO, or an instruction set to force
+ *                 (falls back to R2M_ISA_SCALAR if not supported)
+ * @param[in]  st  Numbers that the ranges start
+ * @param[in]  end Numbers that the ranges end
+ * @param[in]  n   Number of ranges
+ * @param[out] o   Result. o->patt[] and o->mask[] must have room for
+ *                 n * o->stride entries and o->count[] for n counts;
+ *                 o->rc[] (if not NULL) receives a status per range.
+ *                 A range with more than o->stride entries stores the
+ *                 first o->stride entries and gets R2M_ENOSPC.
+ *
+ * @retval SUCCESS    Every range is successfully converted
+ * @retval R2M_EINVAL Wrong parameter
+ * @retval < 0        Status of the first range that failed
+ */
+int
+range2entsBatch (int isa, const u32 *st, const u32 *end, u32 n, r2mSoa *o)
+{
+    int rc[16];
+    int ret = SUCCESS;
+    u32 i = 0, l, w;
+
+
+    if (!st || !end || !o || !o->patt || !o->mask || !o->count) {
+        return R2M_EINVAL;
+    }
+    if (isa == R2M_ISA_AUTO || isa > r2mSimdBest()) {
+        isa = r2mSimdBest();
+    }
+#ifdef R2M_X86
+    w = (isa == R2M_ISA_AVX512) ? 16 : 8;
+    if (isa != R2M_ISA_SCALAR) {
+        for (; i + w <= n; i += w) {
+            if (isa == R2M_ISA_AVX512) {
+                blockAvx512(st, end, o, i, rc);
+            } else {
+                blockAvx2(st, end, o, i, rc);
+            }
+            for (l = 0; l < w; ++l) {
+                if (o->rc) {
+                    o->rc[i + l] = rc[l];
+                }
+                if (ret == SUCCESS) {
+                    ret = rc[l];
+                }
+            }
+        }
+    }
+#else
+    (void)w;
+    (void)l;
+    (void)rc;
+#endif /* R2M_X86 */
+    for (; i < n; ++i) {
+        int r = soaScalar(st[i], end[i], o, i);
+
+        if (o->rc) {
+            o->rc[i] = r;
+        }
+        if (ret == SUCCESS) {
+            ret = r;
+        }
+    }
+    return ret;
+}
@@ -0,0 +1,198 @@
+/*
+ * r2m_verify.c: interval-based check of converted entries
+ *
+ * Copyright (c) 2017, 2018, 2019, 2020, 2021 Yoichi Hariguchi
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the
+ * Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall
+ * be included in all copies or substantial portions of the
+ * Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+ */
+
+/*
+ * Every entry of a range is a prefix, i.e. the interval
+ * [patt & mask, patt | ~mask], and two prefixes are either disjoint
+ * or one contains the other. Sorted by start (the larger one first),
+ * the entries that cover a point are therefore always a chain that
+ * a stack holds, and the entry that matches first is the one with
+ * the smallest index in the stack. One sweep over the sorted entries
+ * visits every piece of the key space with the entry that matches
+ * it, so a layout is checked in O(n log n) instead of 2^32 lookups.
+ */
+
+#include "range2masks.h"
+#include "r2m_bits.h"
+
+typedef struct vIv_ {
+    u32 lo;
+    u32 hi;
+    u32 idx;                    /* index of the entry (priority) */
+} vIv;
+
+typedef struct vTop_ {
+    u32 hi;
+    u32 win;                    /* smallest index in the stack so far */
+} vTop;
+
+
+static int
+cmpIv (const void *a, const void *b)
+{
+    const vIv *x = a, *y = b;
+
+    if (x->lo != y->lo) {
+        return (x->lo < y->lo) ? -1 : 1;
+    }
+    if (x->hi != y->hi) {
+        return (x->hi > y->hi) ? -1 : 1;    /* the larger one first */
+    }
+    return (x->idx > y->idx) - (x->idx < y->idx);
+}
+
+/*
+ * [lo, hi] is matched by entry 'win' (n: none). It must be accepted
+ * exactly where it is inside [st, end].
+ */
+static inline bool
+pieceOk (const u8 *inv, u32 n, u32 win, u32 lo, u32 hi, u32 st, u32 end,
+         u32 *pBad)
+{
+    bool acc = (win < n && !(inv && inv[win]));
+
+    if (acc && (lo < st || hi > end)) {
+        *pBad = (lo < st) ? lo : end + 1;
+        return FALSE;
+    }
+    if (!acc && hi >= st && lo <= end) {
+        *pBad = (lo > st) ? lo : st;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/**
+ * @name  r2mVerify
+ *
+ * @brief Checks that TCAM entries match exactly [st, end]
+ *
+ * Without 'inv', the entries must be disjoint and cover [st, end]
+ * exactly (the entries of one rule). With 'inv', they are a first
+ * match layout in priority order: a key must hit an entry with
+ * inv == 0 if it is in [st, end], and an entry with inv != 0 or
+ * none otherwise.
+ *
+ * @param[in]  ent  Entries (must be prefixes)
+ * @param[in]  inv  Action of each entry, 0: that of the range
+ *                  (NULL: all 0 and disjoint)
+ * @param[in]  n    Number of entries
+ * @param[in]  st   Number that the range starts
+ * @param[in]  end  Number that the range ends
+ * @param[in]  a    Arena for the sort (reset by the caller)
+ * @param[out] pBad A key that is matched wrongly (may be NULL)
+ *
+ * @retval SUCCESS     The entries match [st, end]
+ * @retval R2M_EVERIFY They do not ('*pBad' tells where)
+ * @retval R2M_EINVAL  NULL pointer or st > end
+ * @retval R2M_EFAIL   Out of memory
+ */
+int
+r2mVerify (const tcamEnt *ent, const u8 *inv, u32 n, u32 st, u32 end,
+           r2mArena *a, u32 *pBad)
+{
+    vIv *iv;
+    vTop *stk;
+    u64 pos = 0, next;
+    u32 i, sp = 0, bad = 0, hi;
+    bool sorted = TRUE;
+    int rc = SUCCESS;
+
+
+    if ((!ent && n) || !a || st > end) {
+        return R2M_EINVAL;
+    }
+    if (!pBad) {
+        pBad = &bad;
+    }
+    iv  = r2mArenaAlloc(a, (n + 1) * sizeof(*iv));
+    stk = r2mArenaAlloc(a, (n + 1) * sizeof(*stk));
+    if (!iv || !stk) {
+        return R2M_EFAIL;
+    }
+    /* the engines emit the entries from the end: usually no sort */
+    for (i = 0; i < n; ++i) {
+        const tcamEnt *e = ent + (n - 1 - i);
+
+        if (!r2mIsContig32(e->mask)) {
+            *pBad = e->patt;
+            return R2M_EVERIFY;
+        }
+        iv[i].lo  = e->patt & e->mask;
+        iv[i].hi  = iv[i].lo | ~e->mask;
+        iv[i].idx = n - 1 - i;
+        if (i && cmpIv(iv + i - 1, iv + i) > 0) {
+            sorted = FALSE;
+        }
+    }
+    if (!sorted) {
+        qsort(iv, n, sizeof(*iv), cmpIv);
+    }
+
+    /*
+     * pos: first key not checked yet. Before an entry starts, the
+     * pieces of the entries on the stack up to its start are checked.
+     */
+    for (i = 0; i <= n && rc == SUCCESS; ++i) {
+        next = (i < n) ? iv[i].lo : (1ULL << 32);
+        while (pos < next) {
+            if (sp == 0) {
+                if (!pieceOk(inv, n, n, pos, next - 1, st, end, pBad)) {
+                    rc = R2M_EVERIFY;
+                }
+                pos = next;
+                break;
+            }
+            hi = (stk[sp - 1].hi < next - 1) ? stk[sp - 1].hi : next - 1;
+            if (!pieceOk(inv, n, stk[sp - 1].win, pos, hi, st, end, pBad)) {
+                rc = R2M_EVERIFY;
+                break;
+            }
+            pos = (u64)hi + 1;
+            while (sp && stk[sp - 1].hi < pos) {
+                --sp;
+            }
+        }
+        while (sp && stk[sp - 1].hi < next) {
+            --sp;
+        }
+        if (i == n || rc != SUCCESS) {
+            break;
+        }
+        if (sp && !inv) {
+            *pBad = iv[i].lo;   /* overlap */
+            rc = R2M_EVERIFY;
+            break;
+        }
+        stk[sp].hi  = iv[i].hi;
+        stk[sp].win = (sp && stk[sp - 1].win < iv[i].idx) ?
+                      stk[sp - 1].win : iv[i].idx;
+        ++sp;
+    }
+    return rc;
+}
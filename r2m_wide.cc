@@ -0,0 +1,167 @@
+/*
+ * r2m_wide.cc: C interface of the width-generic engine
+ *
+ * Copyright (c) 2017, 2018, 2019, 2020, 2021 Yoichi Hariguchi
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the
+ * Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall
+ * be included in all copies or substantial portions of the
+ * Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+ */
+
+#include "range2masks.hpp"
+
+#ifdef __SIZEOF_INT128__
+
+namespace {
+
+/* Checks of the constexpr path, at build time */
+static_assert(r2m::count<32>(1, 0xfffffffe) == r2m::maxEnt<32>());
+static_assert(r2m::count<16>(1024, 65535) == 6);
+static_assert(r2m::rule<1024, 65535>().ent[0].mask == 0xffff8000);
+static_assert(r2m::rule<1, 0>().nEnt == 0);
+
+/*
+ * Runs the native W-bit instantiation and widens the entries
+ */
+template <unsigned W>
+int
+wide (r2mU128 st, r2mU128 end, tcamEntW *ent, u32 maxEnt, u32 *pnEnt)
+{
+    typedef typename r2m::width<W>::key T;
+    const r2mU128 max = (W == 128) ? ~(r2mU128)0 : ((r2mU128)1 << W) - 1;
+    r2m::ent<W> tmp[r2m::maxEnt<W>()];
+    u32 i, n;
+    int rc;
+
+
+    if (!ent || !pnEnt) {
+        return R2M_EINVAL;
+    }
+    if (st > max || end > max) {
+        *pnEnt = 0;
+        return R2M_ERANGE;
+    }
+    n  = (maxEnt < r2m::maxEnt<W>()) ? maxEnt : r2m::maxEnt<W>();
+    rc = r2m::range2ents<W>((T)st, (T)end, tmp, n, pnEnt);
+    for (i = 0; i < *pnEnt; ++i) {
+        ent[i].patt = tmp[i].patt;
+        ent[i].mask = tmp[i].mask;
+    }
+    return rc;
+}
+
+} /* namespace */
+
+extern "C" {
+
+/**
+ * @name  range2entsWide
+ *
+ * @brief Converts a range of W-bit keys into TCAM entries.
+ *        [0, 2^W - 1] is a valid range.
+ *
+ * @param[in]  width  W (8, 16, 32, 64 or 128)
+ * @param[in]  st     Number that the range starts
+ * @param[in]  end    Number that the range ends
+ * @param[out] ent    Array of (pattern, mask) receiving the result
+ *                    (the low W bits are significant)
+ * @param[in]  maxEnt Number of elements of 'ent'
+ *                    (R2M_MAXENT_W(width) always fits)
+ * @param[out] pnEnt  Number of entries stored in 'ent'
+ *
+ * @retval SUCCESS    The range is successfully converted
+ * @retval R2M_EINVAL Unsupported width or NULL pointer
+ * @retval R2M_ERANGE 'st' or 'end' does not fit in W bits
+ * @retval R2M_ENOSPC 'maxEnt' is too small
+ */
+int
+range2entsWide (u32 width, r2mU128 st, r2mU128 end, tcamEntW *ent,
+                u32 maxEnt, u32 *pnEnt)
+{
+    switch (width) {
+    case 8:
+        return wide<8>(st, end, ent, maxEnt, pnEnt);
+    case 16:
+        return wide<16>(st, end, ent, maxEnt, pnEnt);
+    case 32:
+        return wide<32>(st, end, ent, maxEnt, pnEnt);
+    case 64:
+        return wide<64>(st, end, ent, maxEnt, pnEnt);
+    case 128:
+        return wide<128>(st, end, ent, maxEnt, pnEnt);
+    default:
+        return R2M_EINVAL;
+    }
+}
+
+/**
+ * @name  range2ents64
+ *
+ * @brief range2ents() for 64-bit keys. [0, 2^64 - 1] is a valid range.
+ *
+ * @param[in]  st     Number that the range starts
+ * @param[in]  end    Number that the range ends
+ * @param[out] ent    Array of (pattern, mask) receiving the result
+ * @param[in]  maxEnt Number of elements of 'ent' (126 always fits)
+ * @param[out] pnEnt  Number of entries stored in 'ent'
+ *
+ * @retval See range2entsWide()
+ */
+int
+range2ents64 (u64 st, u64 end, tcamEnt64 *ent, u32 maxEnt, u32 *pnEnt)
+{
+    static_assert(sizeof(tcamEnt64) == sizeof(r2m::ent<64>),
+                  "tcamEnt64 must match r2m::ent<64>");
+
+    return r2m::range2ents<64>(st, end,
+                               reinterpret_cast<r2m::ent<64> *>(ent),
+                               maxEnt, pnEnt);
+}
+
+/**
+ * @name  range2ents128
+ *
+ * @brief range2ents() for 128-bit keys (IPv6 addresses).
+ *        [0, 2^128 - 1] is a valid range.
+ *
+ * @param[in]  st     Number that the range starts
+ * @param[in]  end    Number that the range ends
+ * @param[out] ent    Array of (pattern, mask) receiving the result
+ * @param[in]  maxEnt Number of elements of 'ent' (254 always fits)
+ * @param[out] pnEnt  Number of entries stored in 'ent'
+ *
+ * @retval See range2entsWide()
+ */
+int
+range2ents128 (r2mU128 st, r2mU128 end, tcamEntW *ent, u32 maxEnt,
+               u32 *pnEnt)
+{
+    static_assert(sizeof(tcamEntW) == sizeof(r2m::ent<128>),
+                  "tcamEntW must match r2m::ent<128>");
+
+    return r2m::range2ents<128>(st, end,
+                                reinterpret_cast<r2m::ent<128> *>(ent),
+                                maxEnt, pnEnt);
+}
+
+} /* extern "C" */
+
+#endif /* __SIZEOF_INT128__ */
@@ -0,0 +1,826 @@
+/*
+ * r2mbench.c: benchmark for the range decomposition engines
+ *
+ * Copyright (c) 2021 Yoichi Hariguchi
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the
+ * Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall
+ * be included in all copies or substantial portions of the
+ * Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+ */
+
+/*
+ * Usage: r2mbench [<nranges> [<rounds> [<threads>]]]
+ *
+ * Every engine is checked against range2masks() and timed over the
+ * same ranges of each distribution: random 32-bit, the worst case,
+ * single prefixes and random 16-bit (port) ranges. The ranges are
+ * also compiled into an r2mMatch classifier and looked up.
+ */
+
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include "range2masks.h"
+
+enum {
+    DEF_NRANGES = 1000000,
+    DEF_NROUNDS = 3,
+    MAX_THREADS = 64,
+};
+
+typedef struct range_ {
+    u32 st;
+    u32 end;
+} range;
+
+
+/*
+ * xorshift32: reproducible and fast enough not to matter
+ */
+static u32
+rnd (u32 *s)
+{
+    u32 x = *s;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return (*s = x);
+}
+
+static double
+now (void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*
+ * Engines under test. 'arg' is engine specific (e.g. the port tables).
+ */
+typedef struct engine_ {
+    const char *name;
+    int (*conv)(const void *arg, u32 st, u32 end, aclRule *p);
+    const void *arg;
+} engine;
+
+static int
+convEngine (const void *arg, u32 st, u32 end, aclRule *p)
+{
+    return range2masksEngine(*(const r2mEngine *)arg, st, end, p);
+}
+
+static int
+convPort (const void *arg, u32 st, u32 end, aclRule *p)
+{
+    return range2entsPort(arg, st, end, p->ent, p->maxEnt, &p->nEnt);
+}
+
+static const r2mEngine engLoop = R2M_ENGINE_LOOP;
+static const r2mEngine engClz  = R2M_ENGINE_CLZ;
+
+static void
+mkRanges (range *r, u32 n, u32 seed, u32 max)
+{
+    u32 i, a, b;
+
+    for (i = 0; i < n; ++i) {
+        a = rnd(&seed) & max;
+        b = rnd(&seed) & max;
+        if (a > b) {
+            u32 t = a; a = b; b = t;
+        }
+        if (b == ~0) {
+            --b;
+        }
+        r[i].st  = a;
+        r[i].end = b;
+    }
+}
+
+/*
+ * Ranges that are exactly one prefix (/1 ... /32). [x, 2^32-1] cannot
+ * be converted, so such blocks are cut off at their last address.
+ */
+static void
+mkAligned (range *r, u32 n, u32 seed)
+{
+    u32 i, plen, mask;
+
+    for (i = 0; i < n; ++i) {
+        plen = 1 + rnd(&seed) % 32;
+        mask = ~0u << (32 - plen);
+        r[i].st  = rnd(&seed) & mask;
+        r[i].end = r[i].st | ~mask;
+        if (r[i].end == ~0) {
+            --r[i].end;
+        }
+    }
+}
+
+static void
+mkWorst (range *r, u32 n)
+{
+    u32 i;
+
+    for (i = 0; i < n; ++i) {
+        r[i].st  = 1;
+        r[i].end = ~0 - 1;
+    }
+}
+
+/*
+ * Every engine must produce exactly what the reference engine does.
+ */
+static int
+verify (const range *r, u32 n, const engine *e)
+{
+    tcamEnt refEnt[MAXENT], resEnt[MAXENT];
+    aclRule ref = { 0, MAXENT, refEnt };
+    aclRule res = { 0, MAXENT, resEnt };
+    int rc1, rc2;
+    u32 i;
+
+    for (i = 0; i < n; ++i) {
+        rc1 = range2masks(r[i].st, r[i].end, &ref);
+        rc2 = e->conv(e->arg, r[i].st, r[i].end, &res);
+        if (rc1 != rc2 || ref.nEnt != res.nEnt ||
+            memcmp(ref.ent, res.ent, ref.nEnt * sizeof(ref.ent[0]))) {
+            fprintf(stderr, "ERROR: %s: mismatch at %u - %u\n",
+                    e->name, r[i].st, r[i].end);
+            return FAILURE;
+        }
+        if (rc1 == SUCCESS && r2mCount(r[i].st, r[i].end) != ref.nEnt) {
+            fprintf(stderr, "ERROR: r2mCount: mismatch at %u - %u\n",
+                    r[i].st, r[i].end);
+            return FAILURE;
+        }
+    }
+    return SUCCESS;
+}
+
+static void
+report (const char *name, double ns, u32 n, u64 nEnt)
+{
+    printf("  %-8s %10.2f ns/range %10.2f Mentries/s (%" PRIu64
+           " entries)\n", name, ns / n, nEnt / ns * 1e3, nEnt);
+}
+
+static void
+bench (const range *r, u32 n, u32 rounds, const engine *e)
+{
+    tcamEnt ent[MAXENT];
+    aclRule rule = { 0, MAXENT, ent };
+    double t0, t, best = 0;
+    u64 nEnt = 0;
+    u32 i, k;
+
+    for (k = 0; k < rounds; ++k) {
+        nEnt = 0;
+        t0 = now();
+        for (i = 0; i < n; ++i) {
+            e->conv(e->arg, r[i].st, r[i].end, &rule);
+            nEnt += rule.nEnt;
+        }
+        t = now() - t0;
+        if (k == 0 || t < best) {
+            best = t;
+        }
+    }
+    report(e->name, best, n, nEnt);
+}
+
+static void
+benchCount (const range *r, u32 n, u32 rounds)
+{
+    double t0, t, best = 0;
+    u64 nEnt = 0;
+    u32 i, k;
+
+    for (k = 0; k < rounds; ++k) {
+        nEnt = 0;
+        t0 = now();
+        for (i = 0; i < n; ++i) {
+            nEnt += r2mCount(r[i].st, r[i].end);
+        }
+        t = now() - t0;
+        if (k == 0 || t < best) {
+            best = t;
+        }
+    }
+    report("count", best, n, nEnt);
+}
+
+/*
+ * range2entsBatch() in blocks of BATCH ranges
+ */
+enum {
+    BATCH = 1024,
+};
+
+static int
+verifyBatch (const range *r, u32 n, int isa, u32 *st, u32 *end, r2mSoa *o)
+{
+    tcamEnt ent[MAXENT];
+    aclRule ref = { 0, MAXENT, ent };
+    int rc;
+    u32 i, j;
+
+    for (i = 0; i + BATCH <= n; i += BATCH) {
+        for (j = 0; j < BATCH; ++j) {
+            st[j]  = r[i + j].st;
+            end[j] = r[i + j].end;
+        }
+        range2entsBatch(isa, st, end, BATCH, o);
+        for (j = 0; j < BATCH; ++j) {
+            rc = range2masks(st[j], end[j], &ref);
+            if (rc != o->rc[j] || ref.nEnt != o->count[j]) {
+                goto bad;
+            }
+            for (rc = 0; rc < ref.nEnt; ++rc) {
+                if (ref.ent[rc].patt != o->patt[j * o->stride + rc] ||
+                    ref.ent[rc].mask != o->mask[j * o->stride + rc]) {
+                    goto bad;
+                }
+            }
+        }
+    }
+    return SUCCESS;
+
+bad:
+    fprintf(stderr, "ERROR: batch/%d: mismatch at %u - %u\n",
+            isa, st[j], end[j]);
+    return FAILURE;
+}
+
+static void
+benchBatch (const range *r, u32 n, u32 rounds)
+{
+    static const char *names[] = { "scalar", "avx2", "avx512" };
+    u32 st[BATCH], end[BATCH];
+    u32 count[BATCH];
+    int rcs[BATCH];
+    r2mSoa o;
+    double t0, t, best = 0;
+    u64 nEnt = 0;
+    u32 i, j, k;
+    int isa;
+
+    o.stride = MAXENT;
+    o.patt   = malloc(BATCH * MAXENT * sizeof(u32));
+    o.mask   = malloc(BATCH * MAXENT * sizeof(u32));
+    o.count  = count;
+    o.rc     = rcs;
+    if (!o.patt || !o.mask) {
+        fprintf(stderr, "ERROR: out of memory\n");
+        exit(1);
+    }
+    for (isa = R2M_ISA_SCALAR; isa <= r2mSimdBest(); ++isa) {
+        if (verifyBatch(r, n, isa, st, end, &o) != SUCCESS) {
+            exit(1);
+        }
+        for (k = 0; k < rounds; ++k) {
+            nEnt = 0;
+            t0 = now();
+            for (i = 0; i + BATCH <= n; i += BATCH) {
+                for (j = 0; j < BATCH; ++j) {
+                    st[j]  = r[i + j].st;
+                    end[j] = r[i + j].end;
+                }
+                range2entsBatch(isa, st, end, BATCH, &o);
+                for (j = 0; j < BATCH; ++j) {
+                    nEnt += count[j];
+                }
+            }
+            t = now() - t0;
+            if (k == 0 || t < best) {
+                best = t;
+            }
+        }
+        report(names[isa], best, n - n % BATCH, nEnt);
+    }
+    free(o.patt);
+    free(o.mask);
+}
+
+/*
+ * range2masksArena() with the arena reset every BATCH ranges, as the
+ * command line does per record or per chunk. Allocator traffic is the
+ * chunk memory malloc()ed while timed: 0 once the arena is warm.
+ */
+static void
+benchArena (const range *r, u32 n, u32 rounds)
+{
+    r2mArena a;
+    aclRule rule;
+    double t0, t, best = 0;
+    size_t warm = 0, peak;
+    u64 nEnt = 0;
+    u32 i, k;
+
+    r2mArenaInit(&a, 0);
+    for (k = 0; k <= rounds; ++k) {
+        if (k == 1) {
+            warm = a.bytes;     /* round 0 warms the arena up */
+        }
+        nEnt = 0;
+        t0 = now();
+        for (i = 0; i < n; ++i) {
+            if (i % BATCH == 0) {
+                r2mArenaReset(&a);
+            }
+            range2masksArena(R2M_ENGINE_CLZ, r[i].st, r[i].end, &a, &rule);
+            nEnt += rule.nEnt;
+        }
+        t = now() - t0;
+        if (k == 1 || t < best) {
+            best = t;
+        }
+    }
+    peak = a.bytes;
+    report("arena", best, n, nEnt);
+    printf("  %-8s %10zu bytes of chunks, %zu bytes malloc()ed while"
+           " timed\n", "", peak, peak - warm);
+    r2mArenaFree(&a);
+}
+
+/*
+ * The clz engine on 'nThr' threads, each with its share of the ranges
+ * and its own entries (what -j does, without the I/O)
+ */
+typedef struct mtArg_ {
+    const range *r;
+    u32          n;
+    u64          nEnt;
+} mtArg;
+
+static void *
+mtWorker (void *arg)
+{
+    mtArg *m = arg;
+    tcamEnt ent[MAXENT];
+    aclRule rule = { 0, MAXENT, ent };
+    u32 i;
+
+    m->nEnt = 0;
+    for (i = 0; i < m->n; ++i) {
+        range2masksEngine(R2M_ENGINE_CLZ, m->r[i].st, m->r[i].end, &rule);
+        m->nEnt += rule.nEnt;
+    }
+    return NULL;
+}
+
+static void
+benchMt (const range *r, u32 n, u32 rounds, u32 nThr)
+{
+    pthread_t tid[MAX_THREADS];
+    mtArg arg[MAX_THREADS];
+    double t0, t, best = 0;
+    char name[16];
+    u64 nEnt = 0;
+    u32 i, k, per = n / nThr;
+
+    for (k = 0; k < rounds; ++k) {
+        t0 = now();
+        for (i = 0; i < nThr; ++i) {
+            arg[i].r = r + i * per;
+            arg[i].n = (i == nThr - 1) ? n - i * per : per;
+            if (pthread_create(tid + i, NULL, mtWorker, arg + i) != 0) {
+                fprintf(stderr, "ERROR: failed to create a thread\n");
+                exit(1);
+            }
+        }
+        nEnt = 0;
+        for (i = 0; i < nThr; ++i) {
+            pthread_join(tid[i], NULL);
+            nEnt += arg[i].nEnt;
+        }
+        t = now() - t0;
+        if (k == 0 || t < best) {
+            best = t;
+        }
+    }
+    snprintf(name, sizeof(name), "clz/j%u", nThr);
+    report(name, best, n, nEnt);
+}
+
+/*
+ * r2mMatch over the first MATCH_RULES ranges as rules of random
+ * priorities and actions, plus some entries with non-contiguous masks,
+ * against a linear first-match scan of the entries
+ */
+enum {
+    MATCH_RULES = 10000,
+    MATCH_ODD   = 16,           /* rules with a non-contiguous mask */
+    MATCH_SCAN  = 1000,         /* keys looked up by the scan */
+};
+
+static s32
+scan (const r2mMatchRule *rules, u32 n, u32 key)
+{
+    s32 best = -1;
+    u32 i, k;
+
+    for (i = 0; i < n; ++i) {
+        if (best >= 0 && rules[i].prio >= rules[best].prio) {
+            continue;
+        }
+        for (k = 0; k < rules[i].nEnt; ++k) {
+            if ((key & rules[i].ent[k].mask) == rules[i].ent[k].patt) {
+                best = i;
+                break;
+            }
+        }
+    }
+    return best;
+}
+
+/*
+ * r2mMatchBatch() against r2mMatchLookup() key by key, then the time
+ * of both. Lock step only runs if no rule has a non-contiguous mask.
+ */
+static void
+timeMatch (const r2mMatch *m, const u32 *key, u32 n, s32 *res, u32 rounds,
+           const char *tag)
+{
+    char name[16];
+    double t0, t, best = 0;
+    u64 sum = 0;
+    u32 i, k;
+
+    r2mMatchBatch(m, key, n, res);
+    for (i = 0; i < n; ++i) {
+        if (res[i] != r2mMatchLookup(m, key[i])) {
+            fprintf(stderr, "ERROR: match: batch%s mismatch at %u\n", tag,
+                    key[i]);
+            exit(1);
+        }
+    }
+    for (k = 0; k < rounds; ++k) {
+        t0 = now();
+        for (i = 0; i < n; ++i) {
+            sum += r2mMatchLookup(m, key[i]);
+        }
+        t = now() - t0;
+        if (k == 0 || t < best) {
+            best = t;
+        }
+    }
+    snprintf(name, sizeof(name), "lookup%s", tag);
+    printf("  %-8s %10.2f ns/key %10.2f Mkeys/s\n", name, best / n,
+           n / best * 1e3);
+    for (k = 0; k < rounds; ++k) {
+        t0 = now();
+        r2mMatchBatch(m, key, n, res);
+        t = now() - t0;
+        if (k == 0 || t < best) {
+            best = t;
+        }
+    }
+    snprintf(name, sizeof(name), "batch%s", tag);
+    printf("  %-8s %10.2f ns/key %10.2f Mkeys/s (%" PRIu64 ")\n", name,
+           best / n, n / best * 1e3, sum & 1);
+}
+
+static void
+benchMatch (const range *r, u32 n, u32 rounds)
+{
+    u32 nRule = (n < MATCH_RULES) ? n : MATCH_RULES;
+    r2mMatchRule *rules;
+    aclRule rule;
+    r2mArena a;
+    r2mMatch *m;
+    u32 *key, seed = 0x9e3779b9;
+    s32 *res;
+    double t0, t;
+    u64 sum = 0;
+    u32 i;
+
+    rules = malloc((nRule + MATCH_ODD) * sizeof(*rules));
+    key   = malloc(n * sizeof(*key));
+    res   = malloc(n * sizeof(*res));
+    if (!rules || !key || !res) {
+        fprintf(stderr, "ERROR: out of memory\n");
+        exit(1);
+    }
+    r2mArenaInit(&a, 0);
+    for (i = 0; i < nRule + MATCH_ODD; ++i) {
+        if (i < nRule) {
+            range2masksArena(R2M_ENGINE_CLZ, r[i].st, r[i].end, &a, &rule);
+        } else {
+            r2mRuleAlloc(&a, &rule, 1);
+            rule.nEnt = 1;
+            rule.ent[0].mask = rnd(&seed) | rnd(&seed);
+            rule.ent[0].patt = rnd(&seed) & rule.ent[0].mask;
+        }
+        rules[i].ent  = rule.ent;
+        rules[i].nEnt = rule.nEnt;
+        rules[i].prio = rnd(&seed) % nRule;
+        rules[i].act  = rnd(&seed) & 1;
+    }
+    for (i = 0; i < n; ++i) {
+        key[i] = (i & 1) ? rnd(&seed) : r[rnd(&seed) % nRule].st;
+    }
+    nRule += MATCH_ODD;
+
+    t0 = now();
+    if ((m = r2mMatchCreate(rules, nRule)) == NULL) {
+        fprintf(stderr, "ERROR: out of memory\n");
+        exit(1);
+    }
+    printf("  match    %u rules compiled in %.2f ms (%zu bytes)\n", nRule,
+           (now() - t0) / 1e6, r2mMatchSize(m));
+    for (i = 0; i < n && i < MATCH_SCAN; ++i) {
+        if (r2mMatchLookup(m, key[i]) != scan(rules, nRule, key[i])) {
+            fprintf(stderr, "ERROR: match: mismatch at %u\n", key[i]);
+            exit(1);
+        }
+    }
+
+    t0 = now();
+    for (i = 0; i < n && i < MATCH_SCAN; ++i) {
+        sum += scan(rules, nRule, key[i]);
+    }
+    t = now() - t0;
+    printf("  %-8s %10.2f ns/key (%" PRIu64 ")\n", "scan", t / i, sum & 1);
+    timeMatch(m, key, n, res, rounds, "");
+    r2mMatchDestroy(m);
+
+    /* prefixes only: r2mMatchBatch() runs MATCH_LANES in lock step */
+    nRule -= MATCH_ODD;
+    if ((m = r2mMatchCreate(rules, nRule)) == NULL) {
+        fprintf(stderr, "ERROR: out of memory\n");
+        exit(1);
+    }
+    printf("  match/p  %u prefix rules (%zu bytes)\n", nRule,
+           r2mMatchSize(m));
+    timeMatch(m, key, n, res, rounds, "/p");
+    r2mMatchDestroy(m);
+    r2mArenaFree(&a);
+    free(res);
+    free(key);
+    free(rules);
+}
+
+/*
+ * r2mPack of all the ranges: bytes per range against the entries
+ * kept as aclRule + tcamEnt[], and the time to decode them all
+ */
+static void
+benchPack (const range *r, u32 n, u32 rounds)
+{
+    tcamEnt ent[MAXENT], e;
+    r2mPackIter it;
+    r2mPack *p;
+    u32 nEnt, i, j, k;
+    u64 total;
+    size_t size;
+    double t0, t, best = 0;
+    u64 sum = 0;
+
+    if ((p = r2mPackCreate()) == NULL) {
+        fprintf(stderr, "ERROR: out of memory\n");
+        exit(1);
+    }
+    t0 = now();
+    for (i = 0; i < n; ++i) {
+        range2entsClz(r[i].st, r[i].end, ent, MAXENT, &nEnt);
+        if (r2mPackAdd(p, ent, nEnt, NULL) != SUCCESS) {
+            fprintf(stderr, "ERROR: pack: failed to add %u - %u\n",
+                    r[i].st, r[i].end);
+            exit(1);
+        }
+    }
+    t = now() - t0;
+    size = r2mPackSize(p, NULL, &total);
+    for (i = 0; i < n; ++i) {
+        range2entsClz(r[i].st, r[i].end, ent, MAXENT, &nEnt);
+        r2mPackIterInit(&it, p, i);
+        for (j = 0; r2mPackNext(&it, &e); ++j) {
+            if (j >= nEnt || e.patt != ent[j].patt || e.mask != ent[j].mask) {
+                break;
+            }
+        }
+        if (j != nEnt || it.i != it.nEnt) {
+            fprintf(stderr, "ERROR: pack: %u - %u decoded wrong\n",
+                    r[i].st, r[i].end);
+            exit(1);
+        }
+    }
+    for (k = 0; k < rounds; ++k) {
+        t0 = now();
+        for (i = 0; i < n; ++i) {
+            r2mPackIterInit(&it, p, i);
+            while (r2mPackNext(&it, &e)) {
+                sum += e.patt;
+            }
+        }
+        t0 = now() - t0;
+        if (k == 0 || t0 < best) {
+            best = t0;
+        }
+    }
+    printf("  pack     %.2f bytes/range (aclRule: %.2f) %.2f ns/range to"
+           " add\n", (double)size / n,
+           sizeof(aclRule) + (double)total * sizeof(tcamEnt) / n, t / n);
+    printf("  %-8s %10.2f ns/range %10.2f Mentries/s (%" PRIu64 ")\n",
+           "unpack", best / n, total / best * 1e3, sum & 1);
+    r2mPackDestroy(p);
+}
+
+/*
+ * r2mLayout: the first half of LAYOUT_RULES rules planned into a
+ * TCAM with LAYOUT_SLACK% free slots, then the other half inserted
+ * entry by entry between random rules. The moves are replayed on a
+ * copy of the table to check the order; a packed table would shift
+ * every entry after the new one.
+ */
+enum {
+    LAYOUT_RULES = 1000,
+    LAYOUT_SLACK = 25,
+};
+
+static void
+benchLayout (const range *r, u32 n)
+{
+    u32 nRule = (n < LAYOUT_RULES) ? n : LAYOUT_RULES;
+    u32 nPlan = (nRule + 1) / 2;
+    u32 nSlots, nEnt = 0, nIns = 0, i, k, s, slot, nMv, seed = 0x9e3779b9;
+    u32 *prio, *slots, *tbl;
+    r2mMove mv[2 * LAYOUT_RULES];
+    r2mLayout *l;
+    u64 moves = 0, shifts = 0;
+    double t0, t;
+
+    for (i = 0; i < nRule; ++i) {
+        nEnt += r2mCount(r[i].st, r[i].end);
+    }
+    nSlots = nEnt + nEnt / (100 / LAYOUT_SLACK);
+    prio  = malloc(nEnt * sizeof(*prio));
+    slots = malloc(nEnt * sizeof(*slots));
+    tbl   = malloc(nSlots * sizeof(*tbl));
+    if (!prio || !slots || !tbl || (l = r2mLayoutCreate(nSlots)) == NULL) {
+        fprintf(stderr, "ERROR: out of memory\n");
+        exit(1);
+    }
+    for (nEnt = 0, i = 0; i < nPlan; ++i) {
+        for (k = r2mCount(r[i].st, r[i].end); k; --k) {
+            prio[nEnt++] = 2 * i;       /* odd: room between the rules */
+        }
+    }
+    if (r2mLayoutPlan(l, prio, nEnt, slots) != SUCCESS) {
+        fprintf(stderr, "ERROR: layout: failed to plan\n");
+        exit(1);
+    }
+    memset(tbl, 0xff, nSlots * sizeof(*tbl));
+    for (i = 0; i < nEnt; ++i) {
+        tbl[slots[i]] = prio[i];
+    }
+
+    t = 0;
+    for (i = nPlan; i < nRule; ++i) {
+        u32 p = 2 * (rnd(&seed) % nPlan) + 1;
+
+        for (k = r2mCount(r[i].st, r[i].end); k; --k) {
+            for (s = 0; s < nSlots; ++s) {
+                shifts += (tbl[s] != ~0U && tbl[s] > p);
+            }
+            t0 = now();
+            if (r2mLayoutInsert(l, p, mv, elementsOf(mv), &nMv, &slot) !=
+                SUCCESS) {
+                fprintf(stderr, "ERROR: layout: no room for rule %u\n", i);
+                exit(1);
+            }
+            t += now() - t0;
+            for (s = 0; s < nMv; ++s) {
+                tbl[mv[s].to] = tbl[mv[s].from];
+                tbl[mv[s].from] = ~0U;
+            }
+            tbl[slot] = p;
+            moves += nMv;
+            ++nIns;
+        }
+    }
+    for (k = ~0U, s = 0; s < nSlots; ++s) {
+        if (tbl[s] == ~0U) {
+            continue;
+        }
+        if (k != ~0U && tbl[s] < k) {
+            fprintf(stderr, "ERROR: layout: slot %u out of order\n", s);
+            exit(1);
+        }
+        k = tbl[s];
+    }
+    printf("  layout   %u slots, %u entries inserted: %.2f moves/entry"
+           " (packed: %.1f) %.2f us/entry\n", nSlots, nIns,
+           (double)moves / nIns, (double)shifts / nIns, t / nIns / 1e3);
+    r2mLayoutDestroy(l);
+    free(tbl);
+    free(slots);
+    free(prio);
+}
+
+static void
+run (const char *title, const range *r, u32 n, u32 rounds, u32 nThr,
+     const engine *e, u32 nEng)
+{
+    u32 i;
+
+    for (i = 0; i < nEng; ++i) {
+        if (verify(r, n, e + i) != SUCCESS) {
+            exit(1);
+        }
+    }
+    printf("%s (%u ranges, best of %u rounds)\n", title, n, rounds);
+    for (i = 0; i < nEng; ++i) {
+        bench(r, n, rounds, e + i);
+    }
+    benchArena(r, n, rounds);
+    benchMt(r, n, rounds, nThr);
+    benchBatch(r, n, rounds);
+    benchCount(r, n, rounds);
+    benchMatch(r, n, rounds);
+    benchPack(r, n, rounds);
+    benchLayout(r, n);
+}
+
+int
+main (int argc, char *argv[])
+{
+    u32 n      = (argc > 1) ? strtoul(argv[1], NULL, 0) : DEF_NRANGES;
+    u32 rounds = (argc > 2) ? strtoul(argv[2], NULL, 0) : DEF_NROUNDS;
+    u32 nThr   = (argc > 3) ? strtoul(argv[3], NULL, 0) :
+                              sysconf(_SC_NPROCESSORS_ONLN);
+    r2mPortTbl *tbl;
+    range *r;
+    double t0;
+
+
+    if (nThr > MAX_THREADS) {
+        nThr = MAX_THREADS;
+    }
+    if (n == 0 || rounds == 0 || nThr == 0) {
+        fprintf(stderr, "Usage: r2mbench [<nranges> [<rounds>"
+                " [<threads>]]]\n");
+        exit(1);
+    }
+    if ((r = malloc(n * sizeof(*r))) == NULL) {
+        fprintf(stderr, "ERROR: out of memory\n");
+        exit(1);
+    }
+    t0 = now();
+    if ((tbl = r2mPortTblCreate()) == NULL) {
+        fprintf(stderr, "ERROR: out of memory\n");
+        exit(1);
+    }
+    printf("port tables: %zu bytes, built in %.2f ms\n",
+           r2mPortTblSize(), (now() - t0) / 1e6);
+
+    {
+        const engine e32[] = {
+            { "loop", convEngine, &engLoop },
+            { "clz",  convEngine, &engClz },
+        };
+        const engine e16[] = {
+            { "loop", convEngine, &engLoop },
+            { "clz",  convEngine, &engClz },
+            { "port", convPort,   tbl },
+        };
+
+        mkRanges(r, n, 0x12345678, ~0);
+        run("random 32-bit ranges", r, n, rounds, nThr, e32,
+            elementsOf(e32));
+        mkWorst(r, n);
+        run("worst case [1, 2^32-2]", r, n, rounds, nThr, e32,
+            elementsOf(e32));
+        mkAligned(r, n, 0x12345678);
+        run("prefix-aligned ranges", r, n, rounds, nThr, e32,
+            elementsOf(e32));
+        mkRanges(r, n, 0x12345678, 0xffff);
+        run("random 16-bit (port) ranges", r, n, rounds, nThr, e16,
+            elementsOf(e16));
+    }
+    r2mPortTblDestroy(tbl);
+    free(r);
+    return 0;
+}
@@ -24,303 +24,1273 @@
  * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
  */
 
-#include <assert.h>
-#include <netinet/in.h>
-#include <arpa/inet.h>
-#include <regex.h>
-#include "local_types.h"
+#include <strings.h>
+#include "cli.h"
+#include "r2m_bits.h"
+
+const char *actName[] = { "Accept", "Reject" };
 
 enum {
-    MAXENT  = 32,
+    OUTBUF_SIZE = 256 * 1024,
 };
 
-typedef struct tcamEnt_ {
-    u32 patt;
-    u32 mask;
-} tcamEnt;
+static char outBuf[OUTBUF_SIZE];
 
-typedef struct aclRule_ {
-    u32     nEnt;               /* number of TCAM entries */
-    tcamEnt ent[MAXENT];        /* pattern/mask */
-} aclRule;
+#ifdef R2M_STATS
+static double statsStartNs;
 
+static double
+nowNs (void)
+{
+    struct timespec ts;
 
-bool isNumber (char *s);
-int  mask2plen (u32 mask);
-int  ipv4a2h (char *s, u32 *addr);
-void printEntry (u32 patt, u32 mask);
-void printEntries (aclRule* p);
-int  range2masks (u32 st, u32 end, aclRule* pRule);
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+#endif /* R2M_STATS */
 
 
 /**
- * @name  isNumber
+ * @name  parseNumber
  *
- * @brief Checks if the parameter (string) is a number or not
+ * @brief Converts a number or an IPv4 address into the host order integer
  *
- * @param[in] s Pointer to a string that may represent a number
+ * @param[in]  s   String representing a number or an IPv4 address
+ * @param[out] val Pointer to the converted value
+ * @param[in]  o   Options (-ipv4 makes every token an IPv4 address)
  *
- * @retval TRUE  's' is a number (decimal or hexadecimal)
- * @retval FALSE 's' is not a number
+ * @retval SUCCESS '*val' has the converted value
+ * @retval < 0     's' is neither a number nor an IPv4 address
  */
-bool
-isNumber (char *s)
+int
+parseNumber (char *s, u32 *val, const cliOpts *o)
 {
-    char *pRstr = "^(0x|)[0-9A-Fa-f]+$";
-    static regex_t re;
-    static bool isCompiled = FALSE;
+    return r2mParseNum(s, strlen(s), o->parseFlags, val, NULL);
+}
 
-    if (!isCompiled) {
-        if (regcomp(&re, pRstr, REG_EXTENDED | REG_NOSUB)) {
-            return FALSE;
-        }
-        isCompiled = TRUE;
+/**
+ * @name  parseWide
+ *
+ * @brief Converts a number or an address of -width bits
+ *        (see r2mParseWide())
+ *
+ * @param[in]  s   String representing a number or an address
+ * @param[out] val Pointer to the converted value
+ * @param[in]  o   Options
+ *
+ * @retval SUCCESS '*val' has the converted value
+ * @retval < 0     Otherwise
+ */
+int
+parseWide (char *s, r2mU128 *val, const cliOpts *o)
+{
+    return r2mParseWide(s, strlen(s), o->parseFlags, o->width, val);
+}
+
+/**
+ * @name  parseAction
+ *
+ * @brief Converts an action keyword into ACT_ACCEPT or ACT_REJECT
+ *
+ * @param[in]  s   "accept", "reject" or NULL (accept)
+ * @param[out] act Pointer to the converted action
+ *
+ * @retval SUCCESS '*act' has the action
+ * @retval FAILURE 's' is not an action keyword
+ */
+int
+parseAction (char *s, int *act)
+{
+    if (s == NULL) {
+        *act = ACT_ACCEPT;
+        return SUCCESS;
+    }
+    return parseActionSpan(s, strlen(s), act);
+}
+
+static inline bool
+isKeyword (const char *s, size_t len, const char *kw)
+{
+    return strlen(kw) == len && strncasecmp(s, kw, len) == 0;
+}
+
+/**
+ * @name  parseActionSpan
+ *
+ * @brief Same as parseAction() but for 'len' bytes that need not be
+ *        NUL terminated
+ *
+ * @param[in]  s   Action keyword
+ * @param[in]  len Length of 's'
+ * @param[out] act Pointer to the converted action
+ *
+ * @retval SUCCESS '*act' has the action
+ * @retval FAILURE 's' is not an action keyword
+ */
+int
+parseActionSpan (const char *s, size_t len, int *act)
+{
+    if (isKeyword(s, len, "accept") || isKeyword(s, len, "permit")) {
+        *act = ACT_ACCEPT;
+        return SUCCESS;
+    }
+    if (isKeyword(s, len, "reject") || isKeyword(s, len, "deny")) {
+        *act = ACT_REJECT;
+        return SUCCESS;
+    }
+    return FAILURE;
+}
+
+/**
+ * @name  emit
+ *
+ * @brief Writes a converted rule out in the selected format
+ *
+ * @param[in] c     Conversion context
+ * @param[in] label Print the action and the range before the entries
+ *                  (text only)
+ * @param[in] st    Number that the range of the rule starts
+ * @param[in] end   Number that the range of the rule ends
+ * @param[in] act   ACT_ACCEPT or ACT_REJECT
+ * @param[in] seq   Index of the rule in the input record
+ * @param[in] nSeq  Number of rules of the input record
+ * @param[in] p     Entries of the rule
+ */
+void
+emit (cliCtx *c, bool label, u32 st, u32 end, int act, int seq, int nSeq,
+      const aclRule *p)
+{
+    if (c->o->binary) {
+        r2mBinPutRule(&c->bin, st, end, act, seq, nSeq, p);
+        return;
+    }
+    if (label) {
+        r2mOutRange(&c->out, actName[act], st, end);
+    }
+    r2mOutRule(&c->out, p, !c->o->brief);
+}
+
+/**
+ * @name  count
+ *
+ * @brief Writes "<start> <end> <entries>" for a range without making
+ *        the entries. With -optimize, the reject and accept entries
+ *        of the better layout are appended.
+ *
+ * @param[in] c     Conversion context
+ * @param[in] start Number that the range starts
+ * @param[in] end   Number that the range ends
+ */
+void
+count (cliCtx *c, u32 start, u32 end)
+{
+    u32 n, nRej = 0, nAcc;
+
+    STATS_PHASE(c, PH_DECOMP);
+    if (c->o->minimize) {
+        n = r2mCountMin(32, start, end);
+    } else if (c->o->optimize) {
+        n = r2mCountOpt(start, end, &nRej, &nAcc);
+    } else {
+        n = r2mCount(start, end);
+    }
+    STATS_RANGE(c, n, (nRej) ? 2 : 1);
+    STATS_PHASE(c, PH_EMIT);
+    c->total += n;
+    r2mOutU32(&c->out, start);
+    r2mOutStr(&c->out, " ");
+    r2mOutU32(&c->out, end);
+    r2mOutStr(&c->out, " ");
+    r2mOutU32(&c->out, n);
+    if (c->o->optimize && !c->o->minimize) {
+        r2mOutStr(&c->out, " ");
+        r2mOutU32(&c->out, nRej);
+        r2mOutStr(&c->out, " ");
+        r2mOutU32(&c->out, nAcc);
     }
-    if (regexec(&re, s, 0, NULL, 0)) {
-        return FALSE;
+    r2mOutStr(&c->out, "\n");
+}
+
+/**
+ * @name  decompose
+ *
+ * @brief Converts a range with the engine selected by -engine. The
+ *        entries are allocated from the arena of the context.
+ *
+ * @param[in]  c     Conversion context
+ * @param[in]  st    Number that the range starts
+ * @param[in]  end   Number that the range ends
+ * @param[out] pRule Converted result
+ *
+ * @retval See range2masks()
+ */
+int
+decompose (cliCtx *c, u32 st, u32 end, aclRule *pRule)
+{
+    int rc;
+
+    if (!c->o->portTbl) {
+        return range2masksArena(c->o->engine, st, end, &c->arena, pRule);
+    }
+    if ((rc = r2mRuleAlloc(&c->arena, pRule, MAXENT)) != SUCCESS) {
+        return rc;
     }
-    return TRUE;
+    rc = range2entsPort(c->o->portTbl, st, end, pRule->ent, pRule->maxEnt,
+                        &pRule->nEnt);
+    r2mRuleTrim(&c->arena, pRule);
+    return rc;
 }
 
 /**
- * @name  mask2plen
+ * @name  solveMin
  *
- * @brief Converts a netmask into a prefix length
+ * @brief Converts a range into the minimum first-match layout
+ *        (-minimize); one rule per level of the layout
  *
- * @param[in] mask Netmask
+ * @param[in]  c     Conversion context
+ * @param[in]  start Number that the range starts
+ * @param[in]  end   Number that the range ends
+ * @param[out] m     Result
  *
- * @retval >= 0 prefix length representing 'mask'
- * @retval < 0  'mask' is not contiguous
+ * @retval See r2mOptimize()
  */
 int
-mask2plen (u32 mask)
+solveMin (cliCtx *c, u32 start, u32 end, cliMemo *m)
 {
-    int plen = 32;
-    int m = ~0;
+    tcamEnt *ent;
+    u8 inv[MAXENT];
+    cliPart *p = NULL;
+    u32 i, n, hi;
 
-    while (plen > 0) {
-        if (m == mask) {
-            return plen;
+
+    STATS_PHASE(c, PH_OPT);
+    m->nPart = 0;
+    if ((ent = r2mArenaAlloc(&c->arena, MAXENT * sizeof(*ent))) == NULL) {
+        return m->rc = R2M_EFAIL;
+    }
+    m->rc = r2mOptimize(32, start, end, ent, inv, MAXENT, &n);
+    if (m->rc != SUCCESS) {
+        return m->rc;
+    }
+    r2mArenaTrim(&c->arena, ent, n * sizeof(*ent));
+    for (i = 0; i < n; ++i) {
+        hi = ent[i].patt | ~ent[i].mask;
+        if (!p || p->inv != inv[i]) {
+            p = m->part + m->nPart++;
+            p->st   = ent[i].patt;
+            p->end  = hi;
+            p->inv  = inv[i];
+            p->rule.nEnt   = 0;
+            p->rule.maxEnt = 0;
+            p->rule.ent    = ent + i;
+        }
+        if (ent[i].patt < p->st) {
+            p->st = ent[i].patt;
+        }
+        if (hi > p->end) {
+            p->end = hi;
         }
-        m <<= 1;
-        --plen;
+        ++p->rule.nEnt;
+        ++p->rule.maxEnt;
     }
-    return plen;
+    return m->rc;
 }
 
 /**
- * @name  ipv4a2h
+ * @name  solve
  *
- * @brief Converts an IPv4 dotted decimal notation to the host order integer
+ * @brief Converts a range into TCAM entries. With -optimize,
+ *        [0, start-1] (!act) + [0, end] (act) is tried as well.
  *
- * @param[in]  s    Sgring representing an IPv4 address (w/o prefix length)
- * @param[out] addr Pointer to the converted IPv4 address
+ * @param[in]  c     Conversion context
+ * @param[in]  start Number that the range starts
+ * @param[in]  end   Number that the range ends
+ * @param[out] m     Result
  *
- * @retval FAILURE (-1) Wrong IPv4 address format, or 'addr' is NULL
- * @retval SUCCESS (0)  '*addr' has the IPv4 address in the host order.
+ * @retval See range2masks()
  */
 int
-ipv4a2h (char *s, u32 *addr)
+solve (cliCtx *c, u32 start, u32 end, cliMemo *m)
 {
-    struct sockaddr_in sa;
+    aclRule *rules = c->rules;
+    cliPart *p = m->part;
 
-    if (addr == NULL) {
-        return FAILURE;
+
+    if (c->o->minimize) {
+        return solveMin(c, start, end, m);
     }
-    if (inet_pton(AF_INET, s, &(sa.sin_addr.s_addr)) > 0) {
-        *addr = ntohl(sa.sin_addr.s_addr);
-        return SUCCESS;
+    m->nPart = 1;
+    p[0].st  = start;
+    p[0].end = end;
+    p[0].inv = FALSE;
+    if ((m->rc = decompose(c, start, end, &p[0].rule)) != SUCCESS) {
+        return m->rc;
     }
-    return FAILURE;
+    if (c->o->optimize && start != 0) {
+        /*
+         * Make two sets of TCAM entries and choose the better one.
+         * No optimization if start is 0: 'start - 1' is negative.
+         */
+        STATS_PHASE(c, PH_OPT);
+        if ((m->rc = decompose(c, 0, start - 1, rules)) != SUCCESS ||
+            (m->rc = decompose(c, 0, end, rules + 1)) != SUCCESS) {
+            return m->rc;
+        }
+        if ((rules[0].nEnt + rules[1].nEnt) < p[0].rule.nEnt) {
+            /* the direct entries stay in the arena until the next record */
+            m->nPart = 2;
+            p[0].st   = 0;
+            p[0].end  = start - 1;
+            p[0].inv  = TRUE;
+            p[0].rule = rules[0];
+            p[1].st   = 0;
+            p[1].end  = end;
+            p[1].inv  = FALSE;
+            p[1].rule = rules[1];
+        }
+    }
+    return m->rc;
 }
 
+/**
+ * @name  memoize
+ *
+ * @brief Copies a result into a cache slot
+ *
+ * @param[out] dst Cache slot
+ * @param[in]  src Result (entries in the arena)
+ * @param[in]  rc  Return code of solve()
+ */
 void
-printPrefix (u32 patt, u32 mask)
+memoize (cliCached *dst, const cliMemo *src, int rc)
 {
-    printf("%d.%d.%d.%d/%d\n",
-           (patt >> 24),
-           (patt >> 16) & 0xff,
-           (patt >>8) & 0xff,
-           patt & 0xff,
-           mask2plen(mask));
+    tcamEnt *ent = dst->ent;
+    cliPart *p;
+    u32 i;
+
+    dst->m.rc    = rc;
+    dst->m.nPart = (rc == SUCCESS) ? src->nPart : 0;
+    for (i = 0; i < dst->m.nPart; ++i) {
+        p  = dst->m.part + i;
+        *p = src->part[i];
+        p->rule.maxEnt = p->rule.nEnt;
+        p->rule.ent    = ent;
+        memcpy(ent, src->part[i].rule.ent, p->rule.nEnt * sizeof(*ent));
+        ent += p->rule.nEnt;
+    }
 }
 
-void
-printEntry (u32 patt, u32 mask)
+/**
+ * @name  verify
+ *
+ * @brief Checks a result with r2mVerify(). The rules of a result of
+ *        several rules are checked as a first match layout.
+ *
+ * @param[in] c     Conversion context
+ * @param[in] start Number that the range starts
+ * @param[in] end   Number that the range ends
+ * @param[in] m     Result
+ *
+ * @retval See r2mVerify()
+ */
+static int
+verify (cliCtx *c, u32 start, u32 end, const cliMemo *m)
 {
-    u32 st;
-    u32 end;
-
-    st  = patt;
-    end = patt | ((~patt) & (~mask));
-    printf("patt:   %08x (%d - %d)\n", patt, st, end);
-    printf("mask:   %08x\n", mask);
-    printf("prefix: %d.%d.%d.%d/%d\n",
-           (patt >> 24),
-           (patt >> 16) & 0xff,
-           (patt >>8) & 0xff,
-           patt & 0xff,
-           mask2plen(mask));
+    const cliPart *p = m->part;
+    tcamEnt *ent;
+    u8 *inv;
+    u32 i, k, n = 0;
+
+    if (m->nPart == 1 && !p->inv) {
+        return r2mVerify(p->rule.ent, NULL, p->rule.nEnt, start, end,
+                         &c->arena, NULL);
+    }
+    for (i = 0; i < m->nPart; ++i) {
+        n += m->part[i].rule.nEnt;
+    }
+    ent = r2mArenaAlloc(&c->arena, n * sizeof(*ent));
+    inv = r2mArenaAlloc(&c->arena, n);
+    if (!ent || !inv) {
+        return R2M_EFAIL;
+    }
+    for (i = n = 0; i < m->nPart; ++i, ++p) {
+        for (k = 0; k < p->rule.nEnt; ++k, ++n) {
+            ent[n] = p->rule.ent[k];
+            inv[n] = p->inv;
+        }
+    }
+    return r2mVerify(ent, inv, n, start, end, &c->arena, NULL);
 }
 
-void
-printEntries (aclRule* p)
+/**
+ * @name  resolve
+ *
+ * @brief Converts a range into TCAM entries (w/o writing them out).
+ *        With -cache, the result of a range converted before is
+ *        reused.
+ *
+ * @param[in] c     Conversion context
+ * @param[in] start Number that the range starts
+ * @param[in] end   Number that the range ends
+ *
+ * @retval Result (in the context or in the cache; valid until the
+ *         next conversion). m->rc tells if it succeeded.
+ */
+cliMemo *
+resolve (cliCtx *c, u32 start, u32 end)
 {
-    int i;
+    r2mCacheKey key;
+    cliMemo *m = &c->memo;
 
 
-    if (!p) {
-        return;
+    /*
+     * Compare the number of TCAM entries between the following rules:
+     *  1. start:end (act)
+     *  2. Combination of:
+     *      [0 ... start-1] (!act)
+     *      [0 ... end]     (act)
+     * then choose the better one.
+     */
+    STATS_PHASE(c, PH_DECOMP);
+    r2mArenaReset(&c->arena);
+    if (c->cache) {
+        key.st    = start;
+        key.end   = end;
+        key.width = 32;
+        key.flags = c->o->optimize | (c->o->minimize << 1);
+        if ((m = r2mCacheGet(c->cache, &key)) == NULL) {
+            m = r2mCachePut(c->cache, &key);
+            memoize((cliCached *)m, &c->memo, solve(c, start, end, &c->memo));
+        }
+    } else {
+        solve(c, start, end, m);
     }
-    for (i = 0; i < p->nEnt; ++i) {
-        printPrefix(p->ent[i].patt, p->ent[i].mask);
+    if (c->o->verify && m->rc == SUCCESS && verify(c, start, end, m) !=
+        SUCCESS) {
+        c->memo.rc    = R2M_EVERIFY;
+        c->memo.nPart = 0;
+        return &c->memo;
     }
-    puts("\n");
-    for (i = 0; i < p->nEnt; ++i) {
-        printEntry(p->ent[i].patt, p->ent[i].mask);
+#ifdef R2M_STATS
+    if (c->o->stats && m->rc == SUCCESS) {
+        u32 i, nEnt = 0;
+
+        for (i = 0; i < m->nPart; ++i) {
+            nEnt += m->part[i].rule.nEnt;
+        }
+        STATS_RANGE(c, nEnt, m->nPart);
     }
+#endif /* R2M_STATS */
+    return m;
 }
 
 /**
- * @name  range2masks
+ * @name  convert
  *
- * @brief Convert an arbitrary range into a set of TCAM entries 
- *        (st <= range <= end). 'end' must be < 0xffffffff.
+ * @brief Converts a range into TCAM entries and writes them out
  *
- * @param[in]  st    Number that the range starts
- * @param[in]  end   Number that the range ends
- * @param[out] pRule Converted result. An array of (pattern, mask)
+ * @param[in] c     Conversion context (see resolve()). A result of
+ *                  several rules is always labeled.
+ * @param[in] start Number that the range starts
+ * @param[in] end   Number that the range ends
+ * @param[in] act   ACT_ACCEPT or ACT_REJECT
+ * @param[in] label Print the action and the range before the entries
  *
  * @retval SUCCESS The range is successfully converted
- * @retval FAILURE Otherwise
+ * @retval < 0     Error code returned by range2masks()
  */
 int
-range2masks (u32 st, u32 end, aclRule* pRule)
+convert (cliCtx *c, u32 start, u32 end, int act, bool label)
 {
-    u32 patt;
-    u32 mask;
+    cliMemo *m;
+    cliPart *p;
     u32 i;
+    int rc;
 
 
-    if (!pRule) {
-        return -1;
+    if (c->o->count) {
+        count(c, start, end);
+        return SUCCESS;
     }
-    if (end == ~0) {
-        if (st != 0) {
-            fprintf(stderr,
-                    "end too big: must be < %u (0x%x)\n", end, end);
-            return FAILURE;
+    if ((m = resolve(c, start, end))->rc != SUCCESS) {
+        return m->rc;
+    }
+    STATS_PHASE(c, PH_EMIT);
+    for (i = 0; i < m->nPart; ++i) {
+        p = m->part + i;
+        if (c->intern) {
+            rc = dedupEmit(c, label || m->nPart > 1, p->st, p->end,
+                           act ^ p->inv, &p->rule);
+            if (rc != SUCCESS) {
+                return rc;
+            }
+            continue;
         }
+        emit(c, label || m->nPart > 1, p->st, p->end, act ^ p->inv, i,
+             m->nPart, &p->rule);
     }
+    return SUCCESS;
+}
+
+/**
+ * @name  convertWide
+ *
+ * @brief Converts a range of -width bit keys into TCAM entries and
+ *        writes them out (text only)
+ *
+ * @param[in] c     Conversion context
+ * @param[in] start Number that the range starts
+ * @param[in] end   Number that the range ends ([0, 2^W - 1] is fine)
+ * @param[in] act   ACT_ACCEPT or ACT_REJECT
+ * @param[in] label Print the action and the range before the entries
+ *
+ * @retval SUCCESS The range is successfully converted
+ * @retval < 0     Error code returned by range2entsWide()
+ */
+int
+convertWide (cliCtx *c, r2mU128 start, r2mU128 end, int act, bool label)
+{
+    u32 maxEnt = R2M_MAXENT_W(c->o->width);
+    u32 chunk = c->o->dirpe;
+    tcamEntW *ent;
+    u32 nEnt, i;
+    int rc;
 
-    pRule->nEnt = 0;
-    for (patt = end; patt >= st; --patt) {
 
-        if (pRule->nEnt >= elementsOf(pRule->ent)) {
-            fprintf(stderr,
-                   "not enough memory (%d:%d)\n", st, end);
+    r2mArenaReset(&c->arena);
+    if (chunk) {
+        maxEnt = R2M_MAXENT_DIRPE(c->o->width, chunk);
+    }
+    if ((ent = r2mArenaAlloc(&c->arena, maxEnt * sizeof(*ent))) == NULL) {
+        return R2M_EFAIL;
+    }
+    if (chunk) {
+        /* -width is at most 32 bits */
+        rc = range2entsDirpe(c->o->width, chunk, start, end, ent, maxEnt,
+                             &nEnt);
+    } else {
+        rc = range2entsWide(c->o->width, start, end, ent, maxEnt, &nEnt);
+    }
+    if (rc != SUCCESS) {
+        return rc;
+    }
+    if (label) {
+        r2mOutRangeWide(&c->out, actName[act], start, end);
+    }
+    if (!chunk) {
+        r2mOutRuleWide(&c->out, c->o->width, ent, nEnt, !c->o->brief);
+        return SUCCESS;
+    }
+    for (i = 0; i < nEnt; ++i) {
+        r2mOutTernaryW(&c->out, ent[i].patt, ent[i].mask,
+                       r2mDirpeWidth(c->o->width, chunk), (1U << chunk) - 1);
+    }
+    return SUCCESS;
+}
+
+/**
+ * @name  splitFields
+ *
+ * @brief Splits a record into whitespace separated fields
+ *
+ * @param[in]  line   Record (modified)
+ * @param[out] tok    Fields
+ * @param[in]  maxTok Number of elements of 'tok'. A record with more
+ *                    fields returns 'maxTok'.
+ *
+ * @retval Number of fields (0: empty line or comment)
+ */
+int
+splitFields (char *line, char **tok, int maxTok)
+{
+    char *save;
+    int n = 0;
+
+    tok[n] = strtok_r(line, " \t\r\n", &save);
+    while (tok[n] && ++n < maxTok) {
+        tok[n] = strtok_r(NULL, " \t\r\n", &save);
+    }
+    if (n == 0 || tok[0][0] == '#') {
+        return 0;
+    }
+    return n;
+}
+
+/**
+ * @name  processLine
+ *
+ * @brief Converts a "start end [action]" record
+ *
+ * Empty lines and lines starting with '#' are skipped.
+ * A record that cannot be parsed is reported.
+ *
+ * @param[in] c       Conversion context
+ * @param[in] line    Record (modified)
+ * @param[in] lineNum Line number of the record (for error messages)
+ * @param[in] name    Name of the input (for error messages)
+ *
+ * @retval SUCCESS The record is converted or skipped
+ * @retval FAILURE Otherwise
+ */
+int
+processLine (cliCtx *c, char *line, u32 lineNum, const char *name)
+{
+    char   *tok[R2M_MAXFIELD + 2];
+    u32     start, end;
+    int     act;
+    int     st;
+    int     n;
+
+
+    if ((n = splitFields(line, tok, elementsOf(tok))) == 0) {
+        return SUCCESS;
+    }
+    if (c->o->nFields) {
+        return convertMulti(c, tok, n, lineNum, name);
+    }
+    if (c->o->delta) {
+        u32 oldSt, oldEnd;
+
+        if (n < 4 || n > 5) {
+            fprintf(stderr, "ERROR: %s:%u: wrong number of fields\n",
+                    name, lineNum);
             return FAILURE;
         }
+        if (parseNumber(tok[0], &oldSt, c->o) != SUCCESS ||
+            parseNumber(tok[1], &oldEnd, c->o) != SUCCESS ||
+            parseNumber(tok[2], &start, c->o) != SUCCESS ||
+            parseNumber(tok[3], &end, c->o) != SUCCESS ||
+            parseAction((n > 4) ? tok[4] : NULL, &act) != SUCCESS) {
+            goto badRecord;
+        }
+        st = convertDelta(c, oldSt, oldEnd, start, end, act);
+        if (st != SUCCESS) {
+            fprintf(stderr, "ERROR: %s:%u: failed to update %u - %u to"
+                    " %u - %u: %s\n", name, lineNum, oldSt, oldEnd,
+                    start, end, r2mStrerror(st));
+            return FAILURE;
+        }
+        return SUCCESS;
+    }
+    if (n < 2 || n > 3) {
+        fprintf(stderr, "ERROR: %s:%u: wrong number of fields\n",
+                name, lineNum);
+        return FAILURE;
+    }
+    if (parseAction((n > 2) ? tok[2] : NULL, &act) != SUCCESS) {
+        goto badRecord;
+    }
+    if (c->o->width) {
+        r2mU128 wStart, wEnd;
 
-        /* First, find the first 0 from LSB in 'patt'
-           while clearing 1s.
-         */
-        mask = ~0;
-        i    = 1;
-        while (i & patt) {
-            patt ^=  i;         /* clear log(i)-th bit */
-            i    <<= 1;
-            mask <<= 1;         /* mask = (~0) << log(i) */
+        if (parseWide(tok[0], &wStart, c->o) != SUCCESS ||
+            parseWide(tok[1], &wEnd, c->o) != SUCCESS) {
+            goto badRecord;
         }
+        st = convertWide(c, wStart, wEnd, act, TRUE);
+        if (st != SUCCESS) {
+            fprintf(stderr, "ERROR: %s:%u: failed to convert %s - %s: %s\n",
+                    name, lineNum, tok[0], tok[1], r2mStrerror(st));
+            return FAILURE;
+        }
+        return SUCCESS;
+    }
+    if (parseNumber(tok[0], &start, c->o) != SUCCESS ||
+        parseNumber(tok[1], &end, c->o) != SUCCESS) {
+        goto badRecord;
+    }
+    st = convert(c, start, end, act, TRUE);
+    if (st != SUCCESS) {
+        fprintf(stderr, "ERROR: %s:%u: failed to convert %u - %u: %s\n",
+                name, lineNum, start, end, r2mStrerror(st));
+        return FAILURE;
+    }
+    return SUCCESS;
 
-        /* Second, if 'patt' becomes too small,
-           retract 'patt' until 'patt' >= 'st'.
-         */
-        while (patt < st) {
-            i    >>= 1;
-            patt |= i;          /* set log(i)-th bit */
-            mask |= i;          /* mask = (~0) << log(i) */
-        }
-        pRule->ent[pRule->nEnt].patt = patt;
-        pRule->ent[pRule->nEnt].mask = mask;
-        ++pRule->nEnt;
-        if (patt == 0) {        /* prevent infinite loop */
+badRecord:
+    fprintf(stderr, "ERROR: %s:%u: failed to parse the record\n",
+            name, lineNum);
+    return FAILURE;
+}
+
+static inline bool
+isBlank (char ch)
+{
+    return ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n';
+}
+
+/**
+ * @name  parseSpan
+ *
+ * @brief Parses a plain 32-bit "start end [action]" record in place
+ *
+ * @param[in]  o     Options
+ * @param[in]  line  Record (w/o the newline; not modified)
+ * @param[in]  len   Length of the record
+ * @param[out] start Number that the range starts
+ * @param[out] end   Number that the range ends
+ * @param[out] act   ACT_ACCEPT or ACT_REJECT
+ *
+ * @retval 1       The record is parsed
+ * @retval 0       Empty line or comment
+ * @retval FAILURE The record does not parse (processLine() tells why)
+ */
+int
+parseSpan (const cliOpts *o, const char *line, size_t len, u32 *start,
+           u32 *end, int *act)
+{
+    const char *last = line + len;
+    const char *tok[4];
+    size_t tokLen[4];
+    int n = 0;
+
+    while (n < elementsOf(tok)) {
+        while (line < last && isBlank(*line)) {
+            ++line;
+        }
+        if (line == last) {
+            break;
+        }
+        tok[n] = line;
+        while (line < last && !isBlank(*line)) {
+            ++line;
+        }
+        tokLen[n] = line - tok[n];
+        ++n;
+    }
+    if (n == 0 || tok[0][0] == '#') {
+        return 0;
+    }
+    *act = ACT_ACCEPT;
+    if (n < 2 || n > 3 ||
+        r2mParseNum(tok[0], tokLen[0], o->parseFlags, start, NULL) !=
+        SUCCESS ||
+        r2mParseNum(tok[1], tokLen[1], o->parseFlags, end, NULL) !=
+        SUCCESS ||
+        (n > 2 && parseActionSpan(tok[2], tokLen[2], act) != SUCCESS)) {
+        return FAILURE;
+    }
+    return 1;
+}
+
+/**
+ * @name  processSpan
+ *
+ * @brief Same as processLine() but the record is not modified, so it
+ *        can be converted where it is (e.g. in an mmap()ed file).
+ *        A plain 32-bit "start end [action]" record is tokenized in
+ *        place; any other record (or one that does not parse) is
+ *        given to processLine() in a copy.
+ *
+ * @param[in] c       Conversion context
+ * @param[in] line    Record (w/o the newline)
+ * @param[in] len     Length of the record
+ * @param[in] lineNum Line number of the record (for error messages)
+ * @param[in] name    Name of the input (for error messages)
+ *
+ * @retval SUCCESS The record is converted or skipped
+ * @retval FAILURE Otherwise
+ */
+int
+processSpan (cliCtx *c, const char *line, size_t len, u32 lineNum,
+             const char *name)
+{
+    char buf[256];
+    char *copy;
+    u32 start, end;
+    int act, st;
+
+
+    if (!c->o->nFields && !c->o->delta && !c->o->width) {
+        st = parseSpan(c->o, line, len, &start, &end, &act);
+        if (st == 0) {
+            return SUCCESS;
+        }
+        if (st > 0) {
+            st = convert(c, start, end, act, TRUE);
+            if (st != SUCCESS) {
+                fprintf(stderr, "ERROR: %s:%u: failed to convert %u - %u:"
+                        " %s\n", name, lineNum, start, end,
+                        r2mStrerror(st));
+                return FAILURE;
+            }
             return SUCCESS;
         }
+        /* processLine() reports it */
+    }
+    if (len < sizeof(buf)) {
+        copy = buf;
+    } else if ((copy = malloc(len + 1)) == NULL) {
+        fprintf(stderr, "ERROR: %s:%u: out of memory\n", name, lineNum);
+        return FAILURE;
+    }
+    memcpy(copy, line, len);
+    copy[len] = '\0';
+    st = processLine(c, copy, lineNum, name);
+    if (copy != buf) {
+        free(copy);
+    }
+    return st;
+}
+
+/**
+ * @name  batch
+ *
+ * @brief Converts newline-delimited "start end [action]" records
+ *        (see processLine()). A record that fails is skipped.
+ *
+ * @param[in] c    Conversion context
+ * @param[in] fp   Input stream
+ * @param[in] name Name of the input stream (for error messages)
+ *
+ * @retval SUCCESS All the records are successfully converted
+ * @retval FAILURE Otherwise
+ */
+int
+batch (cliCtx *c, FILE *fp, const char *name)
+{
+    char   *line = NULL;
+    size_t  size = 0;
+    u32     lineNum = 0;
+    int     rc = SUCCESS;
+
+
+    if (c->o->compact) {
+        return batchCompact(c, fp, name);
+    }
+    if (c->o->pipeline) {
+        return batchPipe(c, fp, NULL, 0, name);
+    }
+    if (c->o->nThreads > 1) {
+        return batchMt(c, fp, NULL, 0, name);
+    }
+    while (getline(&line, &size, fp) >= 0) {
+        STATS_PHASE(c, PH_PARSE);
+        if (processLine(c, line, ++lineNum, name) != SUCCESS) {
+            rc = FAILURE;
+        }
+        STATS_PHASE(c, PH_OTHER);
+    }
+    free(line);
+    return rc;
+}
+
+/**
+ * @name  finish
+ *
+ * @brief Flushes the output (and completes the binary header)
+ *
+ * @param[in] c Conversion context
+ *
+ * @retval SUCCESS The output is completely written
+ * @retval FAILURE Otherwise
+ */
+int
+finish (cliCtx *c)
+{
+    int rc;
+
+    STATS_PHASE(c, PH_EMIT);
+    if (c->o->count) {
+        r2mOutStr(&c->out, "total ");
+        r2mOutU64(&c->out, c->total);
+        r2mOutStr(&c->out, "\n");
+    }
+    if (c->intern) {
+        dedupFinish(c);
+    }
+    if (c->cache) {
+        r2mCacheStats st;
+
+        r2mCacheGetStats(c->cache, &st);
+        fprintf(stderr, "cache: %" PRIu64 " hits %" PRIu64 " misses %"
+                PRIu64 " evictions\n", st.hits + c->cacheSt.hits,
+                st.misses + c->cacheSt.misses,
+                st.evictions + c->cacheSt.evictions);
+    }
+    rc = (c->o->binary) ? r2mBinEnd(&c->bin) : r2mOutFlush(&c->out);
+    if (rc != SUCCESS) {
+        perror("ERROR: failed to write the output");
+        return FAILURE;
+    }
+#ifdef R2M_STATS
+    if (c->o->stats) {
+        u64 ticks = 0;
+        double ns;
+        u32 i;
+
+        STATS_PHASE(c, PH_OTHER);
+        for (i = 0; i < PH_MAX; ++i) {
+            ticks += c->stats.tsc[i];
+        }
+        ticks -= c->stats.workTsc;      /* the main thread only */
+        ns = nowNs() - statsStartNs;
+        statsPrint(&c->stats, c->o, ns, (ticks) ? ns / ticks : 0);
     }
+#endif /* R2M_STATS */
     return SUCCESS;
 }
 
+void
+usage (void)
+{
+    fprintf(stderr,
+            "Usage: range2masks [options] <start> <end>\n"
+            "       range2masks [options] -delta <old start> <old end>"
+            " <start> <end>\n"
+            "       range2masks [options] -serve <socket path>\n"
+            "       range2masks [options] -f <file | ->\n"
+            "Options:\n"
+            "  -optimize       try [0, start-1] + [0, end] as well\n"
+            "  -minimize       fewest entries using both actions"
+            " (first match)\n"
+            "  -multi <w,...>  -f records are '<st>-<end> ... [action]',"
+            " one range per\n"
+            "                  field of <w> bits; prints the cross"
+            " product entries\n"
+            "  -delta          -f records are '<old start> <old end>"
+            " <start> <end> [action]';\n"
+            "                  prints the entries to delete and to add\n"
+            "  -serve <path>   convert r2mSrvReq requests on a Unix"
+            " socket until\n"
+            "                  SIGINT/SIGTERM (see range2masks.h)\n"
+            "  -compact        merge the -f records ('start end [action"
+            " [priority]]',\n"
+            "                  first match) into disjoint ranges first\n"
+            "  -engine <name>  loop (default), clz or port (clz with"
+            " 16-bit tables)\n"
+            "  -ipv4           numbers w/o 0x are IPv4 addresses"
+            " (\"10\" is 10.0.0.0)\n"
+            "  -brief          print the prefixes only\n"
+            "  -dedup          print the IDs of the entries of each rule,"
+            " then each\n"
+            "                  distinct entry once ('<id> <prefix>')\n"
+            "  -verify         check the entries of every 32-bit range"
+            " (r2mVerify())\n"
+            "  -binary le|be   write binary records (see range2masks.h)\n"
+            "  -count          print '<start> <end> <entries>' only\n"
+            "                  (with -optimize: '... <reject> <accept>')\n"
+            "  -stats <fmt>    text or json: per-phase times and entry"
+            " counts on stderr\n"
+            "  -j <n>          convert -f input with <n> threads\n"
+            "  -pipeline       parse, convert and write -f input in"
+            " three threads\n"
+            "  -cache <n>      reuse the results of <n> ranges"
+            " (per thread)\n"
+            "  -dirpe <c>      DIRPE entries of <c>-bit chunks (keys:"
+            " r2mDirpeKey()),\n"
+            "                  one ternary string per entry; -width 8,"
+            " 16 or 32 (default)\n"
+            "  -width <w>      <w>-bit keys: 8, 16, 32, 64 or 128 (IPv6)\n"
+            "                  [0, 2^w-1] is accepted; text output only,"
+            " no -optimize\n");
+    exit(1);
+}
+
 int
 main (int argc, char *argv[])
 {
     u32 start, end;
-    aclRule rules[3]; /* [0]: orig, [1]: 0 - (start-1), [2]: 0 - end */
+    cliOpts opts = { .optimize = FALSE, .minimize = FALSE,
+                     .compact = FALSE, .engine = R2M_ENGINE_LOOP,
+                     .portTbl = NULL,
+                     .parseFlags = 0, .brief = FALSE, .binary = 0,
+                     .count = FALSE, .nThreads = 1, .cacheSize = 0,
+                     .width = 0, .nFields = 0, .delta = FALSE,
+                     .servePath = NULL, .stats = 0, .pipeline = FALSE,
+                     .verify = FALSE, .dirpe = 0, .dedup = FALSE };
+    cliCtx ctx;
+    char *file = NULL;
+    char *args[4];
+    int nArgs = 0;
+    FILE *fp;
     int st;
+    int i;
 
 
-    if (argc < 3) {
-        fprintf(stderr,
-                "Usage: range2ent <start> <end> [-optimize]\n");
+    for (i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-optimize") == 0) {
+            opts.optimize = TRUE;
+        } else if (strcmp(argv[i], "-minimize") == 0) {
+            opts.minimize = TRUE;
+        } else if (strcmp(argv[i], "-multi") == 0) {
+            if (++i >= argc || parseFieldWidths(argv[i], &opts) != SUCCESS) {
+                usage();
+            }
+        } else if (strcmp(argv[i], "-serve") == 0) {
+            if (++i >= argc) {
+                usage();
+            }
+            opts.servePath = argv[i];
+        } else if (strcmp(argv[i], "-delta") == 0) {
+            opts.delta = TRUE;
+        } else if (strcmp(argv[i], "-compact") == 0) {
+            opts.compact = TRUE;
+        } else if (strcmp(argv[i], "-dedup") == 0) {
+            opts.dedup = TRUE;
+        } else if (strcmp(argv[i], "-brief") == 0) {
+            opts.brief = TRUE;
+        } else if (strcmp(argv[i], "-ipv4") == 0) {
+            opts.parseFlags |= R2M_PARSE_ADDR;
+        } else if (strcmp(argv[i], "-engine") == 0) {
+            if (++i >= argc) {
+                usage();
+            }
+            if (strcmp(argv[i], "port") != 0) {
+                if (r2mEngineByName(argv[i], &opts.engine) != SUCCESS) {
+                    usage();
+                }
+                r2mPortTblDestroy(opts.portTbl);
+                opts.portTbl = NULL;
+            } else if (!opts.portTbl &&
+                       (opts.portTbl = r2mPortTblCreate()) == NULL) {
+                fprintf(stderr, "ERROR: out of memory\n");
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "-j") == 0) {
+            if (++i >= argc ||
+                (opts.nThreads = strtoul(argv[i], NULL, 10)) == 0 ||
+                opts.nThreads > MAX_THREADS) {
+                usage();
+            }
+        } else if (strcmp(argv[i], "-cache") == 0) {
+            if (++i >= argc ||
+                (opts.cacheSize = strtoul(argv[i], NULL, 10)) == 0) {
+                usage();
+            }
+        } else if (strcmp(argv[i], "-width") == 0) {
+            if (++i >= argc) {
+                usage();
+            }
+            opts.width = strtoul(argv[i], NULL, 10);
+            if (opts.width != 8 && opts.width != 16 && opts.width != 32 &&
+                opts.width != 64 && opts.width != 128) {
+                usage();
+            }
+        } else if (strcmp(argv[i], "-stats") == 0) {
+            if (++i >= argc) {
+                usage();
+            }
+            if (strcmp(argv[i], "text") == 0) {
+                opts.stats = STATS_TEXT;
+            } else if (strcmp(argv[i], "json") == 0) {
+                opts.stats = STATS_JSON;
+            } else {
+                usage();
+            }
+#ifndef R2M_STATS
+            fprintf(stderr, "ERROR: -stats: built without R2M_STATS\n");
+            exit(1);
+#endif /* R2M_STATS */
+        } else if (strcmp(argv[i], "-dirpe") == 0) {
+            if (++i >= argc ||
+                (opts.dirpe = strtoul(argv[i], NULL, 10)) == 0) {
+                usage();
+            }
+        } else if (strcmp(argv[i], "-verify") == 0) {
+            opts.verify = TRUE;
+        } else if (strcmp(argv[i], "-pipeline") == 0) {
+            opts.pipeline = TRUE;
+        } else if (strcmp(argv[i], "-count") == 0) {
+            opts.count = TRUE;
+        } else if (strcmp(argv[i], "-binary") == 0) {
+            if (++i >= argc) {
+                usage();
+            }
+            if (strcmp(argv[i], "le") == 0) {
+                opts.binary = R2M_BIN_LE;
+            } else if (strcmp(argv[i], "be") == 0) {
+                opts.binary = R2M_BIN_BE;
+            } else {
+                usage();
+            }
+        } else if (strcmp(argv[i], "-f") == 0) {
+            if (++i >= argc) {
+                usage();
+            }
+            file = argv[i];
+        } else if (nArgs < elementsOf(args)) {
+            args[nArgs++] = argv[i];
+        } else {
+            usage();
+        }
+    }
+
+    if (opts.count) {
+        opts.binary = 0;        /* counts are always text */
+    }
+    if (opts.dirpe) {
+        /* -dirpe goes through -width: the checks below cover it */
+        if (opts.width == 0) {
+            opts.width = 32;
+        }
+        if (r2mDirpeWidth(opts.width, opts.dirpe) == 0) {
+            fprintf(stderr, "ERROR: -dirpe %u: not supported for %u-bit"
+                    " keys (chunks must divide the width, at most 128"
+                    " encoded bits)\n", opts.dirpe, opts.width);
+            exit(1);
+        }
+    }
+    if (opts.nFields && (!file || opts.width || opts.compact ||
+                         opts.binary || opts.cacheSize)) {
+        fprintf(stderr, "ERROR: -multi converts -f records to text only (no"
+                " -width, -dirpe, -compact, -binary or -cache)\n");
+        exit(1);
+    }
+    if (opts.servePath && (file || nArgs || opts.nFields || opts.delta ||
+                           opts.width || opts.compact || opts.binary ||
+                           opts.count || opts.nThreads > 1)) {
+        fprintf(stderr, "ERROR: -serve takes no input (no -f, -multi, -delta,"
+                " -width, -dirpe, -compact, -binary,\n       -count or -j)\n");
         exit(1);
     }
-    if (isNumber(argv[1])) {
-        start = strtoul(argv[1], NULL, 0);
-    } else if (ipv4a2h(argv[1], &start) == FAILURE) {
-        fprintf(stderr, "ERROR: failed to parse %s\n", argv[1]);
+    if (opts.pipeline && (!file || opts.nFields || opts.delta ||
+                          opts.width || opts.compact || opts.count ||
+                          opts.nThreads > 1)) {
+        fprintf(stderr, "ERROR: -pipeline converts plain -f records only (no"
+                " -multi, -delta, -width, -dirpe,\n       -compact, -count or"
+                " -j)\n");
         exit(1);
     }
-    if (isNumber(argv[2])) {
-        end = strtoul(argv[2], NULL, 0);
-    } else if (ipv4a2h(argv[2], &end) == FAILURE) {
-        fprintf(stderr, "ERROR: failed to parse %s\n", argv[2]);
+    if (opts.delta && (opts.nFields || opts.width || opts.optimize ||
+                       opts.minimize || opts.compact || opts.binary ||
+                       opts.cacheSize)) {
+        fprintf(stderr, "ERROR: -delta writes text only (no -multi, -width,"
+                " -dirpe, -optimize, -minimize,\n       -compact, -binary or"
+                " -cache)\n");
         exit(1);
     }
-    rules[0].nEnt = 0;
-    rules[1].nEnt = 0;
-    rules[2].nEnt = 0;
+    if (opts.width && (opts.optimize || opts.minimize || opts.compact ||
+                       opts.binary || opts.count ||
+                       opts.cacheSize || opts.portTbl)) {
+        fprintf(stderr, "ERROR: %s converts to text only (no -optimize,"
+                " -minimize, -compact, -binary, -count,\n       -cache or"
+                " -engine port)\n", (opts.dirpe) ? "-dirpe" : "-width");
+        exit(1);
+    }
+    if (opts.dedup && (opts.nFields || opts.delta || opts.width ||
+                       opts.binary || opts.count || opts.servePath ||
+                       opts.pipeline || opts.nThreads > 1)) {
+        fprintf(stderr, "ERROR: -dedup converts plain records only (no"
+                " -multi, -delta, -width, -dirpe,\n       -binary, -count,"
+                " -serve, -pipeline or -j)\n");
+        exit(1);
+    }
+    ctx.o      = &opts;
+    ctx.total  = 0;
+    ctx.intern = NULL;
+    if (opts.dedup && (ctx.intern = r2mInternCreate(0)) == NULL) {
+        fprintf(stderr, "ERROR: out of memory\n");
+        exit(1);
+    }
+#ifdef R2M_STATS
+    memset(&ctx.stats, 0, sizeof(ctx.stats));
+    statsStartNs = nowNs();
+    STATS_START(&ctx);
+#endif /* R2M_STATS */
+    r2mArenaInit(&ctx.arena, 0);
+    ctx.cache = NULL;
+    memset(&ctx.cacheSt, 0, sizeof(ctx.cacheSt));
+    if (opts.cacheSize && !opts.count &&
+        (ctx.cache = r2mCacheCreate(opts.cacheSize,
+                                    sizeof(cliCached))) == NULL) {
+        fprintf(stderr, "ERROR: out of memory\n");
+        exit(1);
+    }
+    r2mOutInit(&ctx.out, STDOUT_FILENO, outBuf, sizeof(outBuf));
+    if (opts.servePath) {
+        opts.binary = R2M_BIN_LE;       /* responses: r2mBinRule records */
+        st = serve(&ctx, opts.servePath);
+        if (finish(&ctx) != SUCCESS) {
+            st = FAILURE;
+        }
+        exit((st == SUCCESS) ? 0 : 1);
+    }
+    if (opts.binary) {
+        r2mBinBegin(&ctx.bin, &ctx.out, opts.binary);
+    }
+    if (file) {
+        if (nArgs != 0) {
+            usage();
+        }
+        if (strcmp(file, "-") == 0) {
+            st = batch(&ctx, stdin, "<stdin>");
+        } else if (!opts.compact &&
+                   (st = batchMap(&ctx, file)) != R2M_EINVAL) {
+            ;                   /* mmap()ed */
+        } else if ((fp = fopen(file, "r")) == NULL) {
+            fprintf(stderr, "ERROR: failed to open %s\n", file);
+            exit(1);
+        } else {
+            st = batch(&ctx, fp, file);
+            fclose(fp);
+        }
+        if (finish(&ctx) != SUCCESS) {
+            st = FAILURE;
+        }
+        exit((st == SUCCESS) ? 0 : 1);
+    }
 
-    /*
-     * Assume action is accept.
-     * Compare the number of TCAM entries between the following rules:
-     *  1. start:end (accept)
-     *  2. Combination of:
-     *      [0 ... start-1] (reject)
-     *      [0 ... end]     (accept)
-     * then choose the better one.
-     */
-    st = range2masks(start, end, rules);
-    assert(st == SUCCESS);
-    if (argc <= 3) {
-        /*
-         * No optimization
-         */
-        printEntries(rules);
-        exit(0);
+    if (opts.delta) {
+        u32 oldSt, oldEnd;
+
+        if (nArgs != 4) {
+            usage();
+        }
+        for (i = 0; i < nArgs; ++i) {
+            if (parseNumber(args[i], (i == 0) ? &oldSt : (i == 1) ? &oldEnd :
+                            (i == 2) ? &start : &end, &opts) != SUCCESS) {
+                fprintf(stderr, "ERROR: failed to parse %s\n", args[i]);
+                exit(1);
+            }
+        }
+        st = convertDelta(&ctx, oldSt, oldEnd, start, end, ACT_ACCEPT);
+        if (st != SUCCESS) {
+            fprintf(stderr, "ERROR: failed to update %u - %u to %u - %u:"
+                    " %s\n", oldSt, oldEnd, start, end, r2mStrerror(st));
+            exit(1);
+        }
+        exit((finish(&ctx) == SUCCESS) ? 0 : 1);
     }
-    if (start == 0) {
-        /*
-         * No optimization: 'start - 1' is negative.
-         */
-        printEntries(rules);
-        exit(0);
+    if (nArgs != 2) {
+        usage();
+    }
+    if (opts.width) {
+        r2mU128 wStart, wEnd;
+
+        if (parseWide(args[0], &wStart, &opts) != SUCCESS ||
+            parseWide(args[1], &wEnd, &opts) != SUCCESS) {
+            fprintf(stderr, "ERROR: failed to parse %s - %s\n",
+                    args[0], args[1]);
+            exit(1);
+        }
+        st = convertWide(&ctx, wStart, wEnd, ACT_ACCEPT, FALSE);
+        if (st != SUCCESS) {
+            fprintf(stderr, "ERROR: failed to convert %s - %s: %s\n",
+                    args[0], args[1], r2mStrerror(st));
+            exit(1);
+        }
+        exit((finish(&ctx) == SUCCESS) ? 0 : 1);
+    }
+    if (parseNumber(args[0], &start, &opts) != SUCCESS) {
+        fprintf(stderr, "ERROR: failed to parse %s\n", args[0]);
+        exit(1);
+    }
+    if (parseNumber(args[1], &end, &opts) != SUCCESS) {
+        fprintf(stderr, "ERROR: failed to parse %s\n", args[1]);
+        exit(1);
     }
+
     /*
-     * Make two sets of TCAM entries and choose the better one
+     * Assume action is accept.
      */
-    st = range2masks(0, start - 1, rules + 1);
-    assert(st == SUCCESS);
-    st = range2masks(0, end, rules + 2);
-    assert(st == SUCCESS);
-    if ((rules[1].nEnt + rules[2].nEnt) < rules[0].nEnt) {
-        printf("Reject: 0 - %d\n", start - 1);
-        printEntries(rules + 1);
-        printf("Accept: 0 - %d\n", end);
-        printEntries(rules + 2);
-    } else {
-        printEntries(rules);
+    st = convert(&ctx, start, end, ACT_ACCEPT, FALSE);
+    if (st != SUCCESS) {
+        fprintf(stderr, "ERROR: failed to convert %u - %u: %s\n",
+                start, end, r2mStrerror(st));
+        exit(1);
     }
-    exit(0);
+    exit((finish(&ctx) == SUCCESS) ? 0 : 1);
 
     return 0;                   /* make compiler happy */
 }
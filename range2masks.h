@@ -0,0 +1,506 @@
+#ifndef __RANGE2MASKS_H__
+#define __RANGE2MASKS_H__
+
+/*
+ * range2masks.h: librange2masks API
+ *
+ * Copyright (c) 2017, 2018, 2019, 2020, 2021 Yoichi Hariguchi
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the
+ * Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall
+ * be included in all copies or substantial portions of the
+ * Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+ */
+
+#include "local_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+enum {
+    MAXENT  = 2 * 32 - 2,       /* entries of the worst 32-bit range */
+};
+
+/*
+ * Error codes. Every library function returns SUCCESS (0) or
+ * one of the negative values below; nothing is printed.
+ */
+enum {
+    R2M_OK     = SUCCESS,
+    R2M_EFAIL  = FAILURE,       /* generic failure */
+    R2M_EINVAL = -2,            /* invalid argument (e.g. NULL pointer) */
+    R2M_ERANGE = -3,            /* range cannot be represented */
+    R2M_ENOSPC = -4,            /* output buffer too small */
+    R2M_EVERIFY = -5,           /* entries do not match the range */
+};
+
+/*
+ * Decomposition engines. All of them produce the same entries in
+ * the same order (from the end of the range towards the start).
+ */
+typedef enum r2mEngine_ {
+    R2M_ENGINE_LOOP = 0,        /* bit-walking loops (reference) */
+    R2M_ENGINE_CLZ,             /* closed-form clz/ctz block split */
+    R2M_ENGINE_MAX,
+} r2mEngine;
+
+/*
+ * Token types recognized by r2mParseNum()
+ */
+typedef enum r2mTok_ {
+    R2M_TOK_DEC = 0,            /* decimal number */
+    R2M_TOK_HEX,                /* hexadecimal number (0x...) */
+    R2M_TOK_IPV4,               /* IPv4 address */
+} r2mTok;
+
+/*
+ * r2mParseNum() flags
+ */
+enum {
+    R2M_PARSE_ADDR = 1 << 0,    /* tokens w/o "0x" are IPv4 addresses */
+};
+
+typedef struct tcamEnt_ {
+    u32 patt;
+    u32 mask;
+} tcamEnt;
+
+/*
+ * Entries of a converted range. 'ent' is supplied by the caller
+ * (an array, or r2mRuleAlloc() from an arena) and has room for
+ * 'maxEnt' entries. MAXENT is always enough for a 32-bit range.
+ */
+typedef struct aclRule_ {
+    u32      nEnt;              /* number of TCAM entries */
+    u32      maxEnt;            /* room of ent[] */
+    tcamEnt *ent;               /* pattern/mask */
+} aclRule;
+
+#ifdef __SIZEOF_INT128__
+typedef unsigned __int128 r2mU128;
+
+/*
+ * Entries of the width-generic engine (range2masks.hpp). The low W
+ * bits of 'patt' and 'mask' are significant.
+ */
+#define R2M_MAXENT_W(_w_) (2 * (_w_) - 2)   /* worst W-bit range */
+
+/* worst W-bit range of range2entsDirpe() with C-bit chunks */
+#define R2M_MAXENT_DIRPE(_w_,_c_) (2 * ((_w_) / (_c_)) - 1)
+
+typedef struct tcamEnt64_ {
+    u64 patt;
+    u64 mask;
+} tcamEnt64;
+
+typedef struct tcamEntW_ {
+    r2mU128 patt;
+    r2mU128 mask;
+} tcamEntW;
+#endif /* __SIZEOF_INT128__ */
+
+/*
+ * Bump allocator. See r2m_arena.c.
+ */
+typedef struct r2mArenaChunk_ r2mArenaChunk;
+
+typedef struct r2mArena_ {
+    r2mArenaChunk *head;        /* first chunk */
+    r2mArenaChunk *cur;         /* chunk being allocated from */
+    void          *last;        /* last allocation (r2mArenaTrim()) */
+    size_t         chunkSize;   /* default size of a chunk */
+    size_t         bytes;       /* total size of the chunks */
+} r2mArena;
+
+/*
+ * Output stage: text is formatted into a caller-supplied buffer
+ * that is written out with write() when it fills up.
+ */
+enum {
+    R2M_OUT_MINBUF = 128,       /* minimum buffer size */
+};
+
+/*
+ * Tables of the 16-bit (L4 port) engine. See r2m_port.c.
+ */
+typedef struct r2mPortTbl_ r2mPortTbl;
+
+/*
+ * Item of a first-match policy. See r2m_policy.c.
+ */
+typedef struct r2mItem_ {
+    u32 st;                     /* range start */
+    u32 end;                    /* range end */
+    u32 prio;                   /* smaller wins */
+    u8  act;                    /* R2M_ACCEPT or R2M_REJECT */
+} r2mItem;
+
+/*
+ * Multi-field rules. See r2m_multi.c.
+ */
+enum {
+    R2M_MAXFIELD = 8,
+};
+
+typedef struct r2mField_ {
+    u32 st;                     /* range start */
+    u32 end;                    /* range end (< 2^width) */
+    u32 width;                  /* bits of the field (1 ... 32) */
+} r2mField;
+
+typedef struct r2mMultiField_ {
+    u32      width;
+    u32      L;                 /* accept cover [L, R] of [st, end] */
+    u32      R;
+    u32      nRej;
+    u32      nAcc;
+    tcamEnt *rej;               /* [L, st-1] and [end+1, R] */
+    tcamEnt *acc;               /* [L, R] */
+} r2mMultiField;
+
+typedef struct r2mMulti_ {
+    u32           nField;
+    r2mMultiField f[R2M_MAXFIELD];
+    u64           nRej;         /* sum of f[].nRej */
+    u64           nAcc;         /* product of f[].nAcc */
+    u64           direct;       /* product of the direct counts */
+} r2mMulti;
+
+typedef struct r2mMultiIter_ {
+    const r2mMulti *m;
+    u32             field;      /* field of the next reject (nField:
+                                   accepts, > nField: done) */
+    u32             idx;
+    u32             odo[R2M_MAXFIELD];
+} r2mMultiIter;
+
+/*
+ * TCAM writes that update a rule. See r2m_delta.c.
+ */
+typedef struct r2mDelta_ {
+    tcamEnt *del;               /* entries to delete */
+    tcamEnt *add;               /* entries to add */
+    u32      nDel;
+    u32      nAdd;
+    u32      nKeep;             /* old entries that stay */
+} r2mDelta;
+
+/*
+ * Software TCAM classifier. See r2m_match.c.
+ */
+typedef struct r2mMatch_ r2mMatch;
+
+typedef struct r2mMatchRule_ {
+    const tcamEnt *ent;         /* entries of the rule */
+    u32            nEnt;
+    u32            prio;        /* smaller wins */
+    u8             act;         /* R2M_ACCEPT or R2M_REJECT */
+} r2mMatchRule;
+
+/*
+ * Compact store of rules. See r2m_pack.c.
+ */
+typedef struct r2mPack_ r2mPack;
+
+typedef struct r2mPackIter_ {
+    const u8 *p;                /* next byte of the rule */
+    u32       end;              /* chain: end of the next entry */
+    u32       i;                /* entries decoded */
+    u32       nEnt;
+    bool      raw;              /* not a chain: (patt, plen) pairs */
+} r2mPackIter;
+
+/*
+ * Priority-ordered TCAM layout. See r2m_layout.c.
+ */
+typedef struct r2mLayout_ r2mLayout;
+
+typedef struct r2mMove_ {
+    u32 from;                   /* slot of the entry */
+    u32 to;                     /* free slot it is copied into */
+} r2mMove;
+
+/*
+ * Table of distinct entries. See r2m_intern.c.
+ */
+typedef struct r2mIntern_ r2mIntern;
+
+/*
+ * Memoizing cache. See r2m_cache.c.
+ */
+typedef struct r2mCache_ r2mCache;
+
+typedef struct r2mCacheKey_ {
+    u32 st;                     /* range start */
+    u32 end;                    /* range end */
+    u8  width;                  /* key width in bits */
+    u8  flags;                  /* caller defined (e.g. -optimize) */
+} r2mCacheKey;
+
+typedef struct r2mCacheStats_ {
+    u64 hits;
+    u64 misses;
+    u64 evictions;              /* keys replaced when a window was full */
+    u32 used;                   /* slots in use */
+    u32 nSlots;
+} r2mCacheStats;
+
+/*
+ * Structure of arrays result of range2entsBatch()
+ */
+typedef struct r2mSoa_ {
+    u32 *patt;                  /* [n * stride] patterns */
+    u32 *mask;                  /* [n * stride] masks */
+    u32 *count;                 /* [n] number of entries of each range */
+    int *rc;                    /* [n] status of each range (optional) */
+    u32  stride;                /* entries reserved per range */
+} r2mSoa;
+
+/*
+ * Instruction sets of range2entsBatch()
+ */
+enum {
+    R2M_ISA_AUTO = -1,
+    R2M_ISA_SCALAR = 0,
+    R2M_ISA_AVX2,
+    R2M_ISA_AVX512,
+};
+
+/*
+ * Rule actions (binary output tags)
+ */
+enum {
+    R2M_ACCEPT = 0,
+    R2M_REJECT = 1,
+};
+
+typedef struct r2mOut_ {
+    int    fd;                  /* output file descriptor (< 0: none) */
+    char  *buf;                 /* buffer */
+    size_t len;                 /* number of bytes in 'buf' */
+    size_t size;                /* size of 'buf' */
+    int    err;                 /* first error (sticky) */
+    /* If set, called instead of write() to empty 'buf' */
+    int  (*drain)(struct r2mOut_ *o);
+    void  *arg;                 /* for 'drain' */
+} r2mOut;
+
+/*
+ * Binary output format. Every field is in the byte order given by
+ * 'order' and every record is 8-byte aligned, so the file can be
+ * mmap()ed and the tcamEnt arrays copied as they are:
+ *
+ *   r2mBinHdr
+ *   r2mBinRule, tcamEnt[nEnt]     (repeated 'nRules' times)
+ *
+ * A converted range may be split into several rules (e.g. the
+ * -optimize reject + accept pair); such rules share an input record
+ * and are numbered with 'seq' (0 ... nSeq-1) in the priority order.
+ * 'nRules' and 'nEnts' are 0 when the output is not seekable; read
+ * rules until EOF in that case.
+ */
+#define R2M_BIN_MAGIC   "R2MB"
+
+enum {
+    R2M_BIN_VERSION = 1,
+    R2M_BIN_LE      = 1,        /* little endian */
+    R2M_BIN_BE      = 2,        /* big endian */
+};
+
+typedef struct r2mBinHdr_ {
+    char magic[4];              /* R2M_BIN_MAGIC */
+    u8   version;               /* R2M_BIN_VERSION */
+    u8   order;                 /* R2M_BIN_LE or R2M_BIN_BE */
+    u16  hdrLen;                /* sizeof(r2mBinHdr) */
+    u32  nRules;                /* number of r2mBinRule (0: unknown) */
+    u32  nEnts;                 /* total number of tcamEnt */
+} r2mBinHdr;
+
+typedef struct r2mBinRule_ {
+    u32 st;                     /* range start */
+    u32 end;                    /* range end */
+    u32 nEnt;                   /* number of tcamEnt that follow */
+    u8  tag;                    /* R2M_ACCEPT or R2M_REJECT */
+    u8  seq;                    /* index in the input record */
+    u8  nSeq;                   /* number of rules of the input record */
+    u8  rsvd;
+} r2mBinRule;
+
+typedef struct r2mBin_ {
+    r2mOut *o;                  /* output stage */
+    u8      order;              /* R2M_BIN_LE or R2M_BIN_BE */
+    off_t   hdrOff;             /* header offset (< 0: not seekable) */
+    u32     nRules;
+    u32     nEnts;
+} r2mBin;
+
+/*
+ * Server protocol (range2masks -serve <path>). A client writes
+ * r2mSrvReq records to the Unix domain socket and may pipeline as
+ * many as it likes. For each request, in the order received, the
+ * server writes an r2mSrvRsp followed by 'nRules' r2mBinRule records,
+ * each with its tcamEnt records, as in the binary output. Every
+ * field is in the host byte order: the socket is local. A client
+ * must keep reading; the server stops reading from a client whose
+ * responses pile up.
+ */
+typedef struct r2mSrvReq_ {
+    u32 id;                     /* echoed in the response */
+    u32 st;                     /* range start */
+    u32 end;                    /* range end */
+    u8  tag;                    /* R2M_ACCEPT or R2M_REJECT */
+    u8  rsvd[3];
+} r2mSrvReq;
+
+typedef struct r2mSrvRsp_ {
+    u32 id;                     /* r2mSrvReq.id */
+    s32 rc;                     /* SUCCESS or R2M_Exxx */
+    u32 nRules;                 /* number of r2mBinRule that follow */
+    u32 nEnts;                  /* total number of tcamEnt */
+} r2mSrvRsp;
+
+
+const char *r2mStrerror (int err);
+int         mask2plen (u32 mask);
+int         ipv4a2h (const char *s, u32 *addr);
+int         r2mParseNum (const char *s, size_t len, u32 flags, u32 *val,
+                         r2mTok *kind);
+void        r2mArenaInit (r2mArena *a, size_t chunkSize);
+void       *r2mArenaAlloc (r2mArena *a, size_t size);
+void        r2mArenaTrim (r2mArena *a, void *p, size_t size);
+void        r2mArenaReset (r2mArena *a);
+void        r2mArenaFree (r2mArena *a);
+int         r2mRuleAlloc (r2mArena *a, aclRule *p, u32 maxEnt);
+void        r2mRuleTrim (r2mArena *a, aclRule *p);
+int         range2masksArena (r2mEngine eng, u32 st, u32 end, r2mArena *a,
+                              aclRule *pRule);
+int         range2ents (u32 st, u32 end, tcamEnt *ent, u32 maxEnt,
+                        u32 *pnEnt);
+int         range2entsClz (u32 st, u32 end, tcamEnt *ent, u32 maxEnt,
+                           u32 *pnEnt);
+int         range2entsFull (u32 st, u32 end, tcamEnt *ent, u32 maxEnt,
+                            u32 *pnEnt);
+u32         r2mCount (u32 st, u32 end);
+u32         r2mCountOpt (u32 st, u32 end, u32 *pnReject, u32 *pnAccept);
+u32         r2mCountMin (u32 width, u32 st, u32 end);
+int         r2mOptimize (u32 width, u32 st, u32 end, tcamEnt *ent, u8 *inv,
+                         u32 maxEnt, u32 *pnEnt);
+int         range2entsEngine (r2mEngine eng, u32 st, u32 end,
+                              tcamEnt *ent, u32 maxEnt, u32 *pnEnt);
+int         range2masks (u32 st, u32 end, aclRule* pRule);
+int         range2masksEngine (r2mEngine eng, u32 st, u32 end,
+                               aclRule* pRule);
+const char *r2mEngineName (r2mEngine eng);
+r2mPortTbl *r2mPortTblCreate (void);
+void        r2mPortTblDestroy (r2mPortTbl *t);
+size_t      r2mPortTblSize (void);
+int         range2entsPort (const r2mPortTbl *t, u32 st, u32 end,
+                            tcamEnt *ent, u32 maxEnt, u32 *pnEnt);
+int         r2mCompact (const r2mItem *in, u32 n, r2mItem *out, u32 maxOut,
+                        u32 *pnOut);
+u64         r2mMultiEstimate (const r2mField *fld, u32 n, u64 *pnDirect);
+int         r2mMultiCompile (const r2mField *fld, u32 n, r2mArena *a,
+                             r2mMulti *m);
+void        r2mMultiIterInit (r2mMultiIter *it, const r2mMulti *m);
+bool        r2mMultiNext (r2mMultiIter *it, tcamEnt *ent, bool *pReject);
+int         r2mVerify (const tcamEnt *ent, const u8 *inv, u32 n, u32 st,
+                       u32 end, r2mArena *a, u32 *pBad);
+int         r2mDeltaEnts (const tcamEnt *old, u32 nOld, u32 st, u32 end,
+                          r2mArena *a, r2mDelta *d);
+int         r2mDeltaRange (u32 oldSt, u32 oldEnd, u32 st, u32 end,
+                           r2mArena *a, r2mDelta *d);
+r2mMatch   *r2mMatchCreate (const r2mMatchRule *rules, u32 n);
+void        r2mMatchDestroy (r2mMatch *m);
+size_t      r2mMatchSize (const r2mMatch *m);
+int         r2mMatchLookup (const r2mMatch *m, u32 key);
+void        r2mMatchBatch (const r2mMatch *m, const u32 *key, u32 n,
+                           s32 *rule);
+r2mPack    *r2mPackCreate (void);
+void        r2mPackDestroy (r2mPack *p);
+int         r2mPackAdd (r2mPack *p, const tcamEnt *ent, u32 nEnt, u32 *pId);
+size_t      r2mPackSize (const r2mPack *p, u32 *pn, u64 *pnEnt);
+int         r2mPackIterInit (r2mPackIter *it, const r2mPack *p, u32 id);
+bool        r2mPackNext (r2mPackIter *it, tcamEnt *ent);
+int         r2mPackGet (const r2mPack *p, u32 id, tcamEnt *ent, u32 maxEnt,
+                        u32 *pnEnt);
+r2mLayout  *r2mLayoutCreate (u32 nSlots);
+void        r2mLayoutDestroy (r2mLayout *l);
+int         r2mLayoutPlan (r2mLayout *l, const u32 *prio, u32 n, u32 *slot);
+int         r2mLayoutInsert (r2mLayout *l, u32 prio, r2mMove *mv, u32 maxMv,
+                             u32 *pnMv, u32 *pSlot);
+int         r2mLayoutDelete (r2mLayout *l, u32 slot);
+u32         r2mLayoutUsed (const r2mLayout *l);
+r2mIntern  *r2mInternCreate (u32 nHint);
+void        r2mInternDestroy (r2mIntern *t);
+int         r2mInternAdd (r2mIntern *t, const tcamEnt *e, u32 *pId);
+const tcamEnt *r2mInternEnts (const r2mIntern *t, u32 *pnEnt, u64 *pnRef);
+r2mCache   *r2mCacheCreate (u32 nSlots, size_t valSize);
+void        r2mCacheDestroy (r2mCache *c);
+void       *r2mCacheGet (r2mCache *c, const r2mCacheKey *k);
+void       *r2mCachePut (r2mCache *c, const r2mCacheKey *k);
+void        r2mCacheGetStats (const r2mCache *c, r2mCacheStats *st);
+#ifdef __SIZEOF_INT128__
+int         range2entsWide (u32 width, r2mU128 st, r2mU128 end,
+                            tcamEntW *ent, u32 maxEnt, u32 *pnEnt);
+int         range2ents64 (u64 st, u64 end, tcamEnt64 *ent, u32 maxEnt,
+                          u32 *pnEnt);
+int         range2ents128 (r2mU128 st, r2mU128 end, tcamEntW *ent,
+                           u32 maxEnt, u32 *pnEnt);
+u32         r2mDirpeWidth (u32 width, u32 chunk);
+r2mU128     r2mDirpeKey (u32 width, u32 chunk, u32 key);
+int         range2entsDirpe (u32 width, u32 chunk, u32 st, u32 end,
+                             tcamEntW *ent, u32 maxEnt, u32 *pnEnt);
+void        r2mOutTernaryW (r2mOut *o, r2mU128 patt, r2mU128 mask,
+                            u32 width, u32 group);
+int         r2mParseWide (const char *s, size_t len, u32 flags, u32 width,
+                          r2mU128 *val);
+void        r2mOutRangeWide (r2mOut *o, const char *label, r2mU128 st,
+                             r2mU128 end);
+void        r2mOutRuleWide (r2mOut *o, u32 width, const tcamEntW *ent,
+                            u32 nEnt, bool verbose);
+#endif /* __SIZEOF_INT128__ */
+int         r2mSimdBest (void);
+int         range2entsBatch (int isa, const u32 *st, const u32 *end, u32 n,
+                             r2mSoa *o);
+int         r2mEngineByName (const char *name, r2mEngine *eng);
+
+int         r2mOutInit (r2mOut *o, int fd, char *buf, size_t size);
+int         r2mOutFlush (r2mOut *o);
+void        r2mOutStr (r2mOut *o, const char *s);
+void        r2mOutU32 (r2mOut *o, u32 v);
+void        r2mOutU64 (r2mOut *o, u64 v);
+void        r2mOutRange (r2mOut *o, const char *label, u32 st, u32 end);
+void        r2mOutPrefix (r2mOut *o, u32 patt, u32 mask);
+void        r2mOutEntry (r2mOut *o, u32 patt, u32 mask);
+void        r2mOutRule (r2mOut *o, const aclRule *p, bool verbose);
+void        r2mOutMultiEnt (r2mOut *o, const char *label, const r2mMulti *m,
+                            const tcamEnt *ent);
+int         r2mBinBegin (r2mBin *b, r2mOut *o, int order);
+void        r2mBinPutRule (r2mBin *b, u32 st, u32 end, int tag, int seq,
+                           int nSeq, const aclRule *p);
+int         r2mBinEnd (r2mBin *b);
+int         r2mBinCheck (const void *p, size_t len, u32 *order);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __RANGE2MASKS_H__ */
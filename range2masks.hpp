@@ -0,0 +1,255 @@
+/*
+ * range2masks.hpp: width-generic range to TCAM entry conversion
+ *
+ * Copyright (c) 2017, 2018, 2019, 2020, 2021 Yoichi Hariguchi
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the
+ * Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall
+ * be included in all copies or substantial portions of the
+ * Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+ */
+
+#ifndef __RANGE2MASKS_HPP__
+#define __RANGE2MASKS_HPP__
+
+/*
+ * range2ents() for keys of W bits (W = 8, 16, 32, 64, 128).
+ *
+ * Each width is a separate instantiation on the narrowest native
+ * integer: u8 ... u64, and unsigned __int128 for 128-bit keys (IPv6
+ * addresses). boost's u128 from local_types.h is only used when the
+ * compiler has no __int128. Unlike range2ents(), the full range
+ * [0, 2^W - 1] is accepted.
+ *
+ * Entries are made top-down from 'end' exactly like range2entsClz():
+ * the block ending at 'end' is 2^k, k = min(ctz(~end), log2(size)).
+ *
+ * Everything is constexpr (except with boost's u128), so well-known
+ * ranges can be converted by the compiler into tables in .rodata:
+ *
+ *   static constexpr auto eph = r2m::rule<1024, 65535>();
+ *   static_assert(eph.nEnt == 6);
+ *   ... eph.ent[i].patt, eph.ent[i].mask (tcamEnt) ...
+ */
+
+#include "range2masks.h"
+
+namespace r2m {
+
+template <unsigned W> struct width;
+
+template <> struct width<8>   { typedef u8  key; };
+template <> struct width<16>  { typedef u16 key; };
+template <> struct width<32>  { typedef u32 key; };
+template <> struct width<64>  { typedef u64 key; };
+#ifdef __SIZEOF_INT128__
+template <> struct width<128> { typedef r2mU128 key; };
+#else
+template <> struct width<128> { typedef u128 key; };
+#endif /* __SIZEOF_INT128__ */
+
+/* Worst case number of entries of a W-bit range */
+template <unsigned W>
+constexpr u32 maxEnt () { return 2 * W - 2; }
+
+template <unsigned W>
+struct ent {
+    typename width<W>::key patt;
+    typename width<W>::key mask;
+};
+
+/* Number of trailing 0s of v (v != 0) */
+template <typename T>
+constexpr int
+ctz (T v)
+{
+    if constexpr (sizeof(T) <= sizeof(unsigned)) {
+        return __builtin_ctz(v);
+    } else if constexpr (sizeof(T) <= sizeof(unsigned long long)) {
+        return __builtin_ctzll(v);
+#ifdef __SIZEOF_INT128__
+    } else if constexpr (std::is_same<T, r2mU128>::value) {
+        u64 lo = (u64)v;
+
+        return lo ? __builtin_ctzll(lo) : 64 + __builtin_ctzll((u64)(v >> 64));
+#endif /* __SIZEOF_INT128__ */
+    } else {
+        return boost::multiprecision::lsb(v);
+    }
+}
+
+/* Index of the highest 1 of v (v != 0) */
+template <typename T>
+constexpr int
+log2 (T v)
+{
+    if constexpr (sizeof(T) <= sizeof(unsigned)) {
+        return 8 * sizeof(unsigned) - 1 - __builtin_clz(v);
+    } else if constexpr (sizeof(T) <= sizeof(unsigned long long)) {
+        return 63 - __builtin_clzll(v);
+#ifdef __SIZEOF_INT128__
+    } else if constexpr (std::is_same<T, r2mU128>::value) {
+        u64 hi = (u64)(v >> 64);
+
+        return hi ? 127 - __builtin_clzll(hi) : 63 - __builtin_clzll((u64)v);
+#endif /* __SIZEOF_INT128__ */
+    } else {
+        return boost::multiprecision::msb(v);
+    }
+}
+
+/**
+ * @name  range2ents
+ *
+ * @brief Converts [st, end] of W-bit keys into TCAM entries
+ *
+ * @param[in]  st     Number that the range starts
+ * @param[in]  end    Number that the range ends
+ * @param[out] e      Array of (pattern, mask) receiving the result
+ * @param[in]  maxEnt Number of elements of 'e' (maxEnt<W>() always fits)
+ * @param[out] pnEnt  Number of entries stored in 'e'
+ *
+ * @retval SUCCESS    The range is converted (no entry if st > end)
+ * @retval R2M_EINVAL 'e' or 'pnEnt' is NULL
+ * @retval R2M_ENOSPC 'maxEnt' is too small (the first 'maxEnt'
+ *                    entries are stored)
+ */
+template <unsigned W>
+constexpr int
+range2ents (typename width<W>::key st, typename width<W>::key end,
+            ent<W> *e, u32 maxEnt, u32 *pnEnt)
+{
+    typedef typename width<W>::key T;
+    const T ones = ~T(0);
+    T size1 = 0;                /* range size - 1 */
+    T mask = 0;
+    int k = 0, kmax = 0;
+    u32 n = 0;
+
+
+    if (!e || !pnEnt) {
+        return R2M_EINVAL;
+    }
+    *pnEnt = 0;
+    if (st > end) {
+        return SUCCESS;
+    }
+
+    for (n = 0; ; ++n) {
+        if (n >= maxEnt) {
+            *pnEnt = n;
+            return R2M_ENOSPC;
+        }
+        size1 = end - st;
+        if (size1 == ones) {    /* [0, 2^W - 1] */
+            e[n].patt = 0;
+            e[n].mask = 0;
+            break;
+        }
+        k    = (end == ones) ? W : ctz(T(~end));
+        kmax = log2(T(size1 + 1));
+        if (k > kmax) {
+            k = kmax;
+        }
+        mask = T(ones << k);
+        e[n].patt = T(end & mask);
+        e[n].mask = mask;
+        if (e[n].patt == st) {
+            break;
+        }
+        end = T(e[n].patt - 1);
+    }
+    *pnEnt = n + 1;
+    return SUCCESS;
+}
+
+/*
+ * Result of entries(): room for the worst case
+ */
+template <unsigned W>
+struct table {
+    ent<W> e[maxEnt<W>()] = {};
+    u32    nEnt = 0;
+};
+
+/**
+ * @name  entries
+ *
+ * @brief Converts [st, end] of W-bit keys into a table (see
+ *        range2ents()). st > end gives no entry.
+ *
+ * @param[in] st  Number that the range starts
+ * @param[in] end Number that the range ends
+ *
+ * @retval Entries
+ */
+template <unsigned W>
+constexpr table<W>
+entries (typename width<W>::key st, typename width<W>::key end)
+{
+    table<W> t;
+
+    range2ents<W>(st, end, t.e, maxEnt<W>(), &t.nEnt);
+    return t;
+}
+
+/* Number of entries of [st, end] of W-bit keys */
+template <unsigned W>
+constexpr u32
+count (typename width<W>::key st, typename width<W>::key end)
+{
+    return entries<W>(st, end).nEnt;
+}
+
+/*
+ * Result of rule(): exactly the entries of a 32-bit range, in the
+ * order of range2masks()
+ */
+template <u32 N>
+struct tcamTable {
+    static constexpr u32 nEnt = N;
+    tcamEnt ent[(N) ? N : 1] = {};
+};
+
+/**
+ * @name  rule
+ *
+ * @brief Converts [St, End] of 32-bit keys into a table sized to fit
+ *
+ * @retval Entries (St > End: nEnt is 0)
+ */
+template <u32 St, u32 End>
+constexpr tcamTable<count<32>(St, End)>
+rule ()
+{
+    table<32> t = entries<32>(St, End);
+    tcamTable<count<32>(St, End)> r;
+    u32 i = 0;
+
+    for (i = 0; i < t.nEnt; ++i) {
+        r.ent[i].patt = t.e[i].patt;
+        r.ent[i].mask = t.e[i].mask;
+    }
+    return r;
+}
+
+} /* namespace r2m */
+
+#endif /* __RANGE2MASKS_HPP__ */